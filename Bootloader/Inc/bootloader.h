@@ -0,0 +1,19 @@
+#ifndef BOOTLOADER_H
+#define BOOTLOADER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Resident bootloader in sector 0 (STM32F411CEUX_FLASH.ld in this directory)
+// Slots, header and stream protocol: ../Firmware/Inc/update.h
+#define Boot_Default_Baud		9600U		// No hand-over (blank slots, button held): Cfg_Baud default, HC-05 factory rate
+#define Boot_HSE_Timeout		100000U		// HSE ready polls before staying on HSI
+#define Boot_Button_Settle		1000U		// Polls between the PA0 pull-up and the button read
+#define Boot_Line_Size			32			// <U,length,crc> start line
+#define Boot_Resync_Quiet_ms	20			// Line silent this long before the frame DMA is re-armed
+
+// USART1_RX: DMA2 stream 2, channel 4
+#define Boot_Dma_Channel		4U
+#define Boot_Dma_Flags			(0x3DU << 16)	// Stream 2 FEIF..TCIF in LISR / LIFCR
+
+#endif /* BOOTLOADER_H */
@@ -0,0 +1,459 @@
+#include "main.h"
+#include "boot.h"
+#include "drive_mix.h"
+#include "failsafe.h"
+#include "flash.h"
+#include "update.h"
+#include "bootloader.h"
+
+// Resident bootloader: starts the newest usable application slot, or takes a new image over USART1
+// Frames land in two RAM buffers by DMA while the previous one is checked and programmed:
+// the CPU stalls on flash during every word program, polled reception would drop bytes
+
+static volatile Update_Frame frames[2];	// Written by the DMA
+static uint32_t clk = HSI_Freq;			// SYSCLK, SysClk once the HSE is in
+static uint32_t ms = 0;
+
+void SystemInit(void)
+{
+	// Registers only (before .data/.bss): L298N enables and servo low, as the application's boot.c
+	// An update session can last seconds, the pins must not float (PA15 JTDI pull-up moves the servo)
+	const uint32_t pa = (1U << Motor) | (1U << Motor_W3) | (1U << Servo);
+	const uint32_t pb = (1U << Motor_W1) | (1U << Motor_W2);
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOBEN;
+	GPIOA->BSRR = pa << 16;
+	GPIOB->BSRR = pb << 16;
+
+	for (uint8_t pin = 0; pin < 16; pin++)
+	{
+		if (pa & (1U << pin))
+		{
+			GPIOA->PUPDR &= ~(3U << (pin * 2));
+			GPIOA->MODER = (GPIOA->MODER & ~(3U << (pin * 2))) | (1U << (pin * 2));	// 01: Output mode
+		}
+		if (pb & (1U << pin))
+		{
+			GPIOB->PUPDR &= ~(3U << (pin * 2));
+			GPIOB->MODER = (GPIOB->MODER & ~(3U << (pin * 2))) | (1U << (pin * 2));
+		}
+	}
+}
+
+void Watchdog_Stretch(bool erase)
+{
+	// flash.c: no IWDG while the bootloader runs, it is only started for a trial boot
+	(void)erase;
+}
+
+// ----------------------------------------------------
+// Clock, time, USART1
+// ----------------------------------------------------
+
+static void Boot_Clock_Init(void)
+{
+	// HSE for an exact BRR at the fast rates (HSI: 1% trim), time base from the SysTick flag
+	RCC->CR |= RCC_CR_HSEON;
+	for (uint32_t n = 0; n < Boot_HSE_Timeout; n++)
+	{
+		if (RCC->CR & RCC_CR_HSERDY)
+		{
+			RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_HSE;
+			while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSE) {}
+			clk = SysClk;
+			break;
+		}
+	}
+
+	SysTick->LOAD = clk / 1000U - 1U;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;	// No interrupt
+}
+
+static uint32_t Boot_Millis(void)
+{
+	// Counts the wraps it sees: flash stalls only stretch the timeouts
+	if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk) ms++;
+	return ms;
+}
+
+static void Boot_Uart_Init(uint32_t brr)
+{
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_DMA2EN | RCC_AHB1ENR_CRCEN;
+	RCC->APB2ENR |= RCC_APB2ENR_USART1EN;
+
+	// PA9 (TX1) / PA10 (RX1), AF7, as UART1_Init()
+	GPIOA->MODER = (GPIOA->MODER & ~((3U << (Tx1 * 2)) | (3U << (Rx1 * 2)))) | (2U << (Tx1 * 2)) | (2U << (Rx1 * 2));
+	GPIOA->AFR[1] = (GPIOA->AFR[1] & ~((0xFU << ((Tx1 - 8) * 4)) | (0xFU << ((Rx1 - 8) * 4))))
+			| (7U << ((Tx1 - 8) * 4)) | (7U << ((Rx1 - 8) * 4));
+	GPIOA->OSPEEDR |= (3U << (Tx1 * 2)) | (3U << (Rx1 * 2));
+
+	USART1->CR1 = 0;
+	USART1->BRR = brr;
+	USART1->CR1 = USART_CR1_TE | USART_CR1_RE | USART_CR1_UE;	// Polled, RX by DMA while streaming
+}
+
+static void Boot_Send_Char(char c)
+{
+	while (!(USART1->SR & USART_SR_TXE)) {}
+	USART1->DR = (uint8_t)c;
+}
+
+static void Boot_Send_Str(const char *str)
+{
+	while (*str) Boot_Send_Char(*str++);
+}
+
+static void Boot_Send_Uint(uint32_t value)
+{
+	char digits[10];
+	uint8_t n = 0;
+
+	do {
+		digits[n++] = (char)('0' + value % 10U);
+		value /= 10U;
+	} while (value);
+
+	while (n) Boot_Send_Char(digits[--n]);
+}
+
+static void Boot_Reply(char code, uint32_t value)
+{
+	// <U,code,value>
+	Boot_Send_Str("<U,");
+	Boot_Send_Char(code);
+	Boot_Send_Char(',');
+	Boot_Send_Uint(value);
+	Boot_Send_Str(">\r\n");
+}
+
+// ----------------------------------------------------
+// Slots
+// ----------------------------------------------------
+
+static const Update_Header *Boot_Header(uint8_t slot)
+{
+	return (const Update_Header *)Update_Slot_Addr(slot);
+}
+
+static const uint32_t *Boot_Image(uint8_t slot)
+{
+	return (const uint32_t *)(Update_Slot_Addr(slot) + Update_Header_Size);
+}
+
+static uint32_t Boot_Crc(const volatile uint32_t *words, uint32_t count)
+{
+	// CRC unit: poly 0x04C11DB7, init 0xFFFFFFFF, one word per write
+	CRC->CR = CRC_CR_RESET;
+	for (uint32_t n = 0; n < count; n++) CRC->DR = words[n];
+	return CRC->DR;
+}
+
+static uint8_t Boot_Tries_Used(const Update_Header *h)
+{
+	uint8_t n = 0;
+	while (n < Update_Tries && h->tries[n] != Flash_Erased) n++;
+	return n;
+}
+
+static bool Boot_Slot_Usable(uint8_t slot)
+{
+	// Confirmed, or on trial with boots left and the image intact
+	// A confirmed image was checked when committed and on its trial boots: no CRC pass on every reset
+	const Update_Header *h = Boot_Header(slot);
+
+	if (h->magic != Update_Magic || h->length == 0 || h->length > Update_Image_Max || (h->length & 3U)) return 0;
+	if (h->confirmed != Flash_Erased) return 1;
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+	return Boot_Tries_Used(h) < Update_Tries && Boot_Crc(Boot_Image(slot), h->length / 4U) == h->crc;
+}
+
+static uint8_t Boot_Select(void)
+{
+	// Newest slot first, the other one is the fallback
+	const Update_Header *a = Boot_Header(0), *b = Boot_Header(1);
+	uint8_t first = (b->magic == Update_Magic && (a->magic != Update_Magic || b->version > a->version)) ? 1 : 0;
+
+	if (Boot_Slot_Usable(first)) return first;
+	if (Boot_Slot_Usable(first ^ 1U)) return first ^ 1U;
+	return Update_No_Slot;
+}
+
+static void Boot_Start(uint8_t slot)
+{
+	// Straight from reset (HSI, no SysTick, USART1 off): the application's boot timing stays valid
+	const Update_Header *h = Boot_Header(slot);
+	const uint32_t *vectors = Boot_Image(slot);
+
+	if (h->confirmed == Flash_Erased)
+	{
+		// Trial boot: counted, and the IWDG runs before the image starts its own (Watchdog_Init())
+		Flash_Program_Word((uint32_t)&h->tries[Boot_Tries_Used(h)], 0);
+
+		IWDG->KR = Watchdog_Key_Start;
+		IWDG->KR = Watchdog_Key_Access;
+		IWDG->PR = Watchdog_PR_Code;
+		IWDG->RLR = Watchdog_Count(Watchdog_Erase_ms) - 1U;
+		IWDG->KR = Watchdog_Key_Reload;
+	}
+
+	RCC->AHB1ENR &= ~RCC_AHB1ENR_CRCEN;
+	RCC->APB1ENR &= ~RCC_APB1ENR_PWREN;
+
+	SCB->VTOR = (uint32_t)vectors;
+	__DSB();
+	__ISB();
+	__set_MSP(vectors[0]);
+	((void (*)(void))vectors[1])();		// Reset_Handler, does not return
+}
+
+// ----------------------------------------------------
+// Update session
+// ----------------------------------------------------
+
+static void Boot_Dma_Start(void)
+{
+	// Frames into frames[0] / frames[1] alternately (double buffer mode), one frame per transfer
+	DMA2_Stream2->CR = 0;
+	while (DMA2_Stream2->CR & DMA_SxCR_EN) {}
+	DMA2->LIFCR = Boot_Dma_Flags;
+
+	DMA2_Stream2->PAR = (uint32_t)&USART1->DR;
+	DMA2_Stream2->M0AR = (uint32_t)&frames[0];
+	DMA2_Stream2->M1AR = (uint32_t)&frames[1];
+	DMA2_Stream2->NDTR = sizeof(Update_Frame);
+	DMA2_Stream2->CR = (Boot_Dma_Channel << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_DBM | DMA_SxCR_MINC;	// Bytes, peripheral to memory
+
+	(void)USART1->SR;
+	(void)USART1->DR;						// Stale byte / ORE from before
+	USART1->CR3 |= USART_CR3_DMAR;
+	DMA2_Stream2->CR |= DMA_SxCR_EN;
+}
+
+static void Boot_Dma_Stop(void)
+{
+	USART1->CR3 &= ~USART_CR3_DMAR;
+	DMA2_Stream2->CR &= ~DMA_SxCR_EN;
+	while (DMA2_Stream2->CR & DMA_SxCR_EN) {}
+}
+
+static void Boot_Resync(uint16_t seq)
+{
+	// Bad, out of order or torn frame: the host stops at <U,N,seq>, what is in flight is dropped
+	Boot_Dma_Stop();
+	Boot_Reply('N', seq);
+
+	uint32_t quiet = Boot_Millis();
+	while (Boot_Millis() - quiet < Boot_Resync_Quiet_ms)
+	{
+		if (USART1->SR & USART_SR_RXNE)
+		{
+			(void)USART1->DR;
+			quiet = Boot_Millis();
+		}
+	}
+
+	Boot_Dma_Start();
+}
+
+static bool Boot_Receive(uint8_t slot, uint32_t length, uint32_t crc)
+{
+	// Stream one image into the slot, true: committed
+	const Update_Header *h = Boot_Header(slot);
+	const Update_Header *other = Boot_Header(slot ^ 1U);
+	const uint32_t base = (uint32_t)Boot_Image(slot);
+
+	if (length == 0 || length > Update_Image_Max || (length & 3U) || !Flash_Erase_Sector(Update_Slot_Sector(slot)))
+	{
+		Boot_Send_Str("<U,E>\r\n");
+		return 0;
+	}
+
+	Boot_Send_Str("<U,G>\r\n");
+	Boot_Dma_Start();
+
+	uint32_t received = 0;
+	uint16_t seq = 0;
+	uint8_t buf = 0;					// Buffer the next completed frame is in
+	uint32_t last = Boot_Millis();		// Last completed frame, or resync
+
+	while (received < length)
+	{
+		uint32_t now = Boot_Millis();
+
+		if (!(DMA2->LISR & DMA_LISR_TCIF2))
+		{
+			if (now - last >= Update_Idle_Timeout_ms) break;	// Host gone
+			if (DMA2_Stream2->NDTR != sizeof(Update_Frame) && now - last >= Update_Frame_Timeout_ms)
+			{
+				Boot_Resync(seq);		// Lost byte: the frame never completes
+				buf = 0;
+				last = Boot_Millis();
+			}
+			continue;
+		}
+
+		// The DMA has moved on to the other buffer, the host sends no more until this one is acknowledged
+		DMA2->LIFCR = DMA_LIFCR_CTCIF2;
+		const volatile Update_Frame *f = &frames[buf];
+		buf ^= 1U;
+		last = now;
+
+		uint32_t len = (length - received < Update_Chunk) ? length - received : Update_Chunk;
+		if (f->seq != seq || f->len != len || Boot_Crc((const volatile uint32_t *)f, (sizeof(Update_Frame) - 4U) / 4U) != f->crc)
+		{
+			Boot_Resync(seq);
+			buf = 0;
+			last = Boot_Millis();
+			continue;
+		}
+
+		for (uint32_t w = 0; w < len / 4U; w++)
+		{
+			if (!Flash_Program_Word(base + received + w * 4U, f->data[w]))
+			{
+				Boot_Dma_Stop();
+				Boot_Send_Str("<U,F>\r\n");
+				return 0;
+			}
+		}
+
+		received += len;
+		Boot_Reply('A', seq++);
+	}
+
+	Boot_Dma_Stop();
+	if (received < length) return 0;
+
+	// Commit: whole image read back, header words, magic last
+	uint32_t version = (other->magic == Update_Magic) ? other->version + 1U : 1U;
+	if (Boot_Crc((const uint32_t *)base, length / 4U) != crc
+			|| !Flash_Program_Word((uint32_t)&h->length, length)
+			|| !Flash_Program_Word((uint32_t)&h->crc, crc)
+			|| !Flash_Program_Word((uint32_t)&h->version, version)
+			|| !Flash_Program_Word((uint32_t)&h->magic, Update_Magic))
+	{
+		Boot_Send_Str("<U,F>\r\n");
+		return 0;
+	}
+
+	Boot_Send_Str("<U,D,");
+	Boot_Send_Uint(slot);
+	Boot_Send_Char(',');
+	Boot_Send_Uint(version);
+	Boot_Send_Str(">\r\n");
+	return 1;
+}
+
+static bool Boot_Parse_Start(const char *s, uint32_t *length, uint32_t *crc)
+{
+	// U,length,crc (decimal)
+	uint32_t v[2] = { 0, 0 };
+
+	if (s[0] != 'U' || s[1] != ',') return 0;
+	s += 2;
+
+	for (uint8_t n = 0; n < 2; n++)
+	{
+		if (*s < '0' || *s > '9') return 0;
+		while (*s >= '0' && *s <= '9') v[n] = v[n] * 10U + (uint32_t)(*s++ - '0');
+		if (*s++ != (n ? '\0' : ',')) return 0;
+	}
+
+	*length = v[0];
+	*crc = v[1];
+	return 1;
+}
+
+static void Boot_Update(uint8_t installed, uint32_t brr)
+{
+	// Never overwrites the image that boots now, reset when done or when the host goes quiet
+	uint8_t slot = (installed == 0) ? 1 : 0;
+	char line[Boot_Line_Size];
+	uint8_t n = 0;
+	bool in_line = 0;
+
+	Boot_Uart_Init(brr);
+
+	uint32_t announce = Boot_Millis() - Update_Announce_ms;
+	uint32_t last_rx = Boot_Millis();
+
+	while (1)
+	{
+		uint32_t now = Boot_Millis();
+
+		if (now - announce >= Update_Announce_ms)
+		{
+			announce = now;
+			Boot_Send_Str("<U,R,");
+			Boot_Send_Uint(slot);
+			Boot_Send_Char(',');
+			Boot_Send_Uint(Update_Image_Max);
+			Boot_Send_Str(">\r\n");
+		}
+
+		if (installed != Update_No_Slot && now - last_rx >= Update_Idle_Timeout_ms) break;
+
+		if (!(USART1->SR & USART_SR_RXNE)) continue;
+		char c = (char)USART1->DR;
+		last_rx = now;
+
+		if (c == '<')
+		{
+			in_line = 1;
+			n = 0;
+		}
+		else if (in_line && c == '>')
+		{
+			uint32_t length, crc;
+			line[n] = '\0';
+			in_line = 0;
+			if (Boot_Parse_Start(line, &length, &crc))
+			{
+				if (Boot_Receive(slot, length, crc)) break;
+				last_rx = Boot_Millis();
+			}
+		}
+		else if (in_line)
+		{
+			if (n < Boot_Line_Size - 1) line[n++] = c;
+			else in_line = 0;			// Not a start line
+		}
+	}
+
+	while (!(USART1->SR & USART_SR_TC)) {}
+	NVIC_SystemReset();					// Into the new image (on trial), or back to the installed one
+}
+
+static bool Boot_Button_Held(void)
+{
+	// PA0 low at reset (active low, pull-up): stay here, recovery when no image answers <U>
+	GPIOA->PUPDR = (GPIOA->PUPDR & ~(3U << (Btn * 2))) | (1U << (Btn * 2));
+	for (volatile uint32_t n = 0; n < Boot_Button_Settle; n++) {}
+	bool held = !(GPIOA->IDR & (1U << Btn));
+	GPIOA->PUPDR &= ~(3U << (Btn * 2));
+	return held;
+}
+
+int main(void)
+{
+	// Hand-over from the application (Update_Enter()): request flag and the link's BRR
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+	PWR->CR |= PWR_CR_DBP;
+	bool requested = (RTC->BKP0R == Update_Request_Magic);
+	uint32_t brr = RTC->BKP1R;
+	RTC->BKP0R = 0;						// One session per request
+
+	uint8_t slot = Boot_Select();
+	if (!requested && !Boot_Button_Held() && slot != Update_No_Slot) Boot_Start(slot);
+
+	Boot_Clock_Init();
+	if (!requested || brr == 0)
+		brr = (clk + Boot_Default_Baud / 2) / Boot_Default_Baud;
+	else if (clk != SysClk)
+		brr = (uint32_t)(((uint64_t)brr * clk + SysClk / 2) / SysClk);	// HSE failed: same rate on HSI
+
+	Boot_Update(slot, brr);
+	while (1) {}
+}
@@ -0,0 +1,28 @@
+#ifndef AUTOBAUD_H
+#define AUTOBAUD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// USART1 auto-baud: time the edges of an incoming '<' on PA10 (EXTI10 + DWT->CYCCNT),
+// snap to the nearest standard rate, reprogram BRR and wait for a valid frame
+// '<' = 0x3C, LSB first: start+d0+d1 low (3 bits), d2-d5 high (4), d6+d7 low (2), stop high
+#define Autobaud_Error_Run		8		// Consecutive framing/noise errors that restart the hunt
+#define Autobaud_Confirm_ms		1000	// No valid frame at the new rate within this: hunt again
+#define Autobaud_Tolerance		20		// Rate snap window: 1/20 = 5%
+
+typedef enum
+{
+	Autobaud_Locked = 0,	// Valid frames at the current rate, EXTI off
+	Autobaud_Hunt,			// Timing edges on RX, USART still receiving at the old rate
+	Autobaud_Confirm		// BRR reprogrammed, waiting for a valid frame
+} Autobaud_State;
+
+void Autobaud_Init(bool hunt);
+void Autobaud_Start(void);
+void Autobaud_Rx_Error(void);
+void Autobaud_Frame_Ok(void);
+void Autobaud_Poll(void);
+Autobaud_State Autobaud_Get_State(void);
+
+#endif /* AUTOBAUD_H */
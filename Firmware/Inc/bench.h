@@ -0,0 +1,23 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// On-target micro-benchmarks: cycle cost of the driver calls, reported over USART1
+// Set to 1 for a benchmark build: main() runs the suite instead of the car, see README
+#ifndef Bench_Build
+#define Bench_Build				0
+#endif
+
+#define Bench_Iterations		2000	// Timed calls per case
+#define Bench_HSE_Timeout		100000	// Polls for the crystal; QEMU has no RCC and stays on HSI
+
+// Report, one frame per line:
+//   <K,begin,clock,iterations,overhead>   clock: dwt (core cycles) or systick (no DWT, e.g. QEMU)
+//   <K,case,min,median,max>               cycles per call, timing overhead subtracted
+//   <K,end>
+// Send K to run the suite again
+
+void Bench_Main(void);
+
+#endif /* BENCH_H */
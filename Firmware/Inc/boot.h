@@ -0,0 +1,25 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+// Cold boot: safe outputs from SystemInit(), HSE locks while the clock-independent init runs on HSI
+#define HSI_Freq		16000000U	// Reset clock until SystemClock_Init() switches to HSE
+
+// Boot milestones, timed from reset with DWT->CYCCNT
+typedef enum
+{
+	Boot_HSE_Ready = 0,		// SYSCLK switched to HSE
+	Boot_First_PWM,			// TIM1 / TIM2 running with the reset state applied
+	Boot_UART_Ready,		// USART1 receiving
+	Boot_Main_Loop,			// All init done
+	Boot_Mark_Count
+} Boot_Mark;
+
+void SystemInit(void);
+void Boot_Clock_Switched(void);
+void Boot_Mark_Time(Boot_Mark mark);
+uint32_t Boot_Time_us(Boot_Mark mark);
+void Boot_Send_Times(void);
+
+#endif /* BOOT_H */
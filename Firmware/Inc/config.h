@@ -0,0 +1,51 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Key-value configuration store in internal flash
+// Two 16KB sectors (1 and 2) used as an append-only log, compacted into the other sector when full
+// Reserved in STM32F411CEUX_FLASH.ld (CONFIG region)
+#define Config_Sector_A			1U
+#define Config_Sector_B			2U
+#define Config_Sector_A_Addr	0x08004000U
+#define Config_Sector_B_Addr	0x08008000U
+#define Config_Sector_Size		0x4000U
+
+#define Config_Magic			0x43464731U		// "CFG1"
+
+// Keys: index into the RAM table, never renumber (stored in flash)
+typedef enum
+{
+	Cfg_Steer_Reset = 0,	// Reset / straight steering, 0.01 degree
+	Cfg_Servo_Min_us,		// Servo pulse at 0 degree
+	Cfg_Servo_Max_us,		// Servo pulse at 180 degree
+	Cfg_Throttle_Ramp,		// Max throttle change per servo frame (%), 100 = no limit
+	Cfg_Baud,				// USART1 baud rate
+	Cfg_Drive_Profile,		// Drive_Profile
+	Cfg_Motor_PWM_Freq,		// TIM1 PWM frequency (Hz)
+	Cfg_Autobaud,			// 1: hunt for the baud rate at start-up (autobaud.h)
+	Cfg_Port2_Role,			// USART2 Link_Role: off / control / debug only
+	Cfg_Yaw_Stab,			// 1: yaw-rate stabilisation on (yaw_ctrl.h)
+	Cfg_Yaw_Full_Rate,		// Requested yaw rate at full lock and full throttle (deg/s)
+	Cfg_Yaw_Kp,				// Servo correction per yaw rate error (0.01 degree per deg/s)
+	Cfg_Yaw_Ki,				// ... per integrated yaw error (0.01 degree per degree)
+	Cfg_Curve,				// Stick response Curve_Id (curves.h)
+	Cfg_Brake_Reverse_ms,	// Brake before reversing while rolling (ms), 0 = reverse at once
+	Cfg_Brake_Force,		// Braking PWM during that time (%)
+	Cfg_Failsafe_ms,		// Link-loss failsafe: stopped and centred this long after the last control frame
+	Cfg_Car_Id,				// Address on a shared link (link.h), 1..Link_Id_Max
+	Cfg_Motor_PWM_Align,	// TIM1 counting: 0 edge-aligned, 1 center-aligned (interleaved wheels)
+	Cfg_Range_Guard,		// 1: ultrasonic emergency braking on (range.h)
+	Cfg_Range_Stop_mm,		// Brake and hold forward at or below this range (mm)
+	Cfg_Range_TTC_ms,		// Brake at or below this time to collision (ms), throttle clamped from twice it
+	Cfg_Count
+} Config_Key;
+
+void Config_Init(void);
+uint32_t Config_Get(Config_Key key);
+bool Config_Set(Config_Key key, uint32_t value);
+void Config_Send(Config_Key key);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,34 @@
+#ifndef CURVES_H
+#define CURVES_H
+
+#include <stdint.h>
+
+// Stick response curves: deadband, expo and rate (dual rate), built into const tables at compile time
+// Applied to every command (Car_Command) with one table lookup per input; selected with <V,curve>,
+// <C,13,curve> stores the boot default
+#define Curve_Throttle_Points	101		// Throttle 0..100 %
+#define Curve_Steer_Points		91		// Steer 0..90 degrees, whole degrees, 0.01 degree in between
+
+typedef enum
+{
+	Curve_Linear = 0,	// Pass-through
+	Curve_Soft,			// Expo and a small deadband on both sticks
+	Curve_Low_Rate,		// Soft, with throttle and steering throw reduced (dual rate low)
+	Curve_Race,			// Light expo, full throw
+	Curve_Count
+} Curve_Id;
+
+#define Curve_Default	Curve_Linear
+
+typedef struct
+{
+	const uint8_t *throttle;	// [Curve_Throttle_Points], throttle %
+	const uint16_t *steer;		// [Curve_Steer_Points], steer 0.01 degree
+} Curve;
+
+void Curve_Select(Curve_Id id);
+Curve_Id Curve_Get(void);
+uint8_t Curve_Throttle(uint8_t throttle);
+uint16_t Curve_Steer(uint16_t steer);
+
+#endif /* CURVES_H */
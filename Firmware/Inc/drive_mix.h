@@ -0,0 +1,50 @@
+#ifndef DRIVE_MIX_H
+#define DRIVE_MIX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Chassis drive profiles
+typedef enum
+{
+	Drive_Ackermann    = 0,	// Steering servo + single drive motor (TIM1 CH1)
+	Drive_Differential = 1,	// Skid/tank: left (CH1) + right (CH2N) motors
+	Drive_4WD          = 2	// Steering servo + four wheel motors (CH1, CH2N, CH3N, CH4)
+} Drive_Profile;
+
+#define Drive_Profile_Default	Drive_Ackermann
+
+#define Drive_Wheels			4		// Max independent wheel outputs
+
+// Direction codes: 0 stop (coast), 1 forward, 2 backward, 3 brake (throttle = braking force)
+#define Drive_Dir_Brake			3
+
+// Extra wheel outputs on TIM1 (AF1)
+#define Motor_W1	0U		// PB0  Tim1Ch2N PWM (Right / Front-Right)
+#define Motor_W2	1U		// PB1  Tim1Ch3N PWM (Rear-Left)
+#define Motor_W3	11U		// PA11 Tim1Ch4  PWM (Rear-Right)
+
+// Extra wheel direction GPIOs (GPIOB), wheel 0 uses Motor_DC1/Motor_DC2
+#define Motor_W1_DC1	14	// PB14
+#define Motor_W1_DC2	15	// PB15
+#define Motor_W2_DC1	8	// PB8
+#define Motor_W2_DC2	9	// PB9
+#define Motor_W3_DC1	4	// PB4
+#define Motor_W3_DC2	5	// PB5
+
+// Mixing parameters
+#define Drive_Steer_Center		45		// Packet steer for straight ahead (degrees)
+#define Drive_Steer_Span		45		// Packet steer from center to full lock (degrees)
+#define Drive_Diff_Turn_Gain	60		// Skid: yaw duty at full lock (% of full scale)
+#define Drive_4WD_Diff_Gain		50		// 4WD: inner wheel slow-down at full lock (%)
+
+void Drive_Mix_Init(Drive_Profile profile);
+void Drive_Mix_SetProfile(Drive_Profile profile);
+Drive_Profile Drive_Mix_GetProfile(void);
+void Drive_Mix_Apply(uint16_t Steer, uint8_t Throttle, uint8_t Dir);
+void Drive_Mix_Tick(void);
+void Drive_Mix_Reapply(void);
+bool Drive_Mix_Driving(void);
+void Drive_Wheel_Direction(uint8_t wheel, uint8_t Direction);
+
+#endif /* DRIVE_MIX_H */
@@ -0,0 +1,45 @@
+#ifndef FAILSAFE_H
+#define FAILSAFE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Link-loss failsafe: no valid control frame for Cfg_Failsafe_ms -> throttle at zero, steering centred
+// The ramp down starts Failsafe_Ramp_ms before the deadline, so the drive is off by the deadline itself,
+// then the brake (Cfg_Brake_Force) holds until the next control frame
+#define Failsafe_Ramp_ms		200		// Throttle ramp to zero (servo frames, Interp_Frame_ms steps)
+
+// IWDG: a hung main loop (or a stopped SysTick) resets into SystemInit()'s parked outputs
+// LSI 32kHz nominal, 17-47kHz over temperature and parts (datasheet): windows are quoted at LSI min
+#define LSI_Freq				32000U
+#define LSI_Freq_Min			17000U
+#define Watchdog_Prescaler		32U		// IWDG_PR = 3: ~1ms per count at LSI nominal
+#define Watchdog_PR_Code		3U
+#define Watchdog_Window_ms		100		// Normal window (nominal LSI)
+#define Watchdog_Erase_ms		4000	// Window around a flash sector erase (128KB takes up to 2s, CPU stalled)
+#define Watchdog_Count(ms)		((uint32_t)(ms) * (LSI_Freq / Watchdog_Prescaler) / 1000U)
+#define Watchdog_Bound_ms		((uint32_t)Watchdog_Window_ms * LSI_Freq / LSI_Freq_Min)
+
+#define Watchdog_Key_Reload		0xAAAAU
+#define Watchdog_Key_Access		0x5555U
+#define Watchdog_Key_Start		0xCCCCU
+
+typedef struct
+{
+	uint32_t trips;				// Failsafe activations (link lost while armed)
+	uint32_t reaction_max_ms;	// Worst case, last valid frame to drive output stopped
+	uint32_t wdg_resets;		// IWDG resets since power-on (kept in .noinit RAM)
+	bool wdg_reset;				// This boot was an IWDG reset
+} Failsafe_Stats;
+
+void Watchdog_Init(void);
+void Watchdog_Refresh(void);
+void Watchdog_Stretch(bool erase);
+
+void Failsafe_Feed(void);
+void Failsafe_Poll(void);
+bool Failsafe_Active(void);
+const Failsafe_Stats *Failsafe_Get_Stats(void);
+void Failsafe_Send_Status(void);
+
+#endif /* FAILSAFE_H */
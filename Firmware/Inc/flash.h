@@ -0,0 +1,20 @@
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Internal flash erase / program, 32-bit parallelism (2.7-3.6V supply)
+// The CPU stalls on any flash fetch while an operation runs: sector erase takes hundreds of ms
+#define Flash_Key1		0x45670123U
+#define Flash_Key2		0xCDEF89ABU
+#define Flash_Erased	0xFFFFFFFFU
+
+#ifndef Flash_Word
+#define Flash_Word(addr)	(*(volatile uint32_t *)(addr))	// Overridden by the host simulator
+#endif
+
+bool Flash_Erase_Sector(uint8_t sector);
+bool Flash_Program_Word(uint32_t addr, uint32_t data);
+
+#endif /* FLASH_H */
@@ -0,0 +1,59 @@
+#ifndef IMU_H
+#define IMU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// MPU-6050 class 6-axis IMU on I2C1, gyro read in the background
+// SysTick starts a transfer every IMU_Period_ms, the I2C1 event interrupt addresses the device,
+// DMA1 Stream0 moves the data and its transfer-complete interrupt accumulates the sample
+#define IMU_SCL				6U		// PB6 I2C1_SCL (AF4, open-drain)
+#define IMU_SDA				7U		// PB7 I2C1_SDA (AF4, open-drain)
+#define IMU_I2C_Freq		400000U	// Fast mode
+#define IMU_Addr			0x68U	// AD0 low
+
+#define IMU_Period_ms		2		// Gyro read rate: 500Hz
+#define IMU_Probe_ms		500		// Retry interval while no device answers
+#define IMU_Reset_ms		100		// Device reset / start-up time
+#define IMU_Bus_Timeout_ms	5		// Transfer still running after this: bus reset
+
+// Device setup
+#define IMU_Gyro_FS			1		// GYRO_CONFIG FS_SEL: +-500 deg/s
+#define IMU_Gyro_LSB_x10	655		// 65.5 LSB per deg/s at FS_SEL 1
+#define IMU_DLPF_Cfg		3		// CONFIG DLPF_CFG: 42Hz gyro bandwidth, 1kHz internal rate
+#define IMU_Smplrt_Div		1		// 1kHz / (1 + 1) = 500Hz output rate, matches IMU_Period_ms
+
+// MPU-6050 registers
+#define MPU_SMPLRT_DIV		0x19U
+#define MPU_CONFIG			0x1AU
+#define MPU_GYRO_CONFIG		0x1BU
+#define MPU_GYRO_XOUT_H		0x43U	// X, Y, Z, big-endian
+#define MPU_PWR_MGMT_1		0x6BU
+#define MPU_WHO_AM_I		0x75U
+
+#define MPU_PWR_RESET		0x80U	// PWR_MGMT_1 DEVICE_RESET
+#define MPU_PWR_CLK_PLL_X	0x01U	// PWR_MGMT_1: awake, PLL on the X gyro
+
+typedef enum
+{
+	IMU_Absent = 0,		// Probing every IMU_Probe_ms
+	IMU_Reset_Wait,		// Device answered, reset in progress
+	IMU_Configure,		// Writing the setup registers
+	IMU_Running			// Gyro sampled every IMU_Period_ms
+} IMU_State;
+
+typedef struct
+{
+	uint32_t samples;	// Gyro reads completed
+	uint32_t errors;	// NACK / bus / arbitration errors
+	uint32_t timeouts;	// Transfers that never finished (bus reset)
+	uint32_t overruns;	// Period elapsed with the previous read still running
+} IMU_Stats;
+
+void IMU_Init(void);
+void IMU_Tick(void);
+IMU_State IMU_Get_State(void);
+bool IMU_Gyro_Take(int32_t *sum_z, uint16_t *count);
+const IMU_Stats *IMU_Get_Stats(void);
+
+#endif /* IMU_H */
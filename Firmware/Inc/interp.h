@@ -0,0 +1,20 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Inter-packet interpolation at the servo frame rate (TIM2 update, Servo_PWM_Freq)
+#define Interp_Default			1		// Interpolation on at boot
+#define Interp_Frame_ms			(1000 / Servo_PWM_Freq)	// 20ms servo frame
+#define Interp_Max_Interval_ms	200		// Packet gaps above this are not used as the rate estimate
+#define Interp_Max_Hold_ms		100		// Keep extrapolating this long after a packet is overdue
+
+void Interp_Init(void);
+void Interp_Enable(bool enable);
+bool Interp_Enabled(void);
+void Interp_Set_Target(uint16_t steer, uint8_t throttle, uint8_t dir);
+void Interp_Hold(void);
+void Interp_Ramp_To(uint16_t steer, uint8_t throttle, uint8_t dir, uint16_t ms);
+
+#endif /* INTERP_H */
@@ -0,0 +1,71 @@
+#ifndef IRQ_CONFIG_H
+#define IRQ_CONFIG_H
+
+#include <stdint.h>
+
+// NVIC priority plan, lower number pre-empts higher
+// 4 pre-emption bits, no sub-priority: equal levels never nest, they queue
+// Replies and telemetry are polled from Car_Loop() (Link_Tx_Poll()), no TX interrupt
+#define IRQ_Priority_Grouping	3U		// PRIGROUP = 3 -> 4 bits group priority
+
+#define IRQ_Prio_Control		0U		// TIM1 update, ADC current limit
+#define IRQ_Prio_UART_RX		1U		// Command reception
+#define IRQ_Prio_Scheduler		2U		// SysTick time base, servo frame interpolation, IMU, range guard
+
+// On-target measurement of worst-case entry latency and run time (DWT cycles)
+// Set to 1 for a measurement build, report with <I>
+#ifndef IRQ_Measure
+#define IRQ_Measure				0
+#endif
+
+// Handlers with no hardware timestamp for their event (RXNE, I2C event, DMA complete) pass this:
+// the entry is counted, the latency column is left empty in the <I> reply
+#define IRQ_Latency_Unknown		0xFFFFFFFFU
+
+typedef enum
+{
+	IRQ_Slot_TIM1_UP = 0,
+	IRQ_Slot_ADC,
+	IRQ_Slot_USART1,
+	IRQ_Slot_SysTick,
+	IRQ_Slot_TIM2,
+	IRQ_Slot_USART2,
+	IRQ_Slot_I2C1,
+	IRQ_Slot_IMU_DMA,
+	IRQ_Slot_TIM3,
+	IRQ_Slot_Count
+} IRQ_Slot;
+
+typedef struct
+{
+	uint32_t count;			// Handler entries
+	uint32_t latency_max;	// Cycles from the hardware event to handler entry, IRQ_Latency_Unknown if untimed
+	uint32_t run_max;		// Cycles spent in the handler
+} IRQ_Stat;
+
+extern volatile IRQ_Stat irq_stats[IRQ_Slot_Count];
+
+#if IRQ_Measure
+#define IRQ_Measure_Enter(slot, latency_cycles) \
+	uint32_t irq_t0 = DWT->CYCCNT; \
+	IRQ_Record_Latency((slot), (latency_cycles))
+#define IRQ_Measure_Exit(slot) \
+	IRQ_Record_Run((slot), DWT->CYCCNT - irq_t0)
+#else
+#define IRQ_Measure_Enter(slot, latency_cycles)
+#define IRQ_Measure_Exit(slot)
+#endif
+
+// Hold off the scheduler level (SysTick, servo frame) around state shared with it; higher levels still run
+#define IRQ_Scheduler_Lock() \
+	uint32_t irq_basepri = __get_BASEPRI(); \
+	__set_BASEPRI(IRQ_Prio_Scheduler << (8U - __NVIC_PRIO_BITS))
+#define IRQ_Scheduler_Unlock() \
+	__set_BASEPRI(irq_basepri)
+
+void IRQ_Config_Init(void);
+void IRQ_Record_Latency(IRQ_Slot slot, uint32_t cycles);
+void IRQ_Record_Run(IRQ_Slot slot, uint32_t cycles);
+void IRQ_Send_Stats(void);
+
+#endif /* IRQ_CONFIG_H */
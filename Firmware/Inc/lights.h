@@ -0,0 +1,23 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <stdint.h>
+
+// Lights: external driver on PB10 (active high), mirrored on the on-board LED (PC13, active low)
+#define Lights_Pin			10U		// PB10
+#define Lights_Blink_ms		250		// Half period of the hazard blink
+
+typedef enum
+{
+	Lights_Off = 0,
+	Lights_On,
+	Lights_Blink,			// Hazard: toggled from Car_Loop()
+	Lights_Mode_Count
+} Lights_Mode;
+
+void Lights_Init(void);
+void Lights_Set(Lights_Mode mode);
+Lights_Mode Lights_Get(void);
+void Lights_Poll(void);
+
+#endif /* LIGHTS_H */
@@ -0,0 +1,86 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Command links: one protocol parser instance per byte-stream port
+#define Link_Frame_Size			32		// Max frame between '<' and '>'
+#define Link_Max_Fields			4		// Comma separated fields after the command letter
+#define Link_Tx_Size			256		// Reply queue per port, power of two
+#define Link_Telemetry_Min_ms	20		// Fastest <R> telemetry period
+#define Link_Source_Timeout_ms	500		// A silent control source loses priority after this
+
+// Car addressing on a shared link: <@id,...> text frames, the ID byte of binary frames
+// Frames without an ID are for every car (single car links), ID 0 is broadcast: acted on, never answered
+#define Link_Broadcast_Id		0
+#define Link_Id_Max				254		// Cfg_Car_Id range 1..Link_Id_Max
+
+// Binary control frame: start, id, steer (0.01 deg, little endian), throttle, direction, CRC-8
+// 7 bytes against ~14 for <@id,S,...>: twice the cars at the same link rate
+#define Link_Bin_Start			0xA5U
+#define Link_Bin_Size			7
+#define Link_Crc8_Poly			0x07U	// CRC-8 (x^8 + x^2 + x + 1), init 0, over id..direction
+
+typedef enum
+{
+	Link_HC05 = 0,		// USART1, Bluetooth
+	Link_Wired,			// USART2, wired controller or debug console
+	Link_Port_Count
+} Link_Port_Id;
+
+// Port role, Link_Wired from Cfg_Port2_Role
+typedef enum
+{
+	Link_Role_Off     = 0,	// Port not initialised
+	Link_Role_Control = 1,	// Control and query frames
+	Link_Role_Debug   = 2	// Query frames only, control frames (<S>, <T>, <M,op>, <O,profile>, <V,curve>, <C,key,value>) ignored
+} Link_Role;
+
+// Source priority for control frames (<S>, <T>), lower wins
+#define Link_Prio_Wired		0
+#define Link_Prio_HC05		1
+
+// Per port link statistics
+typedef struct
+{
+	uint32_t overrun;			// ORE: byte lost, DR not read in time
+	uint32_t noise;				// NE: noise detected on a bit
+	uint32_t framing;			// FE: stop bit missing (baud mismatch / break)
+	uint32_t parity;			// PE: parity mismatch (parity off by default)
+	uint32_t frames_dropped;	// Frames discarded after an error / bad parse
+	uint32_t bytes;				// Good bytes received
+	uint32_t frames;			// Good frames received
+	uint32_t bytes_per_s;		// Updated by Link_Stats_Update()
+	uint32_t frames_per_s;
+	uint32_t ring_overflow;		// Bytes lost because the RX ring was full
+	uint32_t preempted;			// Control frames ignored, higher priority source active
+	uint32_t foreign;			// Frames addressed to another car, skipped unparsed
+} UART_Link_Stats;
+
+void Link_Init(Link_Role wired_role);
+void Link_Set_Source(Link_Port_Id port, bool (*rx_pop)(uint16_t *entry));
+bool Link_Receive_Packet(uint16_t *steer, uint8_t *throttle, uint8_t *dir);
+Link_Port_Id Link_Control_Source(void);
+void Link_Stats_Update(void);
+const UART_Link_Stats *Link_Stats(Link_Port_Id port);
+void Link_Send_Stats(void);
+void Link_Tx_Poll(void);
+void Link_Flush(void);
+void Link_Telemetry_Poll(void);
+uint8_t Link_Crc8(const uint8_t *data, uint8_t len);
+
+// Replies go to the port whose frame is being handled (USART1 outside the parser)
+// They are queued, Link_Tx_Poll() writes them out as the USART is ready; a full queue waits
+void Link_Send_Char(char c);
+void Link_Send_Str(const char *str);
+void Link_Send_Uint(uint32_t value);
+void Link_Send_Int(int32_t value);
+
+// Streamed reply, too long for the queue: written in chunks from Link_Tx_Poll() by its producer
+// Other replies to the port are dropped until it is closed
+bool Link_Stream_Open(void);
+bool Link_Stream_Write(const uint8_t *data, uint8_t len);
+void Link_Stream_Close(void);
+
+#endif /* LINK_H */
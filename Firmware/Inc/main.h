@@ -0,0 +1,89 @@
+#ifndef MAIN_H
+#define MAIN_H
+
+#include "stm32f4xx.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SysClk 25000000U 	// 25MHz HSE system clock frequency
+
+#define B_LED 13U 			// PC13 Built-in LED
+#define Btn 0U 				// PA0 push-btn active low
+
+#define Motor 8U			// PA8 Tim1Ch1 PWM
+#define Servo 15U 			// PA15 Tim2Ch1 PWM
+
+#define Motor_PWM_Freq 1000	// 1KHz motor PWM frequency
+#define Motor_PWM_Center 0	// TIM1 counting at boot (Cfg_Motor_PWM_Align): 0 edge-aligned, 1 center-aligned
+#define Servo_PWM_Freq 50	// 50Hz servo control frequency
+
+#define Servo_HighRes		1		// 1: TIM2 at the full timer clock (40ns pulse steps), 0: 1MHz (1us)
+#define Servo_Tick_Freq		(Servo_HighRes ? SysClk : 1000000U)
+#define Servo_Min_Pulse_us	544		// 0 degree pulse
+#define Servo_Max_Pulse_us	2344	// 180 degree pulse: 10us per degree, the mapping steering trims are set against
+
+#define Steer_Scale			100		// Steering carried in 0.01 degree units (centi-degrees)
+
+#define Tx1	9				// PA9 Tx UART1
+#define Rx1 10				// PA10 Rx UART1
+
+#define Tx2	2				// PA2 Tx UART2 (wired controller / debug)
+#define Rx2	3				// PA3 Rx UART2
+#define UART2_Baud	115200U
+
+// USART transmit access, overridden by the host simulator (transmit timing)
+#ifndef UART_Tx_Ready
+#define UART_Tx_Ready(uart)		((uart)->SR & USART_SR_TXE)
+#define UART_Tx_Write(uart, c)	((uart)->DR = (c))
+#endif
+
+#define Motor_DC1	12		// PB12 Motor Direction Control
+#define Motor_DC2	13		// PB13 Motor Direction Control
+
+#define Car_Reset_Steer_Angle	60	// Straight facing
+#define Car_Reset_Throttle		0	// No Throttle
+#define Car_Reset_Direction 	0 	// Stop Condition
+
+
+// Driver Function Prototyping
+void Car_Init(void);
+void Car_Loop(void);
+
+void SystemClock_Init(void);
+
+void Motor_TIM1_PWM_Init(void);
+void Motor_TIM1_PWM_SetDutyCycle(uint8_t duty_cycle);
+void Motor_TIM1_PWM_SetChannelDutyCycle(uint8_t channel, uint8_t duty_cycle);
+void Motor_TIM1_PWM_Refresh(void);
+void Motor_TIM1_PWM_Align(bool center);
+uint32_t Motor_TIM1_OC_Mode(uint8_t channel);
+
+void Servo_TIM2_PWM_Init(void);
+void Servo_TIM2_PWM_SetDutyCycle(uint8_t duty_cycle);
+void Servo_TIM2_PWM_SetAngle(uint8_t angle);
+void Servo_TIM2_PWM_SetAngleFine(uint16_t angle_cdeg);
+
+void UART1_Init(void);
+void UART1_Send_Char(char c);
+bool UART1_Try_Send_Char(char c);
+void UART1_Send_Str(char *str);
+void UART1_Send_Uint(uint32_t value);
+char UART1_Receive_Char(void);
+void UART1_Receive_Str(char *str);
+bool UART1_Rx_Pop(uint16_t *entry);
+uint32_t UART1_Rx_Overflow(void);
+
+void UART2_Init(void);
+void UART2_Send_Char(char c);
+bool UART2_Try_Send_Char(char c);
+bool UART2_Rx_Pop(uint16_t *entry);
+uint32_t UART2_Rx_Overflow(void);
+
+void Motor_Direction_Control_Init(void);
+void Motor_Direction_Control(uint8_t Direction);
+
+void Car_Control(uint16_t Steer, uint8_t Throttle, uint8_t Dir);
+void Car_Command(uint16_t Steer, uint8_t Throttle, uint8_t Dir);
+void Car_Output(uint16_t *Steer, uint8_t *Throttle, uint8_t *Dir);
+
+#endif /* MAIN_H */
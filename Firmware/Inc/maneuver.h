@@ -0,0 +1,51 @@
+#ifndef MANEUVER_H
+#define MANEUVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Maneuver record / replay: steer, throttle, direction keyframes with ms timing, played from Car_Loop()
+// Keyframe, delta-encoded against the previous one (only changed fields are stored):
+//   header   bit0 steer, bit1 throttle, bit2 direction present, bits 3-4 direction
+//   dt       ms since the previous keyframe, unsigned LEB128
+//   steer    change in 0.01 degree, zigzag LEB128 (if present)
+//   throttle change in %, zigzag LEB128 (if present)
+// A keyframe with no fields only moves the clock (hold at the end of a sequence)
+#define Maneuver_Buffer_Size	4096	// RAM recording, bytes (~1000 keyframes of a live drive)
+#define Maneuver_Key_Max		11		// Longest keyframe: 1 + 5 + 3 + 2 bytes
+
+// Saved recording: flash sector 7, reserved in STM32F411CEUX_FLASH.ld (MANEUVER region)
+#define Maneuver_Flash_Sector	7U
+#define Maneuver_Flash_Addr		0x08060000U
+#define Maneuver_Magic			0x4D4E5631U		// "MNV1"
+
+#define Maneuver_Has_Steer		0x01U
+#define Maneuver_Has_Throttle	0x02U
+#define Maneuver_Has_Dir		0x04U
+#define Maneuver_Dir_Pos		3
+
+typedef enum
+{
+	Maneuver_Idle = 0,
+	Maneuver_Recording,		// Live commands appended to the RAM buffer
+	Maneuver_Playing		// Keyframes applied as they come due
+} Maneuver_State;
+
+typedef enum
+{
+	Maneuver_Src_RAM = 0,	// Last recording
+	Maneuver_Src_Flash,		// Saved recording (loaded into RAM first)
+	Maneuver_Src_Sweep,		// Built-in steering sweep 0-90-0 degrees, car stopped
+	Maneuver_Src_Count
+} Maneuver_Source;
+
+void Maneuver_Record_Start(void);
+bool Maneuver_Play(Maneuver_Source src);
+void Maneuver_Stop(void);
+bool Maneuver_Save(void);
+void Maneuver_Live(uint16_t steer, uint8_t throttle, uint8_t dir);
+bool Maneuver_Poll(uint16_t *steer, uint8_t *throttle, uint8_t *dir);
+Maneuver_State Maneuver_Get_State(void);
+void Maneuver_Send_Status(void);
+
+#endif /* MANEUVER_H */
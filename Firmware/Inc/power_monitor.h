@@ -0,0 +1,41 @@
+#ifndef POWER_MONITOR_H
+#define POWER_MONITOR_H
+
+#include <stdint.h>
+
+#define Batt_Sense		1U		// PA1 ADC1_IN1, battery voltage divider
+#define Motor_Sense		4U		// PA4 ADC1_IN4, L298N SENSE A resistor
+
+#define Power_ADC_Channels	2		// Scan: battery, motor current
+#define Power_ADC_Scans		16		// Scans held in the DMA ring
+
+#define Power_Monitor_Period_ms	10	// Filter + derate update rate
+#define Power_Filter_Shift		3	// IIR: filt += (x - filt) >> 3
+
+// Analog front end
+#define ADC_Vref_mV			3300
+#define ADC_Full_Scale		4095
+#define Batt_Divider_Ratio	5		// 30k/7.5k divider, Vbatt = Vpin * 5
+#define Motor_Sense_mOhm	500		// L298N sense resistor, 0.5R
+
+// Derating thresholds (2S Li-ion / LiPo)
+#define Batt_Derate_Start_mV	7000	// Full throttle above this
+#define Batt_Cutoff_mV			6400	// Zero throttle at or below this
+#define Motor_Current_Limit_mA	2000	// Pull throttle back above this
+#define Current_Derate_Step		5		// % off the cap per update over limit
+#define Current_Recover_Step	1		// % back on the cap per update under limit
+
+// PWM synchronised current limit (ADC1 injected, triggered by TIM1 CC4 at mid on-time)
+#define Motor_Current_Trip_mA	3000	// Cut the rest of the PWM on-time above this
+#define Motor_Current_Trip_Counts \
+	((uint32_t)Motor_Current_Trip_mA * Motor_Sense_mOhm / 1000 * ADC_Full_Scale / ADC_Vref_mV)
+
+void Power_Monitor_Init(void);
+void Power_Monitor_Update(void);
+uint16_t Power_Battery_mV(void);
+uint16_t Power_Motor_mA(void);
+uint8_t Power_Throttle_Limit(void);
+uint16_t Power_Motor_Sync_mA(void);
+uint32_t Power_Current_Trips(void);
+
+#endif /* POWER_MONITOR_H */
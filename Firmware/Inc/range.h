@@ -0,0 +1,62 @@
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Ultrasonic rangefinder (HC-SR04 class) for automatic emergency braking
+// TIM3 counts 1us steps over one ping period: CH1 PWM is the trigger pulse, CH2 captures both echo edges
+// The echo falling edge interrupt measures the range and re-gates the drive output itself (Range_Gate())
+#define Range_Trig				6U		// PA6 Tim3Ch1 trigger out (AF2)
+#define Range_Echo				7U		// PA7 Tim3Ch2 echo capture (AF2), 5V tolerant, pull-down
+
+#define Range_Tick_Freq			1000000U	// TIM3 counter, 1us
+#define Range_Period_us			60000U		// Ping period, the sensor wants >= 60ms between triggers
+#define Range_Period_ms			(Range_Period_us / 1000U)
+#define Range_Trigger_us		12U			// Trigger pulse, >= 10us
+#define Range_Echo_Filter		3U			// IC2F: 8 samples at the timer clock (0.3us)
+#define Range_Sound_mm_per_ms	343U		// Speed of sound at 20C, the echo is the round trip
+#define Range_Max_mm			4000U		// Beyond this, or no echo (38ms pulse): nothing ahead
+#define Range_Stale_Pings		4			// Pings without an echo: sensor lost, the guard lets go
+
+// Time to collision from the closing speed, Cfg_Range_TTC_ms brakes and Cfg_Range_Stop_mm holds
+// Forward throttle is clamped linearly from Range_Clamp_Factor x the brake TTC down to zero at it
+#define Range_Clamp_Factor		2
+#define Range_Release_mm		100			// Brake hold lets go this far beyond the stop distance
+#define Range_Max_Closing		5000		// mm/s: a larger step between pings is a new target, not speed
+#define Range_TTC_None			0xFFFFU		// Not closing
+
+// TIM3 count as the handler reads it, overridden by the host simulator (handler run time)
+#ifndef Range_Count
+#define Range_Count()			((uint16_t)TIM3->CNT)
+#endif
+
+typedef enum
+{
+	Range_Off = 0,		// Cfg_Range_Guard 0: TIM3 stopped, no override
+	Range_Lost,			// No echo for Range_Stale_Pings, no override
+	Range_Clear,
+	Range_Clamp,		// Forward throttle limited to Range_Stats.limit
+	Range_Brake			// Forward and coast commands replaced by the brake (Cfg_Brake_Force)
+} Range_State;
+
+typedef struct
+{
+	uint32_t echoes;			// Echoes measured
+	uint32_t clamps;			// Range_Clamp entries
+	uint32_t brakes;			// Range_Brake entries
+	uint32_t latency_max_us;	// Echo falling edge (capture) to the gated drive output written
+	uint16_t range_mm;
+	int16_t closing_mm_s;		// Positive: approaching
+	uint16_t ttc_ms;
+	uint8_t limit;				// Forward throttle allowed (%)
+} Range_Stats;
+
+void Range_Init(void);
+void Range_Enable(bool on);
+void Range_Gate(uint8_t *Throttle, uint8_t *Dir);
+Range_State Range_Get_State(void);
+const Range_Stats *Range_Get_Stats(void);
+void Range_Send_Status(void);
+
+#endif /* RANGE_H */
@@ -0,0 +1,13 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define Sched_Tick_Freq		1000	// 1KHz SysTick, 1ms tick
+
+void Sched_Init(void);
+uint32_t Sched_Millis(void);
+bool Sched_Every(uint32_t *next_ms, uint32_t period_ms);
+
+#endif /* SCHED_H */
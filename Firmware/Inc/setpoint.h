@@ -0,0 +1,28 @@
+#ifndef SETPOINT_H
+#define SETPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Time-stamped setpoint queue: <T,time_ms,steer,throttle,dir>
+// time_ms is the sender's clock; the first frame of a stream anchors it to Sched_Millis()
+// plus a playout lead, later frames keep that offset so radio jitter is absorbed
+#define Setpoint_Queue_Size		32		// Power of two
+#define Setpoint_Lead_ms		150		// Playout delay, larger than the worst link jitter
+#define Setpoint_Resync_ms		500		// Queue idle this long -> re-anchor on the next frame
+#define Setpoint_Late_ms		50		// Drop setpoints due further in the past than this
+
+typedef struct
+{
+	uint32_t due_ms;	// Local Sched_Millis() time to apply
+	uint16_t steer;		// 0.01 degree
+	uint8_t throttle;
+	uint8_t dir;
+} Setpoint;
+
+void Setpoint_Queue_Push(uint32_t sender_ms, uint16_t steer, uint8_t throttle, uint8_t dir);
+bool Setpoint_Queue_Poll(uint16_t *steer, uint8_t *throttle, uint8_t *dir);
+void Setpoint_Queue_Flush(void);
+uint32_t Setpoint_Dropped(void);
+
+#endif /* SETPOINT_H */
@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Flight recorder: overwrite-oldest ring of 8 byte binary events in RAM
+#define Trace_Depth		256		// Events held, power of two
+#define Trace_Magic		"TRC1"	// Dump header, see Tools/trace_decode.py
+
+// Event codes (keep in sync with Tools/trace_decode.py)
+typedef enum
+{
+	Trace_Boot          = 0x01,	// a: -,          b: RCC->CSR reset flags >> 16
+	Trace_Packet_Rx     = 0x02,	// a: cmd letter, b: frame length
+	Trace_Parse_Error   = 0x03,	// a: cmd letter, b: frame length
+	Trace_Cmd_Applied   = 0x04,	// a: steer,      b: throttle | dir << 8
+	Trace_Uart_Error    = 0x05,	// a: in frame,   b: USART SR (ORE/NE/FE/PE)
+	Trace_Mode_Change   = 0x06,	// a: new mode,   b: old mode
+	Trace_Derate        = 0x07,	// a: throttle limit %, b: battery mV
+	Trace_Current_Trip  = 0x08,	// a: -,          b: injected ADC counts
+	Trace_Dump          = 0x09,	// a: -,          b: events in dump
+	Trace_Setpoint_Drop = 0x0A,	// a: 1 late | 2 out of order | 4 full, b: sender ms (low 16 bits)
+	Trace_Autobaud      = 0x0B,	// a: 1 rate snapped | 0 confirmed, b: baud / 100
+	Trace_Imu           = 0x0C,	// a: IMU_State (0 lost, 3 running), b: I2C1 SR1 at the error
+	Trace_Failsafe      = 0x0D,	// a: 0 link lost | 1 drive stopped, b: ms since the last control frame
+	Trace_Range         = 0x0E	// a: Range_State, b: range mm
+} Trace_Event;
+
+typedef struct
+{
+	uint32_t cycles;	// DWT->CYCCNT at log time
+	uint8_t  event;		// Trace_Event
+	uint8_t  a;
+	uint16_t b;
+} Trace_Record;
+
+void Trace_Init(void);
+void Trace_Log(uint8_t event, uint8_t a, uint16_t b);
+bool Trace_Send_Dump(void);
+void Trace_Dump_Poll(void);
+
+#endif /* TRACE_H */
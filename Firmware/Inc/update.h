@@ -0,0 +1,67 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Firmware update over USART1: the resident bootloader (Bootloader/) in sector 0 boots one of two
+// application slots, each linked by STM32F411CEUX_FLASH_APP.ld (slot A, or B with App_Slot_B defined)
+// Flash: 0 bootloader | 1-2 config | 3-4 free | 5 slot A | 6 slot B | 7 maneuver
+#define Update_Slot_Count		2
+#define Update_Slot_A_Addr		0x08020000U
+#define Update_Slot_B_Addr		0x08040000U
+#define Update_Slot_A_Sector	5U
+#define Update_Slot_B_Sector	6U
+#define Update_Slot_Size		0x20000U
+#define Update_Header_Size		0x200U		// Slot header, the vector table follows (VTOR: 512 byte aligned)
+#define Update_Image_Max		(Update_Slot_Size - Update_Header_Size)
+#define Update_Magic			0x494D4731U		// "IMG1", programmed last: the image is complete and checked
+#define Update_Tries			3			// Unconfirmed boots of a new image before the other slot takes over
+
+#define Update_Slot_Addr(slot)		((slot) ? Update_Slot_B_Addr : Update_Slot_A_Addr)
+#define Update_Slot_Sector(slot)	((slot) ? Update_Slot_B_Sector : Update_Slot_A_Sector)
+#define Update_No_Slot			Update_Slot_Count	// Running without the bootloader (STM32F411CEUX_FLASH.ld)
+
+// Start of each slot, erased together with the image
+// A new image boots on trial: one tries[] word programmed per boot until the application confirms it
+typedef struct
+{
+	uint32_t magic;				// Update_Magic
+	uint32_t length;			// Image bytes after the header, multiple of 4
+	uint32_t crc;				// CRC-32 of the image (CRC unit: poly 0x04C11DB7, init 0xFFFFFFFF, 32-bit words)
+	uint32_t version;			// One above the other slot's when written, the higher valid slot boots
+	uint32_t confirmed;			// Flash_Erased until the application heard its host over the link
+	uint32_t tries[Update_Tries];
+} Update_Header;
+
+// Application -> bootloader hand-over in the RTC backup registers (kept over a system reset)
+#define Update_Request_Magic	0x55504431U		// "UPD1" in BKP0R: stay in the bootloader, BKP1R = USART1 BRR
+#define Update_Min_Baud			1200U
+#define Update_Max_Baud			1382400U		// HC-05 fastest UART rate (AT+UART), BRR 18 at 25 MHz
+
+// Stream, host -> bootloader (Tools/fw_update.py), USART1 at the rate handed over:
+//   <U,R,slot,max_bytes>   bootloader ready, repeated every Update_Announce_ms while idle
+//   <U,length,crc>         host: image to come; the slot is erased, then <U,G> (<U,E>: refused)
+//   frames                 Update_Frame, binary, at most two unacknowledged
+//   <U,A,seq> / <U,N,seq>  frame programmed / frame rejected: resend from seq
+//   <U,D,slot,version>     image checked and committed, the bootloader resets into it; <U,F> image CRC failed
+#define Update_Chunk			1024U		// Image bytes per frame
+#define Update_Announce_ms		500
+#define Update_Frame_Timeout_ms	200		// Partial frame this long: resynchronise (<U,N,seq>)
+#define Update_Idle_Timeout_ms	60000	// Nothing received: reset into the installed image
+
+typedef struct
+{
+	uint16_t seq;				// Chunk index
+	uint16_t len;				// Image bytes in data[], Update_Chunk except for the last chunk
+	uint32_t data[Update_Chunk / 4];	// Padded with 0xFF
+	uint32_t crc;				// CRC-32 of seq..data, as above
+} Update_Frame;
+
+void Update_Init(void);
+uint8_t Update_Running_Slot(void);
+void Update_Confirm(void);
+void Update_Enter(uint32_t baud);
+void Update_Send_Status(void);
+
+#endif /* UPDATE_H */
@@ -0,0 +1,23 @@
+#ifndef YAW_CTRL_H
+#define YAW_CTRL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Yaw-rate stabilisation on the servo-steered profiles (Ackermann, 4WD)
+// The packet steer and throttle ask for a turn rate; once per servo frame the gyro rate (imu.h)
+// is compared with it and a PI correction is added to the servo command
+// Rates in 0.01 deg/s (positive = turning right), steering in 0.01 degree
+#define Yaw_Gyro_Sign			(-1)	// Sensor face up: gyro Z is positive counter-clockwise (left)
+#define Yaw_Min_Throttle		15		// % below this: no correction, the car is barely moving
+#define Yaw_Max_Correction		(15 * Steer_Scale)	// Servo correction limit (0.01 degree)
+#define Yaw_Bias_Shift			4		// Gyro bias IIR while stopped: bias += (x - bias) >> 4 per frame
+
+uint16_t Yaw_Command(uint16_t steer, uint8_t throttle, uint8_t dir);
+void Yaw_Frame(void);
+int32_t Yaw_Rate(void);
+int32_t Yaw_Target(void);
+int32_t Yaw_Correction(void);
+void Yaw_Send_Status(void);
+
+#endif /* YAW_CTRL_H */
@@ -0,0 +1,143 @@
+#include "main.h"
+#include "autobaud.h"
+#include "config.h"
+#include "sched.h"
+#include "trace.h"
+
+static const uint32_t standard_rates[] =
+{
+	1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600
+};
+
+static volatile Autobaud_State state = Autobaud_Locked;
+static volatile uint32_t edges[4];			// CYCCNT at fall, rise, fall, rise
+static volatile uint8_t edge_n = 0;
+static volatile uint32_t confirm_ms = 0;	// Sched_Millis() when BRR was changed
+static uint8_t error_run = 0;
+
+void Autobaud_Init(bool hunt)
+{
+	// PA10 stays in AF7 for USART1, the input path still feeds EXTI10
+	RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+	SYSCFG->EXTICR[2] &= ~SYSCFG_EXTICR3_EXTI10;	// 0000: PA10
+	EXTI->RTSR |= (1U << Rx1);						// Both edges
+	EXTI->FTSR |= (1U << Rx1);
+	EXTI->IMR &= ~(1U << Rx1);						// Masked until a hunt starts
+	NVIC_EnableIRQ(EXTI15_10_IRQn);					// Priority: IRQ_Config_Init()
+
+	if (hunt) Autobaud_Start();
+}
+
+void Autobaud_Start(void)
+{
+	edge_n = 0;
+	error_run = 0;
+	state = Autobaud_Hunt;
+	EXTI->PR = (1U << Rx1);							// rc_w1
+	EXTI->IMR |= (1U << Rx1);
+}
+
+static bool Near(uint32_t a, uint32_t b, uint32_t tol)
+{
+	return ((a > b) ? a - b : b - a) <= tol;
+}
+
+static void Autobaud_Match(void)
+{
+	// Scaled by 9 so total = one bit per unit: 3 + 4 + 2 bits, each within half a bit
+	uint32_t total = edges[3] - edges[0];
+	uint32_t d1 = edges[1] - edges[0];
+	uint32_t d2 = edges[2] - edges[1];
+	uint32_t d3 = edges[3] - edges[2];
+
+	if (!Near(9 * d1, 3 * total, total / 2)) return;
+	if (!Near(9 * d2, 4 * total, total / 2)) return;
+	if (!Near(9 * d3, 2 * total, total / 2)) return;
+
+	uint32_t baud = (SysClk / total) * 9;
+	for (uint8_t i = 0; i < sizeof(standard_rates) / sizeof(standard_rates[0]); i++)
+	{
+		uint32_t rate = standard_rates[i];
+		if (Near(baud, rate, rate / Autobaud_Tolerance))
+		{
+			USART1->CR1 &= ~USART_CR1_UE;
+			USART1->BRR = (SysClk + rate / 2) / rate;	// Oversampling 16
+			USART1->CR1 |= USART_CR1_UE;
+
+			EXTI->IMR &= ~(1U << Rx1);
+			confirm_ms = Sched_Millis();
+			state = Autobaud_Confirm;
+			Trace_Log(Trace_Autobaud, 1, (uint16_t)(rate / 100));
+			return;
+		}
+	}
+}
+
+void EXTI15_10_IRQHandler(void)
+{
+	uint32_t now = DWT->CYCCNT;					// Software input capture, first thing
+
+	if (EXTI->PR & (1U << Rx1))
+	{
+		EXTI->PR = (1U << Rx1);
+		bool high = (GPIOA->IDR & (1U << Rx1)) != 0;
+
+		// Longer than a 1200 baud character since the start edge: stale, start over
+		if (edge_n && (now - edges[0]) > (SysClk / 1200) * 10) edge_n = 0;
+
+		// Edges alternate fall / rise; on a missed edge restart at the next start bit
+		if (high != (edge_n & 1))
+		{
+			edge_n = 0;
+			if (high) return;
+		}
+
+		edges[edge_n++] = now;
+		if (edge_n == 4)
+		{
+			edge_n = 0;
+			Autobaud_Match();
+		}
+	}
+}
+
+void Autobaud_Rx_Error(void)
+{
+	// Called by the parser on framing / noise errors
+	if (state == Autobaud_Locked && ++error_run >= Autobaud_Error_Run)
+		Autobaud_Start();
+}
+
+void Autobaud_Frame_Ok(void)
+{
+	// Called by the parser on every complete, known frame
+	error_run = 0;
+	if (state == Autobaud_Locked) return;
+
+	EXTI->IMR &= ~(1U << Rx1);
+	state = Autobaud_Locked;
+
+	// Keep the confirmed rate for the next boot
+	uint32_t brr = USART1->BRR;
+	for (uint8_t i = 0; i < sizeof(standard_rates) / sizeof(standard_rates[0]); i++)
+	{
+		if ((SysClk + standard_rates[i] / 2) / standard_rates[i] == brr)
+		{
+			Trace_Log(Trace_Autobaud, 0, (uint16_t)(standard_rates[i] / 100));
+			Config_Set(Cfg_Baud, standard_rates[i]);
+			break;
+		}
+	}
+}
+
+void Autobaud_Poll(void)
+{
+	// Confirmation timed out: wrong snap, hunt again
+	if (state == Autobaud_Confirm && (Sched_Millis() - confirm_ms) > Autobaud_Confirm_ms)
+		Autobaud_Start();
+}
+
+Autobaud_State Autobaud_Get_State(void)
+{
+	return state;
+}
@@ -0,0 +1,246 @@
+#include "main.h"
+#include "bench.h"
+#include "trace.h"
+#include "irq_config.h"
+#include "config.h"
+#include "drive_mix.h"
+#include "link.h"
+#include <stdlib.h>
+
+typedef struct
+{
+	const char *name;
+	void (*prepare)(uint32_t i);	// Untimed set-up before each call, may be NULL
+	void (*run)(uint32_t i);		// The timed call
+} Bench_Case;
+
+static uint32_t samples[Bench_Iterations];
+static uint32_t overhead = 0;		// Cycles of an empty case, subtracted from every sample
+static bool use_systick = 0;		// No DWT cycle counter (QEMU): time with the SysTick down-counter
+
+static uint32_t Bench_Now(void)
+{
+	// Counts up in both modes, SysTick wraps at 24 bits
+	return use_systick ? (0U - SysTick->VAL) : DWT->CYCCNT;
+}
+
+static uint32_t Bench_Elapsed(uint32_t t0)
+{
+	return (Bench_Now() - t0) & (use_systick ? 0x00FFFFFFU : 0xFFFFFFFFU);
+}
+
+// ----------------------------------------------------
+// Cases: arguments vary with the iteration so branches in the drivers are all exercised
+// ----------------------------------------------------
+
+static void Run_Empty(uint32_t i)
+{
+	(void)i;
+}
+
+static void Run_Servo_Angle(uint32_t i)
+{
+	Servo_TIM2_PWM_SetAngle((uint8_t)(i % 181));
+}
+
+static void Run_Motor_Duty(uint32_t i)
+{
+	Motor_TIM1_PWM_SetDutyCycle((uint8_t)(i % 101));
+}
+
+static void Run_Motor_Dir(uint32_t i)
+{
+	Motor_Direction_Control((uint8_t)(i % 3));
+}
+
+static void Run_Car_Control(uint32_t i)
+{
+	Car_Control((uint16_t)((i * 37) % 9001), (uint8_t)(i % 101), (uint8_t)(i % 3));
+}
+
+// Parser: one control frame fed through the HC-05 port's byte source
+static const char *parse_frame = "<S,45.25,60,1>";
+static uint8_t parse_pos = 0;
+
+static bool Parse_Pop(uint16_t *entry)
+{
+	if (parse_frame[parse_pos] == '\0') return 0;
+	*entry = (uint8_t)parse_frame[parse_pos++];
+	return 1;
+}
+
+static void Prep_Parser(uint32_t i)
+{
+	(void)i;
+	parse_frame = "<S,45.25,60,1>";
+	parse_pos = 0;
+}
+
+static void Prep_Parser_Foreign(uint32_t i)
+{
+	// The same frame addressed to another car: skipped after the ID
+	(void)i;
+	parse_frame = (Config_Get(Cfg_Car_Id) == 2) ? "<@3,S,45.25,60,1>" : "<@2,S,45.25,60,1>";
+	parse_pos = 0;
+}
+
+static void Run_Parser(uint32_t i)
+{
+	uint16_t steer;
+	uint8_t throttle, dir;
+	(void)i;
+	Link_Receive_Packet(&steer, &throttle, &dir);
+}
+
+// Send path: one character into the empty reply queue (no wait for the wire), CR so the report stays readable
+static void Prep_Uart_Send(uint32_t i)
+{
+	(void)i;
+	Link_Flush();
+	while (!(USART1->SR & USART_SR_TC)) {}
+}
+
+static void Run_Uart_Send(uint32_t i)
+{
+	(void)i;
+	Link_Send_Char('\r');
+}
+
+static const Bench_Case cases[] =
+{
+	{ "servo_set_angle",  NULL,                Run_Servo_Angle },
+	{ "motor_set_duty",   NULL,                Run_Motor_Duty },
+	{ "motor_direction",  NULL,                Run_Motor_Dir },
+	{ "car_control",      NULL,                Run_Car_Control },
+	{ "link_parse_frame", Prep_Parser,         Run_Parser },
+	{ "link_skip_frame",  Prep_Parser_Foreign, Run_Parser },
+	{ "uart_send_char",   Prep_Uart_Send,      Run_Uart_Send },
+};
+
+// ----------------------------------------------------
+// Harness
+// ----------------------------------------------------
+
+static int Compare_U32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void Bench_Measure(const Bench_Case *c)
+{
+	// Each call timed alone with interrupts masked, so no handler lands inside a sample
+	for (uint32_t i = 0; i < Bench_Iterations; i++)
+	{
+		if (c->prepare) c->prepare(i);
+
+		__disable_irq();
+		uint32_t t0 = Bench_Now();
+		c->run(i);
+		uint32_t dt = Bench_Elapsed(t0);
+		__enable_irq();
+
+		samples[i] = (dt > overhead) ? dt - overhead : 0;
+	}
+
+	qsort(samples, Bench_Iterations, sizeof(samples[0]), Compare_U32);
+}
+
+static void Bench_Clock_Init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	uint32_t t0 = DWT->CYCCNT;
+	for (volatile uint8_t n = 0; n < 16; n++) {}
+	use_systick = (DWT->CYCCNT == t0);
+
+	if (use_systick)
+	{
+		SysTick->LOAD = 0x00FFFFFFU;
+		SysTick->VAL = 0;
+		SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;	// Core clock, no interrupt
+	}
+}
+
+static void Bench_Init(void)
+{
+	// Car_Init() without SysTick, ADC, IMU and interpolation: nothing runs behind the measurements
+	Trace_Init();
+	IRQ_Config_Init();
+	Config_Init();
+	Motor_Direction_Control_Init();
+
+	// Core cycle counts are the same on HSI, both clocks run flash at zero wait states
+	for (uint32_t n = 0; n < Bench_HSE_Timeout; n++)
+	{
+		if (RCC->CR & RCC_CR_HSERDY)
+		{
+			SystemClock_Init();
+			break;
+		}
+	}
+
+	Motor_TIM1_PWM_Init();
+	Servo_TIM2_PWM_Init();
+	Drive_Mix_Init((Drive_Profile)Config_Get(Cfg_Drive_Profile));
+	Car_Control(Config_Get(Cfg_Steer_Reset), Car_Reset_Throttle, Car_Reset_Direction);
+	UART1_Init();
+
+	Bench_Clock_Init();
+}
+
+static void Bench_Run(void)
+{
+	// Calibrate: the cheapest empty sample is the cost of the timing itself
+	const Bench_Case empty = { "empty", NULL, Run_Empty };
+	overhead = 0;
+	Bench_Measure(&empty);
+	overhead = samples[0];
+
+	Link_Send_Str("<K,begin,");
+	Link_Send_Str(use_systick ? "systick" : "dwt");
+	Link_Send_Char(',');
+	Link_Send_Uint(Bench_Iterations);
+	Link_Send_Char(',');
+	Link_Send_Uint(overhead);
+	Link_Send_Str(">\r\n");
+
+	Link_Set_Source(Link_HC05, Parse_Pop);
+
+	for (uint8_t n = 0; n < sizeof(cases) / sizeof(cases[0]); n++)
+	{
+		Bench_Measure(&cases[n]);
+
+		Link_Send_Str("<K,");
+		Link_Send_Str(cases[n].name);
+		Link_Send_Char(',');
+		Link_Send_Uint(samples[0]);
+		Link_Send_Char(',');
+		Link_Send_Uint(samples[Bench_Iterations / 2]);
+		Link_Send_Char(',');
+		Link_Send_Uint(samples[Bench_Iterations - 1]);
+		Link_Send_Str(">\r\n");
+	}
+
+	Link_Set_Source(Link_HC05, UART1_Rx_Pop);
+	Car_Control(Config_Get(Cfg_Steer_Reset), Car_Reset_Throttle, Car_Reset_Direction);
+	Link_Send_Str("<K,end>\r\n");
+	Link_Flush();						// Nothing polls the reply queue while waiting for K
+}
+
+void Bench_Main(void)
+{
+	// Benchmark build entry (Bench_Build): never returns
+	Bench_Init();
+
+	while (1)
+	{
+		Bench_Run();
+
+		uint16_t entry;
+		do {
+			while (!UART1_Rx_Pop(&entry)) {}
+		} while ((char)entry != 'K');
+	}
+}
@@ -0,0 +1,86 @@
+#include "main.h"
+#include "boot.h"
+#include "drive_mix.h"
+#include "link.h"
+
+static uint32_t boot_switch_cycles = 0;			// CYCCNT when SYSCLK moved from HSI to HSE
+static uint32_t boot_cycles[Boot_Mark_Count];
+
+static void Boot_Safe_Outputs(void)
+{
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOBEN;
+
+	// L298N inputs: direction pins low (motor free), enables low (no drive)
+	const uint32_t pb = (1U << Motor_DC1) | (1U << Motor_DC2)
+			| (1U << Motor_W1_DC1) | (1U << Motor_W1_DC2) | (1U << Motor_W2_DC1) | (1U << Motor_W2_DC2)
+			| (1U << Motor_W3_DC1) | (1U << Motor_W3_DC2) | (1U << Motor_W1) | (1U << Motor_W2);
+
+	// Servo: PA15 is JTDI with a pull-up after reset, a long high level makes the servo jump
+	const uint32_t pa = (1U << Motor) | (1U << Motor_W3) | (1U << Servo);
+
+	GPIOB->BSRR = pb << 16;						// Low before the pins become outputs
+	GPIOA->BSRR = pa << 16;
+
+	for (uint8_t pin = 0; pin < 16; pin++)
+	{
+		if (pb & (1U << pin))
+		{
+			GPIOB->PUPDR &= ~(3U << (pin * 2));	// No pull-up or pull-down
+			GPIOB->MODER = (GPIOB->MODER & ~(3U << (pin * 2))) | (1U << (pin * 2));	// 01: Output mode
+		}
+		if (pa & (1U << pin))
+		{
+			GPIOA->PUPDR &= ~(3U << (pin * 2));
+			GPIOA->MODER = (GPIOA->MODER & ~(3U << (pin * 2))) | (1U << (pin * 2));
+		}
+	}
+}
+
+void SystemInit(void)
+{
+	// Called by Reset_Handler before .data/.bss are set up: registers only, no statics
+
+	// Start the crystal now, it locks while the rest of the boot runs on HSI
+	RCC->CR |= RCC_CR_HSEON;
+
+	// DWT cycle counter from reset, shared with the flight recorder
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	Boot_Safe_Outputs();
+}
+
+void Boot_Clock_Switched(void)
+{
+	boot_switch_cycles = DWT->CYCCNT;
+	boot_cycles[Boot_HSE_Ready] = boot_switch_cycles;
+}
+
+void Boot_Mark_Time(Boot_Mark mark)
+{
+	boot_cycles[mark] = DWT->CYCCNT;
+}
+
+uint32_t Boot_Time_us(Boot_Mark mark)
+{
+	// Cycles before the switch are HSI cycles, after it SysClk cycles
+	uint32_t cycles = boot_cycles[mark];
+
+	if (cycles <= boot_switch_cycles)
+		return cycles / (HSI_Freq / 1000000U);
+
+	return boot_switch_cycles / (HSI_Freq / 1000000U) + (cycles - boot_switch_cycles) / (SysClk / 1000000U);
+}
+
+void Boot_Send_Times(void)
+{
+	// Reply: <B,hse_ready_us,first_pwm_us,uart_ready_us,main_loop_us>
+	Link_Send_Str("<B");
+	for (uint8_t mark = 0; mark < Boot_Mark_Count; mark++)
+	{
+		Link_Send_Char(',');
+		Link_Send_Uint(Boot_Time_us((Boot_Mark)mark));
+	}
+	Link_Send_Str(">\r\n");
+}
@@ -0,0 +1,202 @@
+#include "main.h"
+#include "config.h"
+#include "drive_mix.h"
+#include "link.h"
+#include "curves.h"
+#include "flash.h"
+#include "range.h"
+
+// Flash layout, per sector:
+//   0x0000  seq   (written first)     generation, higher wins
+//   0x0004  magic (written last)      Config_Magic, sector valid once present
+//   0x0008  entries, 8 bytes each:    word0 = key | check << 16, word1 = value
+// Entries are appended; on load the last valid entry of a key wins
+
+#define Entry_Size		8U
+#define Header_Size		8U
+
+typedef struct
+{
+	uint32_t def;
+	uint32_t min;
+	uint32_t max;
+} Config_Def;
+
+static const Config_Def config_defs[Cfg_Count] =
+{
+	[Cfg_Steer_Reset]      = { Car_Reset_Steer_Angle * Steer_Scale, 0, 180 * Steer_Scale },
+	[Cfg_Servo_Min_us]     = { Servo_Min_Pulse_us, 400, 1500 },
+	[Cfg_Servo_Max_us]     = { Servo_Max_Pulse_us, 1500, 2600 },
+	[Cfg_Throttle_Ramp]    = { 100, 1, 100 },
+	[Cfg_Baud]             = { 9600, 1200, 1382400 },
+	[Cfg_Drive_Profile]    = { Drive_Profile_Default, Drive_Ackermann, Drive_4WD },
+	[Cfg_Motor_PWM_Freq]   = { Motor_PWM_Freq, 100, 20000 },
+	[Cfg_Autobaud]         = { 1, 0, 1 },
+	[Cfg_Port2_Role]       = { Link_Role_Control, Link_Role_Off, Link_Role_Debug },
+	[Cfg_Yaw_Stab]         = { 1, 0, 1 },
+	[Cfg_Yaw_Full_Rate]    = { 180, 10, 1000 },
+	[Cfg_Yaw_Kp]           = { 20, 0, 500 },
+	[Cfg_Yaw_Ki]           = { 40, 0, 1000 },
+	[Cfg_Curve]            = { Curve_Default, Curve_Linear, Curve_Count - 1 },
+	[Cfg_Brake_Reverse_ms] = { 250, 0, 2000 },
+	[Cfg_Brake_Force]      = { 100, 0, 100 },
+	[Cfg_Failsafe_ms]      = { 500, 300, 5000 },
+	[Cfg_Car_Id]           = { 1, 1, Link_Id_Max },
+	[Cfg_Motor_PWM_Align]  = { Motor_PWM_Center, 0, 1 },
+	[Cfg_Range_Guard]      = { 0, 0, 1 },
+	[Cfg_Range_Stop_mm]    = { 250, 50, 2000 },
+	[Cfg_Range_TTC_ms]     = { 500, 100, 3000 },
+};
+
+static uint32_t config_ram[Cfg_Count];		// Loaded once at boot, O(1) lookups
+static uint32_t active_addr = Config_Sector_A_Addr;
+static uint32_t active_seq = 0;
+static uint32_t write_off = Header_Size;	// Next free entry in the active sector
+
+static uint16_t Entry_Check(uint16_t key, uint32_t value)
+{
+	return (uint16_t)(~key ^ value ^ (value >> 16) ^ 0x5A5AU);
+}
+
+static bool Sector_Valid(uint32_t addr)
+{
+	return Flash_Word(addr + 4) == Config_Magic && Flash_Word(addr) != Flash_Erased;
+}
+
+// ----------------------------------------------------
+// Store
+// ----------------------------------------------------
+
+static void Config_Load(uint32_t addr)
+{
+	uint32_t off;
+
+	for (off = Header_Size; off + Entry_Size <= Config_Sector_Size; off += Entry_Size)
+	{
+		uint32_t w0 = Flash_Word(addr + off);
+		uint32_t w1 = Flash_Word(addr + off + 4);
+
+		if (w0 == Flash_Erased && w1 == Flash_Erased) break;		// End of log
+
+		uint16_t key = (uint16_t)(w0 & 0xFFFF);
+		if (key < Cfg_Count && (w0 >> 16) == Entry_Check(key, w1)
+				&& w1 >= config_defs[key].min && w1 <= config_defs[key].max)
+			config_ram[key] = w1;
+		// Torn or foreign entries are skipped, the slot stays used
+	}
+
+	write_off = off;
+}
+
+static bool Config_Format(uint32_t addr, uint8_t sector, uint32_t seq)
+{
+	// Header last: the sector only becomes valid once every entry is in
+	if (!Flash_Erase_Sector(sector)) return 0;
+
+	uint32_t off = Header_Size;
+	for (uint16_t key = 0; key < Cfg_Count; key++)
+	{
+		if (config_ram[key] == config_defs[key].def) continue;
+
+		if (!Flash_Program_Word(addr + off + 4, config_ram[key])) return 0;
+		if (!Flash_Program_Word(addr + off, key | ((uint32_t)Entry_Check(key, config_ram[key]) << 16))) return 0;
+		off += Entry_Size;
+	}
+
+	if (!Flash_Program_Word(addr, seq)) return 0;
+	if (!Flash_Program_Word(addr + 4, Config_Magic)) return 0;
+
+	active_addr = addr;
+	active_seq = seq;
+	write_off = off;
+	return 1;
+}
+
+static bool Config_Compact(void)
+{
+	// Erase stalls the CPU for hundreds of ms: park the car first
+	Car_Control(config_ram[Cfg_Steer_Reset], 0, 0);
+
+	if (active_addr == Config_Sector_A_Addr)
+		return Config_Format(Config_Sector_B_Addr, Config_Sector_B, active_seq + 1);
+	else
+		return Config_Format(Config_Sector_A_Addr, Config_Sector_A, active_seq + 1);
+}
+
+void Config_Init(void)
+{
+	for (uint16_t key = 0; key < Cfg_Count; key++)
+		config_ram[key] = config_defs[key].def;
+
+	bool a = Sector_Valid(Config_Sector_A_Addr);
+	bool b = Sector_Valid(Config_Sector_B_Addr);
+
+	if (a && (!b || Flash_Word(Config_Sector_A_Addr) > Flash_Word(Config_Sector_B_Addr)))
+		active_addr = Config_Sector_A_Addr;
+	else if (b)
+		active_addr = Config_Sector_B_Addr;
+	else
+	{
+		Config_Format(Config_Sector_A_Addr, Config_Sector_A, 1);	// Blank: defaults only
+		return;
+	}
+
+	active_seq = Flash_Word(active_addr);
+	Config_Load(active_addr);
+}
+
+uint32_t Config_Get(Config_Key key)
+{
+	return config_ram[key];
+}
+
+bool Config_Set(Config_Key key, uint32_t value)
+{
+	if (key >= Cfg_Count) return 0;
+	if (value < config_defs[key].min || value > config_defs[key].max) return 0;
+	if (config_ram[key] == value) return 1;
+
+	// The RAM value follows the flash: a failed write leaves both as they were
+	if (write_off + Entry_Size > Config_Sector_Size)
+	{
+		// Sector full: compaction rewrites the current table, new value included, into the other sector
+		uint32_t old = config_ram[key];
+		config_ram[key] = value;
+		if (!Config_Compact())
+		{
+			config_ram[key] = old;		// The old sector is still the active one
+			return 0;
+		}
+	}
+	else
+	{
+		// Value first, key + check last: a torn write never matches its check
+		uint32_t addr = active_addr + write_off;
+		write_off += Entry_Size;
+		if (!Flash_Program_Word(addr + 4, value)) return 0;
+		if (!Flash_Program_Word(addr, key | ((uint32_t)Entry_Check(key, value) << 16))) return 0;
+		config_ram[key] = value;
+	}
+
+	// Keys that take effect immediately, the rest are read live or at the next boot
+	if (key == Cfg_Drive_Profile)
+		Drive_Mix_SetProfile((Drive_Profile)value);
+	else if (key == Cfg_Curve)
+		Curve_Select((Curve_Id)value);
+	else if (key == Cfg_Motor_PWM_Align)
+		Motor_TIM1_PWM_Align(value);
+	else if (key == Cfg_Range_Guard)
+		Range_Enable(value);
+
+	return 1;
+}
+
+void Config_Send(Config_Key key)
+{
+	// Reply: <C,key,value>
+	Link_Send_Str("<C,");
+	Link_Send_Uint(key);
+	Link_Send_Char(',');
+	Link_Send_Uint(config_ram[key]);
+	Link_Send_Str(">\r\n");
+}
@@ -0,0 +1,84 @@
+#include "main.h"
+#include "curves.h"
+#include "drive_mix.h"
+
+#if (2 * Drive_Steer_Span + 1) != Curve_Steer_Points || Drive_Steer_Center != Drive_Steer_Span
+#error "Steering tables cover 0 .. 2 * Drive_Steer_Span degrees around Drive_Steer_Center"
+#endif
+
+// Shaping, integer constant expressions on x = 0..10000 (stick deflection, 0.01 %)
+// Parameters in %: deadband width, expo (cubic share), rate (output at full deflection)
+#define Curve_Deadband(x, db)	((x) <= (db) * 100 ? 0 : ((x) - (db) * 100) * 10000 / (10000 - (db) * 100))
+#define Curve_Expo(x, ex)		(((100 - (ex)) * (x) + (ex) * (((x) * (x) / 10000) * (x) / 10000)) / 100)
+#define Curve_Shape(x, ex, db, rate)	(Curve_Expo(Curve_Deadband(x, db), ex) * (rate) / 100)
+
+// Table entries: throttle index 0..100 %, steer index 0..90 degrees mirrored about the center
+#define Curve_Thr_Entry(i, ex, db, rate) \
+	((uint8_t)((Curve_Shape((i) * 100, ex, db, rate) + 50) / 100))
+#define Curve_Steer_Offset(d, ex, db, rate) \
+	((Curve_Shape((d) * 10000 / Drive_Steer_Span, ex, db, rate) * (Drive_Steer_Span * Steer_Scale) + 5000) / 10000)
+#define Curve_Steer_Entry(i, ex, db, rate) \
+	((uint16_t)(((i) < Drive_Steer_Center) \
+		? Drive_Steer_Center * Steer_Scale - Curve_Steer_Offset(Drive_Steer_Center - (i), ex, db, rate) \
+		: Drive_Steer_Center * Steer_Scale + Curve_Steer_Offset((i) - Drive_Steer_Center, ex, db, rate)))
+
+// Expand an entry macro over every index
+#define Curve_Row10(F, b, ...) \
+	F((b) + 0, __VA_ARGS__), F((b) + 1, __VA_ARGS__), F((b) + 2, __VA_ARGS__), F((b) + 3, __VA_ARGS__), \
+	F((b) + 4, __VA_ARGS__), F((b) + 5, __VA_ARGS__), F((b) + 6, __VA_ARGS__), F((b) + 7, __VA_ARGS__), \
+	F((b) + 8, __VA_ARGS__), F((b) + 9, __VA_ARGS__)
+#define Curve_Rows90(F, ...) \
+	Curve_Row10(F, 0, __VA_ARGS__), Curve_Row10(F, 10, __VA_ARGS__), Curve_Row10(F, 20, __VA_ARGS__), \
+	Curve_Row10(F, 30, __VA_ARGS__), Curve_Row10(F, 40, __VA_ARGS__), Curve_Row10(F, 50, __VA_ARGS__), \
+	Curve_Row10(F, 60, __VA_ARGS__), Curve_Row10(F, 70, __VA_ARGS__), Curve_Row10(F, 80, __VA_ARGS__)
+#define Curve_Throttle_Table(...)	{ Curve_Rows90(Curve_Thr_Entry, __VA_ARGS__), Curve_Row10(Curve_Thr_Entry, 90, __VA_ARGS__), \
+										Curve_Thr_Entry(100, __VA_ARGS__) }
+#define Curve_Steer_Table(...)		{ Curve_Rows90(Curve_Steer_Entry, __VA_ARGS__), Curve_Steer_Entry(90, __VA_ARGS__) }
+
+//                                                              expo  deadband  rate
+static const uint8_t thr_linear[Curve_Throttle_Points]  = Curve_Throttle_Table( 0,    0,      100);
+static const uint8_t thr_soft[Curve_Throttle_Points]    = Curve_Throttle_Table(40,    3,      100);
+static const uint8_t thr_low[Curve_Throttle_Points]     = Curve_Throttle_Table(40,    3,       60);
+static const uint8_t thr_race[Curve_Throttle_Points]    = Curve_Throttle_Table(20,    0,      100);
+
+static const uint16_t steer_linear[Curve_Steer_Points]  = Curve_Steer_Table(    0,    0,      100);
+static const uint16_t steer_soft[Curve_Steer_Points]    = Curve_Steer_Table(   50,    2,      100);
+static const uint16_t steer_low[Curve_Steer_Points]     = Curve_Steer_Table(   50,    2,       70);
+static const uint16_t steer_race[Curve_Steer_Points]    = Curve_Steer_Table(   25,    0,      100);
+
+static const Curve curves[Curve_Count] =
+{
+	[Curve_Linear]   = { thr_linear, steer_linear },
+	[Curve_Soft]     = { thr_soft,   steer_soft },
+	[Curve_Low_Rate] = { thr_low,    steer_low },
+	[Curve_Race]     = { thr_race,   steer_race },
+};
+
+static const Curve *volatile curve_active = &curves[Curve_Default];
+
+void Curve_Select(Curve_Id id)
+{
+	// Pointer swap from the parser (<C,13,id>), the same context that shapes commands in Car_Command()
+	if (id < Curve_Count) curve_active = &curves[id];
+}
+
+Curve_Id Curve_Get(void)
+{
+	return (Curve_Id)(curve_active - curves);
+}
+
+uint8_t Curve_Throttle(uint8_t throttle)
+{
+	return curve_active->throttle[(throttle > 100) ? 100 : throttle];
+}
+
+uint16_t Curve_Steer(uint16_t steer)
+{
+	// Whole degrees: one lookup; the 0.01 degree part is interpolated to the next entry
+	const uint16_t *t = curve_active->steer;
+	uint16_t i = steer / Steer_Scale;
+	if (i >= Curve_Steer_Points - 1) return t[Curve_Steer_Points - 1];
+
+	uint16_t frac = steer % Steer_Scale;
+	return (uint16_t)(t[i] + (((int32_t)t[i + 1] - t[i]) * frac) / Steer_Scale);
+}
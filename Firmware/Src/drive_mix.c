@@ -0,0 +1,313 @@
+#include "main.h"
+#include "drive_mix.h"
+#include "trace.h"
+#include "yaw_ctrl.h"
+#include "sched.h"
+#include "config.h"
+#include "irq_config.h"
+#include "range.h"
+
+// Wheel index -> TIM1 channel
+// Ackermann:     0 = Drive
+// Differential:  0 = Left, 1 = Right
+// 4WD:           0 = Front-Left, 1 = Front-Right, 2 = Rear-Left, 3 = Rear-Right
+static const uint8_t Wheel_Channel[Drive_Wheels] = { 1, 2, 3, 4 };
+
+// Wheel index -> direction pins on GPIOB (wheel 0 handled by Motor_Direction_Control)
+static const uint8_t Wheel_DC1[Drive_Wheels] = { Motor_DC1, Motor_W1_DC1, Motor_W2_DC1, Motor_W3_DC1 };
+static const uint8_t Wheel_DC2[Drive_Wheels] = { Motor_DC2, Motor_W1_DC2, Motor_W2_DC2, Motor_W3_DC2 };
+
+static Drive_Profile profile_active = Drive_Ackermann;
+
+// Brake-then-reverse: a drive command against the direction of travel brakes first (Cfg_Brake_Reverse_ms)
+static int8_t drive_sign = 0;			// Drive output now: +1 forward, -1 reverse, 0 coast / brake
+static int8_t last_sign = 0;			// Last non-zero drive_sign
+static uint32_t coast_ms = 0;			// When drive_sign last went to 0
+static volatile bool reversing = 0;		// Brake phase running, the command waits in pend_*
+static uint32_t reverse_end_ms = 0;
+static uint16_t pend_steer;
+static uint8_t pend_thr;
+static uint8_t pend_dir;
+
+// Last output asked for, before the range guard: applied again when the guard changes (Drive_Mix_Reapply)
+static uint16_t req_steer = Drive_Steer_Center * Steer_Scale;
+static uint8_t req_thr = 0;
+static uint8_t req_dir = 0;
+
+static void Drive_Wheel_GPIO_Init(uint8_t wheel)
+{
+	uint8_t dc1 = Wheel_DC1[wheel];
+	uint8_t dc2 = Wheel_DC2[wheel];
+
+	GPIOB->MODER &= ~((3U << (dc1 * 2)) | (3U << (dc2 * 2)));	// 00: Clear register
+	GPIOB->MODER |=  ((1U << (dc1 * 2)) | (1U << (dc2 * 2)));	// 01: Output mode
+	GPIOB->OTYPER &= ~((1U << dc1) | (1U << dc2));				// Push-pull
+	GPIOB->PUPDR &= ~((3U << (dc1 * 2)) | (3U << (dc2 * 2)));	// No pull-up or pull-down
+	GPIOB->BSRR = (1U << (dc1 + 16)) | (1U << (dc2 + 16));		// Both low, motor off
+}
+
+void Drive_Mix_Init(Drive_Profile profile)
+{
+	// Enable clocks for GPIOA, GPIOB (TIM1 already running from Motor_TIM1_PWM_Init)
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOBEN;
+
+	// Direction pins for the extra wheels
+	for (uint8_t wheel = 1; wheel < Drive_Wheels; wheel++)
+		Drive_Wheel_GPIO_Init(wheel);
+
+	// PB0 (CH2N), PB1 (CH3N) as Alternate Function(AF1)
+	GPIOB->MODER &= ~((3U << (Motor_W1 * 2)) | (3U << (Motor_W2 * 2)));	// 00: Clear register
+	GPIOB->MODER |=  ((2U << (Motor_W1 * 2)) | (2U << (Motor_W2 * 2)));	// 10: Alternate function
+	GPIOB->OTYPER &= ~((1U << Motor_W1) | (1U << Motor_W2));				// Push-pull
+	GPIOB->OSPEEDR |= (3U << (Motor_W1 * 2)) | (3U << (Motor_W2 * 2));		// Very high speed
+	GPIOB->AFR[0] &= ~((0xFU << (Motor_W1 * 4)) | (0xFU << (Motor_W2 * 4)));	// Clear register
+	GPIOB->AFR[0] |=  ((1U << (Motor_W1 * 4)) | (1U << (Motor_W2 * 4)));		// AF1 TIM1_CH2N/CH3N
+
+	// PA11 (CH4) as Alternate Function(AF1)
+	GPIOA->MODER &= ~(3U << (Motor_W3 * 2));			// 00: Clear register
+	GPIOA->MODER |=  (2U << (Motor_W3 * 2));			// 10: Alternate function
+	GPIOA->OTYPER &= ~(1U << Motor_W3);					// Push-pull
+	GPIOA->OSPEEDR |= (3U << (Motor_W3 * 2));			// Very high speed
+	GPIOA->AFR[1] &= ~(0xFU << ((Motor_W3 - 8) * 4));	// Clear register
+	GPIOA->AFR[1] |=  (1U << ((Motor_W3 - 8) * 4));		// AF1 TIM1_CH4
+
+	// CH2-CH4 PWM mode 1 (center-aligned: CH2/CH3 mode 2), pre-load enable, 0% duty cycle
+	TIM1->CCMR1 &= ~(7U << 12);
+	TIM1->CCMR1 |= (Motor_TIM1_OC_Mode(2) << 12) | TIM_CCMR1_OC2PE;	// OC2M
+	TIM1->CCMR2 &= ~((7U << 4) | (7U << 12));
+	TIM1->CCMR2 |= (Motor_TIM1_OC_Mode(3) << 4) | TIM_CCMR2_OC3PE;		// OC3M
+	TIM1->CCMR2 |= (Motor_TIM1_OC_Mode(4) << 12) | TIM_CCMR2_OC4PE;	// OC4M
+	for (uint8_t channel = 2; channel <= 4; channel++)
+		Motor_TIM1_PWM_SetChannelDutyCycle(channel, 0);	// Mode 2 is off at CCR > ARR, not 0
+	TIM1->EGR = TIM_EGR_UG;								// Load them before the outputs are enabled
+
+	// CH2/CH3 drive only their complementary pins (CCxE = 0, CCxNE = 1)
+	// With MOE = 1, OCxN = OCxREF (CCxNP = 0), so PB0/PB1 carry a normal PWM
+	// CH4 output is enabled for 4WD only, otherwise CC4 is the ADC current trigger
+	TIM1->CCER |= TIM_CCER_CC2NE | TIM_CCER_CC3NE;
+
+	Drive_Mix_SetProfile(profile);
+}
+
+void Drive_Mix_SetProfile(Drive_Profile profile)
+{
+	// Stop every wheel before changing the mapping
+	for (uint8_t wheel = 0; wheel < Drive_Wheels; wheel++)
+	{
+		Motor_TIM1_PWM_SetChannelDutyCycle(Wheel_Channel[wheel], 0);
+		Drive_Wheel_Direction(wheel, 0);
+	}
+
+	if (profile == Drive_4WD)
+		TIM1->CCER |= TIM_CCER_CC4E;		// PA11 drives Rear-Right
+	else
+		TIM1->CCER &= ~TIM_CCER_CC4E;		// CC4 internal only
+
+	Trace_Log(Trace_Mode_Change, (uint8_t)profile, (uint16_t)profile_active);
+	profile_active = profile;
+}
+
+Drive_Profile Drive_Mix_GetProfile(void)
+{
+	return profile_active;
+}
+
+void Drive_Wheel_Direction(uint8_t wheel, uint8_t Direction)
+{
+	// Directions
+	// 0 = Stop (coast)
+	// 1 = Forward
+	// 2 = Backward
+	// 3 = Brake (both inputs high, the PWM sets the braking force)
+
+	if (wheel == 0)
+	{
+		Motor_Direction_Control(Direction);
+		return;
+	}
+
+	uint8_t dc1 = Wheel_DC1[wheel];
+	uint8_t dc2 = Wheel_DC2[wheel];
+
+	if (Direction == 1)
+		GPIOB->BSRR = (1U << dc1) | (1U << (dc2 + 16));			// DC1 high, DC2 low
+	else if (Direction == 2)
+		GPIOB->BSRR = (1U << (dc1 + 16)) | (1U << dc2);			// DC1 low, DC2 high
+	else if (Direction == Drive_Dir_Brake)
+		GPIOB->BSRR = (1U << dc1) | (1U << dc2);					// Both high
+	else
+		GPIOB->BSRR = (1U << (dc1 + 16)) | (1U << (dc2 + 16));	// Both low
+}
+
+static void Drive_Wheel_Set(uint8_t wheel, int16_t duty)
+{
+	// duty: -100..100, sign is the wheel direction
+	if (duty > 0)
+	{
+		Drive_Wheel_Direction(wheel, 1);
+		Motor_TIM1_PWM_SetChannelDutyCycle(Wheel_Channel[wheel], (uint8_t)duty);
+	}
+	else if (duty < 0)
+	{
+		Drive_Wheel_Direction(wheel, 2);
+		Motor_TIM1_PWM_SetChannelDutyCycle(Wheel_Channel[wheel], (uint8_t)(-duty));
+	}
+	else
+	{
+		Motor_TIM1_PWM_SetChannelDutyCycle(Wheel_Channel[wheel], 0);
+		Drive_Wheel_Direction(wheel, 0);
+	}
+}
+
+static void Drive_Wheel_Brake(uint8_t wheel, uint8_t force)
+{
+	Drive_Wheel_Direction(wheel, Drive_Dir_Brake);
+	Motor_TIM1_PWM_SetChannelDutyCycle(Wheel_Channel[wheel], force);
+}
+
+static void Drive_Mix_Output(uint16_t Steer, uint8_t Throttle, uint8_t Dir)
+{
+	req_steer = Steer;
+	req_thr = Throttle;
+	req_dir = Dir;
+	Range_Gate(&Throttle, &Dir);		// Emergency braking: forward clamped or turned into the brake
+
+	int8_t sign = (Throttle == 0) ? 0 : (Dir == 1) ? 1 : (Dir == 2) ? -1 : 0;
+	if (sign != 0)
+		last_sign = sign;
+	else if (drive_sign != 0)
+		coast_ms = Sched_Millis();
+	drive_sign = sign;
+
+	if (Steer > (Drive_Steer_Center + Drive_Steer_Span) * Steer_Scale) Steer = (Drive_Steer_Center + Drive_Steer_Span) * Steer_Scale;
+	if (Throttle > 100) Throttle = 100;
+
+	uint16_t servo = Yaw_Command(Steer, Throttle, Dir);	// Steer plus the yaw-rate correction
+
+	// Turn in Q8: -256 (full left) .. +256 (full right)
+	int32_t turn = (((int32_t)Steer - Drive_Steer_Center * Steer_Scale) * 256) / (Drive_Steer_Span * Steer_Scale);
+
+	// Signed throttle: -100..100
+	int32_t thr = 0;
+	if (Dir == 1) thr = Throttle;
+	else if (Dir == 2) thr = -(int32_t)Throttle;
+
+	int32_t left, right;
+
+	if (Dir == Drive_Dir_Brake)
+	{
+		// Every wheel shorted through the bridge, the servo keeps steering
+		if (profile_active != Drive_Differential) Servo_TIM2_PWM_SetAngleFine(servo);
+		uint8_t wheels = (profile_active == Drive_Ackermann) ? 1 : (profile_active == Drive_Differential) ? 2 : 4;
+		for (uint8_t wheel = 0; wheel < wheels; wheel++)
+			Drive_Wheel_Brake(wheel, Throttle);
+	}
+	else if (profile_active == Drive_Differential)
+	{
+		if (Dir == 0)
+		{
+			left = 0;
+			right = 0;
+		}
+		else
+		{
+			// Arcade mix: left = thr + yaw, right = thr - yaw
+			int32_t yaw = (turn * Drive_Diff_Turn_Gain) >> 8;
+			left  = thr + yaw;
+			right = thr - yaw;
+
+			// Scale both sides back into range keeping their ratio
+			int32_t peak = (left < 0 ? -left : left);
+			int32_t peak_r = (right < 0 ? -right : right);
+			if (peak_r > peak) peak = peak_r;
+			if (peak > 100)
+			{
+				left  = (left * 100) / peak;
+				right = (right * 100) / peak;
+			}
+		}
+
+		Drive_Wheel_Set(0, (int16_t)left);
+		Drive_Wheel_Set(1, (int16_t)right);
+	}
+	else if (profile_active == Drive_4WD)
+	{
+		// Front wheels steer with the servo, inner side slowed down (electronic differential)
+		Servo_TIM2_PWM_SetAngleFine(servo);
+
+		int32_t inner = (thr * (256 - (((turn < 0 ? -turn : turn) * Drive_4WD_Diff_Gain) / 100))) >> 8;
+		left  = (turn < 0) ? inner : thr;
+		right = (turn > 0) ? inner : thr;
+
+		Drive_Wheel_Set(0, (int16_t)left);		// Front-Left
+		Drive_Wheel_Set(1, (int16_t)right);		// Front-Right
+		Drive_Wheel_Set(2, (int16_t)left);		// Rear-Left
+		Drive_Wheel_Set(3, (int16_t)right);		// Rear-Right
+	}
+	else
+	{
+		// Ackermann: steer and throttle pass straight through
+		Servo_TIM2_PWM_SetAngleFine(servo);
+		Motor_Direction_Control(Dir);
+		Motor_TIM1_PWM_SetDutyCycle(Dir == 0 ? 0 : Throttle);	// Stop coasts: bridge disabled
+	}
+}
+
+void Drive_Mix_Apply(uint16_t Steer, uint8_t Throttle, uint8_t Dir)
+{
+	// Steer: 		0-9000 (0.01 deg), 0-Left, 4500-Straight, 9000-Right
+	// Throttle: 	0-100, braking force for Dir 3
+	// Direction:	0-Stop (coast), 1-Forward, 2-Backward, 3-Brake
+	int8_t sign = (Throttle == 0) ? 0 : (Dir == 1) ? 1 : (Dir == 2) ? -1 : 0;
+	uint32_t brake_ms = Config_Get(Cfg_Brake_Reverse_ms);
+
+	IRQ_Scheduler_Lock();		// Drive_Mix_Tick() must not end the brake phase half way through
+
+	uint32_t now = Sched_Millis();
+	bool rolling = last_sign != 0 && (drive_sign != 0 || (now - coast_ms) < brake_ms);
+
+	if (brake_ms && sign != 0 && sign == -last_sign && (reversing || rolling))
+	{
+		// Reversal while still rolling: brake, the command follows when the time is up
+		pend_steer = Steer;
+		pend_thr = Throttle;
+		pend_dir = Dir;
+		if (!reversing)
+		{
+			reversing = 1;
+			reverse_end_ms = now + brake_ms;
+			Drive_Mix_Output(Steer, (uint8_t)Config_Get(Cfg_Brake_Force), Drive_Dir_Brake);
+		}
+	}
+	else
+	{
+		reversing = 0;			// Any other command cancels the sequence
+		Drive_Mix_Output(Steer, Throttle, Dir);
+	}
+
+	IRQ_Scheduler_Unlock();
+}
+
+void Drive_Mix_Tick(void)
+{
+	// SysTick: end of the brake phase, the waiting reverse command is applied
+	if (reversing && (int32_t)(Sched_Millis() - reverse_end_ms) >= 0)
+	{
+		reversing = 0;
+		Drive_Mix_Output(pend_steer, pend_thr, pend_dir);
+	}
+}
+
+void Drive_Mix_Reapply(void)
+{
+	// Range guard changed (TIM3 capture): the last output through the new gate, without waiting for a command
+	IRQ_Scheduler_Lock();
+	Drive_Mix_Output(req_steer, req_thr, req_dir);
+	IRQ_Scheduler_Unlock();
+}
+
+bool Drive_Mix_Driving(void)
+{
+	// Drive output on (forward or reverse), brake and coast count as stopped
+	return drive_sign != 0 || reversing;
+}
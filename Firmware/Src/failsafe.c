@@ -0,0 +1,158 @@
+#include "main.h"
+#include "failsafe.h"
+#include "sched.h"
+#include "config.h"
+#include "interp.h"
+#include "drive_mix.h"
+#include "trace.h"
+#include "link.h"
+#include "setpoint.h"
+#include "maneuver.h"
+
+// Survives a watchdog reset (not zeroed by the startup code), checked with a magic
+#define Watchdog_Noinit_Magic	0x57444731U		// "WDG1"
+static uint32_t wdg_magic __attribute__((section(".noinit")));
+static uint32_t wdg_count __attribute__((section(".noinit")));
+
+static Failsafe_Stats stats;
+static bool wdg_on = 0;				// Started (not in the benchmark build)
+static uint32_t wdg_tick = 0;		// SysTick ms at the last refresh
+
+static bool armed = 0;				// A control frame arrived since boot / the last trip
+static bool tripped = 0;			// Ramp down running or done, until the next frame
+static bool stopped = 0;			// Drive output seen stopped after the trip
+static uint32_t last_ms = 0;		// Last valid control frame
+
+// ----------------------------------------------------
+// IWDG
+// ----------------------------------------------------
+
+static void Watchdog_Reload_Value(uint32_t ms)
+{
+	IWDG->KR = Watchdog_Key_Access;
+	while (IWDG->SR & IWDG_SR_RVU) {}		// Previous reload value still being transferred
+	IWDG->RLR = Watchdog_Count(ms) - 1U;
+	while (IWDG->SR & IWDG_SR_RVU) {}
+	IWDG->KR = Watchdog_Key_Reload;
+}
+
+void Watchdog_Init(void)
+{
+	// Before Trace_Init(), which clears the reset flags
+	uint32_t csr = RCC->CSR;
+	stats.wdg_reset = (csr & RCC_CSR_IWDGRSTF) != 0;
+
+	if ((csr & RCC_CSR_PORRSTF) || wdg_magic != Watchdog_Noinit_Magic)
+	{
+		wdg_magic = Watchdog_Noinit_Magic;
+		wdg_count = 0;
+	}
+	if (stats.wdg_reset) wdg_count++;
+	stats.wdg_resets = wdg_count;
+
+	DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;	// Halted in the debugger: no reset
+
+	IWDG->KR = Watchdog_Key_Start;			// Starts the LSI too, cannot be stopped again
+	wdg_on = 1;
+	IWDG->KR = Watchdog_Key_Access;
+	while (IWDG->SR & IWDG_SR_PVU) {}
+	IWDG->PR = Watchdog_PR_Code;
+	Watchdog_Reload_Value(Watchdog_Window_ms);
+}
+
+void Watchdog_Refresh(void)
+{
+	// Main loop: only while the SysTick still advances, the failsafe timing depends on it
+	uint32_t now = Sched_Millis();
+	if (now != wdg_tick)
+	{
+		wdg_tick = now;
+		IWDG->KR = Watchdog_Key_Reload;
+	}
+}
+
+void Watchdog_Stretch(bool erase)
+{
+	// Flash erase stalls the CPU for up to seconds: long window around it, normal one after
+	if (!wdg_on) return;				// Register updates need the LSI running
+	Watchdog_Reload_Value(erase ? Watchdog_Erase_ms : Watchdog_Window_ms);
+}
+
+// ----------------------------------------------------
+// Link-loss failsafe
+// ----------------------------------------------------
+
+void Failsafe_Feed(void)
+{
+	// Link_Arbitrate(): a control frame was accepted
+	last_ms = Sched_Millis();
+	armed = 1;
+	tripped = 0;
+}
+
+void Failsafe_Poll(void)
+{
+	uint32_t now = Sched_Millis();
+	uint32_t timeout = Config_Get(Cfg_Failsafe_ms);
+
+	if (Maneuver_Get_State() == Maneuver_Playing) Failsafe_Feed();	// Replay drives, not the link
+
+	if (armed && !tripped && now - last_ms >= timeout - Failsafe_Ramp_ms)
+	{
+		// Link lost: throttle ramps to zero and steering to centre, done at last_ms + timeout
+		tripped = 1;
+		stopped = 0;
+		stats.trips++;
+		Trace_Log(Trace_Failsafe, 0, (uint16_t)(now - last_ms));
+		Setpoint_Queue_Flush();			// Queued trajectory must not take over again
+
+		if (Interp_Enabled())
+			Interp_Ramp_To(Drive_Steer_Center * Steer_Scale, 0, 0, Failsafe_Ramp_ms);
+		else
+			Car_Control(Drive_Steer_Center * Steer_Scale, 0, 0);
+	}
+
+	if (tripped && !stopped && !Drive_Mix_Driving())
+	{
+		// Drive off: hold the brake so the car does not coast on
+		stopped = 1;
+		if (now - last_ms > stats.reaction_max_ms) stats.reaction_max_ms = now - last_ms;
+		Trace_Log(Trace_Failsafe, 1, (uint16_t)(now - last_ms));
+
+		uint8_t force = (uint8_t)Config_Get(Cfg_Brake_Force);
+		if (Interp_Enabled())
+			Interp_Ramp_To(Drive_Steer_Center * Steer_Scale, force, Drive_Dir_Brake, Interp_Frame_ms);
+		else
+			Car_Control(Drive_Steer_Center * Steer_Scale, force, Drive_Dir_Brake);
+	}
+}
+
+bool Failsafe_Active(void)
+{
+	return tripped;
+}
+
+const Failsafe_Stats *Failsafe_Get_Stats(void)
+{
+	return &stats;
+}
+
+void Failsafe_Send_Status(void)
+{
+	// <F,timeout_ms,active,trips,reaction_max_ms,wdg_resets,wdg_reset,wdg_bound_ms>
+	Link_Send_Str("<F,");
+	Link_Send_Uint(Config_Get(Cfg_Failsafe_ms));
+	Link_Send_Char(',');
+	Link_Send_Uint(tripped);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.trips);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.reaction_max_ms);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.wdg_resets);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.wdg_reset);
+	Link_Send_Char(',');
+	Link_Send_Uint(Watchdog_Bound_ms);
+	Link_Send_Str(">\r\n");
+}
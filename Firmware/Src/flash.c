@@ -0,0 +1,52 @@
+#include "main.h"
+#include "flash.h"
+#include "failsafe.h"
+
+static void Flash_Unlock(void)
+{
+	if (FLASH->CR & FLASH_CR_LOCK)
+	{
+		FLASH->KEYR = Flash_Key1;
+		FLASH->KEYR = Flash_Key2;
+	}
+}
+
+static bool Flash_Wait(void)
+{
+	const uint32_t errors = FLASH_SR_PGSERR | FLASH_SR_PGPERR | FLASH_SR_PGAERR | FLASH_SR_WRPERR | FLASH_SR_OPERR;
+
+	while (FLASH->SR & FLASH_SR_BSY) {}
+	uint32_t sr = FLASH->SR;
+	FLASH->SR = errors | FLASH_SR_EOP;		// rc_w1
+	return !(sr & errors);
+}
+
+bool Flash_Erase_Sector(uint8_t sector)
+{
+	Watchdog_Stretch(1);		// CPU stalls on flash fetches until the erase is done
+	Flash_Unlock();
+	Flash_Wait();
+	FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | ((uint32_t)sector << FLASH_CR_SNB_Pos);	// x32, sector erase
+	FLASH->CR |= FLASH_CR_STRT;
+	bool ok = Flash_Wait();
+	FLASH->CR = FLASH_CR_LOCK;
+
+	// Stale erased data may still sit in the data cache
+	FLASH->ACR &= ~FLASH_ACR_DCEN;
+	FLASH->ACR |= FLASH_ACR_DCRST;
+	FLASH->ACR &= ~FLASH_ACR_DCRST;
+	FLASH->ACR |= FLASH_ACR_DCEN;
+	Watchdog_Stretch(0);
+	return ok;
+}
+
+bool Flash_Program_Word(uint32_t addr, uint32_t data)
+{
+	Flash_Unlock();
+	Flash_Wait();
+	FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;		// x32 programming
+	Flash_Word(addr) = data;
+	bool ok = Flash_Wait();
+	FLASH->CR = FLASH_CR_LOCK;
+	return ok && Flash_Word(addr) == data;
+}
@@ -0,0 +1,326 @@
+#include "main.h"
+#include "imu.h"
+#include "trace.h"
+#include "irq_config.h"
+
+// Transfer in progress on I2C1
+typedef enum
+{
+	Bus_Idle = 0,
+	Bus_Reg,			// Address (write) + register byte
+	Bus_Data,			// Register value (writes)
+	Bus_Read			// Repeated start, address (read), DMA reception
+} Bus_Phase;
+
+#define Gyro_Bytes			6		// X, Y, Z
+#define Gyro_Max_Count		1000	// Samples accumulated without a reader: start over
+
+// Written once per IMU_Absent -> IMU_Running, in order
+static const uint8_t IMU_Setup[][2] =
+{
+	{ MPU_PWR_MGMT_1,  MPU_PWR_CLK_PLL_X },
+	{ MPU_CONFIG,      IMU_DLPF_Cfg },
+	{ MPU_SMPLRT_DIV,  IMU_Smplrt_Div },
+	{ MPU_GYRO_CONFIG, IMU_Gyro_FS << 3 },
+};
+
+static volatile Bus_Phase phase = Bus_Idle;
+static uint8_t xfer_reg;				// Register addressed by the transfer
+static uint8_t xfer_data;				// Value written (Bus_Data)
+static bool xfer_read;
+
+static IMU_State state = IMU_Absent;
+static uint16_t wait_ms = 0;			// Ticks before the next step
+static uint8_t busy_ms = 0;				// Ticks the current transfer has been running
+static uint8_t setup_step = 0;
+
+static uint8_t rx_buf[Gyro_Bytes];		// DMA1 Stream0 destination
+static int32_t gyro_sum_z = 0;			// Raw Z since the last IMU_Gyro_Take()
+static uint16_t gyro_count = 0;
+static IMU_Stats stats;
+
+static void IMU_I2C_Setup(void)
+{
+	// APB1 = SysClk, fast mode Tlow/Thigh = 2 (CCR = PCLK1 / (3 * f)), rise time 300ns
+	I2C1->CR1 = I2C_CR1_SWRST;
+	I2C1->CR1 = 0;
+	I2C1->CR2 = ((SysClk / 1000000U) << I2C_CR2_FREQ_Pos) | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+	I2C1->CCR = I2C_CCR_FS | ((SysClk + 3 * IMU_I2C_Freq - 1) / (3 * IMU_I2C_Freq));
+	I2C1->TRISE = (SysClk / 1000000U) * 300 / 1000 + 1;
+	I2C1->CR1 = I2C_CR1_PE | I2C_CR1_ACK;
+}
+
+void IMU_Init(void)
+{
+	// Enable clocks for GPIOB, DMA1 and I2C1
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_DMA1EN;
+	RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;
+
+	// PB6, PB7 as Alternate Function(AF4), open-drain with pull-ups (module has 4.7k)
+	GPIOB->MODER &= ~((3U << (IMU_SCL * 2)) | (3U << (IMU_SDA * 2)));	// 00: Clear register
+	GPIOB->MODER |=  ((2U << (IMU_SCL * 2)) | (2U << (IMU_SDA * 2)));	// 10: Alternate function
+	GPIOB->OTYPER |= (1U << IMU_SCL) | (1U << IMU_SDA);					// Open-drain
+	GPIOB->OSPEEDR |= (2U << (IMU_SCL * 2)) | (2U << (IMU_SDA * 2));		// Fast speed
+	GPIOB->PUPDR &= ~((3U << (IMU_SCL * 2)) | (3U << (IMU_SDA * 2)));
+	GPIOB->PUPDR |=  ((1U << (IMU_SCL * 2)) | (1U << (IMU_SDA * 2)));	// 01: Pull-up
+	GPIOB->AFR[0] &= ~((0xFU << (IMU_SCL * 4)) | (0xFU << (IMU_SDA * 4)));	// Clear register
+	GPIOB->AFR[0] |=  ((4U << (IMU_SCL * 4)) | (4U << (IMU_SDA * 4)));		// AF4 I2C1
+
+	// DMA1 Stream0 Channel1: I2C1->DR to rx_buf, byte, normal mode, armed per read
+	DMA1_Stream0->CR &= ~DMA_SxCR_EN;
+	while (DMA1_Stream0->CR & DMA_SxCR_EN) {}
+	DMA1->LIFCR = 0x3DU;						// Clear stream0 flags
+	DMA1_Stream0->PAR = (uint32_t)&I2C1->DR;
+	DMA1_Stream0->M0AR = (uint32_t)rx_buf;
+	DMA1_Stream0->CR = (1U << DMA_SxCR_CHSEL_Pos)	// Channel 1 = I2C1_RX
+			| DMA_SxCR_MINC							// Peripheral to memory, 8-bit
+			| DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+	IMU_I2C_Setup();
+
+	NVIC_EnableIRQ(I2C1_EV_IRQn);				// Priorities: IRQ_Config_Init()
+	NVIC_EnableIRQ(I2C1_ER_IRQn);
+	NVIC_EnableIRQ(DMA1_Stream0_IRQn);
+
+	// First probe on the first tick, the device may still be starting: retried every IMU_Probe_ms
+	state = IMU_Absent;
+	wait_ms = 0;
+}
+
+static void IMU_Bus_Reset(void)
+{
+	// A slave left holding SDA low mid-byte: clock it out on SCL as a GPIO, then restart I2C1
+	DMA1_Stream0->CR &= ~DMA_SxCR_EN;
+	I2C1->CR1 = I2C_CR1_SWRST;
+
+	GPIOB->MODER &= ~(3U << (IMU_SCL * 2));
+	GPIOB->MODER |=  (1U << (IMU_SCL * 2));		// 01: Output (open-drain)
+	for (uint8_t i = 0; i < 9; i++)
+	{
+		GPIOB->BSRR = 1U << (IMU_SCL + 16);
+		for (volatile uint8_t d = 0; d < 16; d++) {}	// ~2.5us at 25MHz
+		GPIOB->BSRR = 1U << IMU_SCL;
+		for (volatile uint8_t d = 0; d < 16; d++) {}
+	}
+	GPIOB->MODER &= ~(3U << (IMU_SCL * 2));
+	GPIOB->MODER |=  (2U << (IMU_SCL * 2));		// 10: Alternate function
+
+	IMU_I2C_Setup();
+	phase = Bus_Idle;
+}
+
+static void IMU_Lost(uint16_t sr1)
+{
+	// Device gone or bus fault: probe again, the setup is redone from the reset
+	if (state != IMU_Absent)
+	{
+		stats.errors++;
+		Trace_Log(Trace_Imu, (uint8_t)IMU_Absent, sr1);
+	}
+	state = IMU_Absent;
+	wait_ms = IMU_Probe_ms;
+	phase = Bus_Idle;
+}
+
+static void IMU_Start(uint8_t reg, bool read)
+{
+	xfer_reg = reg;
+	xfer_read = read;
+	busy_ms = 0;
+	phase = Bus_Reg;
+	I2C1->CR1 |= I2C_CR1_START;				// SB -> I2C1_EV_IRQHandler
+}
+
+static void IMU_Write(uint8_t reg, uint8_t value)
+{
+	xfer_data = value;
+	IMU_Start(reg, 0);
+}
+
+static void IMU_Read_Gyro(void)
+{
+	DMA1->LIFCR = 0x3DU;
+	DMA1_Stream0->NDTR = Gyro_Bytes;
+	DMA1_Stream0->CR |= DMA_SxCR_EN;
+	IMU_Start(MPU_GYRO_XOUT_H, 1);
+}
+
+void IMU_Tick(void)
+{
+	// Called from SysTick_Handler every ms, starts at most one transfer
+	if (phase != Bus_Idle)
+	{
+		if (++busy_ms >= IMU_Bus_Timeout_ms)
+		{
+			stats.timeouts++;
+			uint16_t sr1 = (uint16_t)I2C1->SR1;
+			IMU_Bus_Reset();
+			IMU_Lost(sr1);
+		}
+		else if (state == IMU_Running && wait_ms == 0)
+		{
+			stats.overruns++;
+		}
+		return;
+	}
+
+	if (wait_ms)
+	{
+		wait_ms--;
+		return;
+	}
+
+	switch (state)
+	{
+	case IMU_Absent:
+		IMU_Write(MPU_PWR_MGMT_1, MPU_PWR_RESET);	// An ACK is the presence check
+		break;
+
+	case IMU_Reset_Wait:
+		state = IMU_Configure;
+		setup_step = 0;
+		/* fall through */
+
+	case IMU_Configure:
+		if (setup_step < sizeof(IMU_Setup) / sizeof(IMU_Setup[0]))
+		{
+			IMU_Write(IMU_Setup[setup_step][0], IMU_Setup[setup_step][1]);
+			break;
+		}
+		state = IMU_Running;
+		Trace_Log(Trace_Imu, (uint8_t)IMU_Running, 0);
+		/* fall through */
+
+	case IMU_Running:
+		IMU_Read_Gyro();
+		wait_ms = IMU_Period_ms - 1;
+		break;
+	}
+}
+
+static void IMU_Write_Done(void)
+{
+	if (state == IMU_Absent)
+	{
+		state = IMU_Reset_Wait;
+		wait_ms = IMU_Reset_ms;
+	}
+	else if (state == IMU_Configure)
+	{
+		setup_step++;
+	}
+}
+
+void I2C1_EV_IRQHandler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_I2C1, IRQ_Latency_Unknown);
+
+	// Flags cleared by the SR1 read followed by the DR / SR2 access or START / STOP
+	uint32_t sr1 = I2C1->SR1;
+
+	if (sr1 & I2C_SR1_SB)
+	{
+		I2C1->DR = (IMU_Addr << 1) | ((phase == Bus_Read) ? 1U : 0U);
+	}
+	else if (sr1 & I2C_SR1_ADDR)
+	{
+		if (phase == Bus_Read)
+		{
+			// DMA takes the bytes, LAST NACKs the final one
+			I2C1->CR2 |= I2C_CR2_DMAEN | I2C_CR2_LAST;
+			(void)I2C1->SR2;
+		}
+		else
+		{
+			(void)I2C1->SR2;
+			I2C1->DR = xfer_reg;
+		}
+	}
+	else if (sr1 & I2C_SR1_BTF)
+	{
+		if (phase == Bus_Reg && xfer_read)
+		{
+			phase = Bus_Read;
+			I2C1->CR1 |= I2C_CR1_START;			// Repeated start
+		}
+		else if (phase == Bus_Reg)
+		{
+			phase = Bus_Data;
+			I2C1->DR = xfer_data;
+		}
+		else
+		{
+			I2C1->CR1 |= I2C_CR1_STOP;
+			phase = Bus_Idle;
+			IMU_Write_Done();
+		}
+	}
+
+	IRQ_Measure_Exit(IRQ_Slot_I2C1);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+	uint32_t sr1 = I2C1->SR1;
+	I2C1->SR1 = ~(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF | I2C_SR1_OVR | I2C_SR1_TIMEOUT);	// rc_w0
+
+	I2C1->CR1 |= I2C_CR1_STOP;
+	DMA1_Stream0->CR &= ~DMA_SxCR_EN;
+	I2C1->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+	IMU_Lost((uint16_t)sr1);
+}
+
+void DMA1_Stream0_IRQHandler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_IMU_DMA, IRQ_Latency_Unknown);
+
+	uint32_t isr = DMA1->LISR;
+	DMA1->LIFCR = 0x3DU;
+
+	I2C1->CR1 |= I2C_CR1_STOP;
+	I2C1->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+
+	if (isr & DMA_LISR_TEIF0)
+	{
+		IMU_Lost(0);
+	}
+	else if (isr & DMA_LISR_TCIF0)
+	{
+		phase = Bus_Idle;
+		stats.samples++;
+
+		int16_t z = (int16_t)((rx_buf[4] << 8) | rx_buf[5]);
+		if (gyro_count >= Gyro_Max_Count)
+		{
+			gyro_sum_z = 0;
+			gyro_count = 0;
+		}
+		gyro_sum_z += z;
+		gyro_count++;
+	}
+
+	IRQ_Measure_Exit(IRQ_Slot_IMU_DMA);
+}
+
+IMU_State IMU_Get_State(void)
+{
+	return state;
+}
+
+bool IMU_Gyro_Take(int32_t *sum_z, uint16_t *count)
+{
+	// Raw Z samples since the last call
+	// Call at IRQ_Prio_Scheduler: same level as the DMA interrupt, so no masking is needed
+	if (gyro_count == 0) return 0;
+
+	*sum_z = gyro_sum_z;
+	*count = gyro_count;
+	gyro_sum_z = 0;
+	gyro_count = 0;
+	return 1;
+}
+
+const IMU_Stats *IMU_Get_Stats(void)
+{
+	return &stats;
+}
@@ -0,0 +1,179 @@
+#include "main.h"
+#include "interp.h"
+#include "sched.h"
+#include "irq_config.h"
+#include "config.h"
+#include "yaw_ctrl.h"
+#include "drive_mix.h"
+
+// State in Q8 (steer in degrees), throttle signed: + forward, - reverse
+static int32_t cur_steer = Car_Reset_Steer_Angle << 8;
+static int32_t cur_thr = 0;
+static int32_t tgt_steer = Car_Reset_Steer_Angle << 8;
+static int32_t tgt_thr = 0;
+static int32_t step_steer = 0;		// Per frame increment
+static int32_t step_thr = 0;
+static uint16_t steps_left = 0;		// Frames until the target is reached
+static uint16_t extrap_left = 0;	// Frames of extrapolation still allowed
+
+static uint32_t rx_ms = 0;			// Last target arrival
+static uint32_t interval_ms = 100;	// Packet interval estimate
+static bool interp_on = Interp_Default;
+static bool braking = 0;			// Active brake: force passed through, not ramped
+static uint8_t brake_force = 0;
+
+static uint16_t out_steer = Car_Reset_Steer_Angle * Steer_Scale;
+static uint8_t out_thr = Car_Reset_Throttle;
+static uint8_t out_dir = Car_Reset_Direction;
+
+void Interp_Init(void)
+{
+	// Start from the stored reset steering
+	cur_steer = tgt_steer = ((int32_t)Config_Get(Cfg_Steer_Reset) << 8) / Steer_Scale;
+	out_steer = (uint16_t)Config_Get(Cfg_Steer_Reset);
+
+	// TIM2 already running from Servo_TIM2_PWM_Init, update event once per servo frame
+	TIM2->SR = ~TIM_SR_UIF;
+	TIM2->DIER |= TIM_DIER_UIE;
+	NVIC_EnableIRQ(TIM2_IRQn);		// Priority: IRQ_Config_Init()
+}
+
+void Interp_Enable(bool enable)
+{
+	interp_on = enable;
+}
+
+bool Interp_Enabled(void)
+{
+	return interp_on;
+}
+
+void Interp_Set_Target(uint16_t steer, uint8_t throttle, uint8_t dir)
+{
+	uint32_t now = Sched_Millis();
+	uint32_t gap = now - rx_ms;
+	rx_ms = now;
+
+	// Packet interval estimate, EMA 1/4
+	if (gap <= Interp_Max_Interval_ms)
+		interval_ms = (3 * interval_ms + gap) / 4;
+	if (interval_ms < Interp_Frame_ms) interval_ms = Interp_Frame_ms;
+
+	int32_t thr = (dir == 1) ? throttle : (dir == 2) ? -(int32_t)throttle : 0;
+
+	TIM2->DIER &= ~TIM_DIER_UIE;		// Frame update must see a consistent target
+
+	tgt_steer = ((int32_t)steer << 8) / Steer_Scale;
+	tgt_thr = thr << 8;
+	braking = (dir == Drive_Dir_Brake);
+	brake_force = throttle;
+
+	if (dir == 0 || braking)
+	{
+		// Stop and brake are applied on the next frame, not ramped
+		cur_thr = 0;
+	}
+
+	steps_left = (uint16_t)(interval_ms / Interp_Frame_ms);
+
+	// Throttle ramp limit (%/frame): stretch the move if the step would be larger
+	int32_t ramp = (int32_t)Config_Get(Cfg_Throttle_Ramp) << 8;
+	int32_t dthr = (tgt_thr > cur_thr) ? tgt_thr - cur_thr : cur_thr - tgt_thr;
+	if (dthr > ramp * steps_left)
+		steps_left = (uint16_t)((dthr + ramp - 1) / ramp);
+
+	step_steer = (tgt_steer - cur_steer) / steps_left;
+	step_thr = (tgt_thr - cur_thr) / steps_left;
+	extrap_left = Interp_Max_Hold_ms / Interp_Frame_ms;
+
+	TIM2->DIER |= TIM_DIER_UIE;
+}
+
+void Interp_Hold(void)
+{
+	// Last target is final (sparse keyframes, not a stream): land on it, no extrapolation
+	extrap_left = 0;
+}
+
+void Interp_Ramp_To(uint16_t steer, uint8_t throttle, uint8_t dir, uint16_t ms)
+{
+	// Move landing within ms (failsafe): no ramp limit stretch, no extrapolation, rate estimate untouched
+	int32_t thr = (dir == 1) ? throttle : (dir == 2) ? -(int32_t)throttle : 0;
+
+	TIM2->DIER &= ~TIM_DIER_UIE;
+
+	tgt_steer = ((int32_t)steer << 8) / Steer_Scale;
+	tgt_thr = thr << 8;
+	braking = (dir == Drive_Dir_Brake);
+	brake_force = throttle;
+	if (braking) cur_thr = 0;
+	steps_left = (uint16_t)(ms / Interp_Frame_ms);
+	if (steps_left == 0) steps_left = 1;
+	step_steer = (tgt_steer - cur_steer) / steps_left;
+	step_thr = (tgt_thr - cur_thr) / steps_left;
+	extrap_left = 0;
+
+	TIM2->DIER |= TIM_DIER_UIE;
+}
+
+static int32_t Clamp(int32_t v, int32_t lo, int32_t hi)
+{
+	return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+static void Interp_Frame(void)
+{
+	if (steps_left)
+	{
+		// Move toward the latest target, land on it exactly
+		if (--steps_left == 0)
+		{
+			cur_steer = tgt_steer;
+			cur_thr = tgt_thr;
+		}
+		else
+		{
+			cur_steer += step_steer;
+			cur_thr += step_thr;
+		}
+	}
+	else if (extrap_left && (Sched_Millis() - rx_ms) > interval_ms)
+	{
+		// Packet overdue: keep the last rate for a bounded time, then hold
+		extrap_left--;
+		cur_steer = Clamp(cur_steer + step_steer, 0, 180 << 8);
+		cur_thr = Clamp(cur_thr + step_thr, -(100 << 8), 100 << 8);
+	}
+
+	uint16_t steer = (uint16_t)((cur_steer * Steer_Scale + 128) >> 8);
+	int32_t thr = (cur_thr + 128) >> 8;
+	uint8_t dir = (thr > 0) ? 1 : (thr < 0) ? 2 : 0;
+	uint8_t throttle = (uint8_t)(thr < 0 ? -thr : thr);
+	if (braking)
+	{
+		dir = Drive_Dir_Brake;
+		throttle = brake_force;
+	}
+
+	if (steer != out_steer || throttle != out_thr || dir != out_dir)
+	{
+		out_steer = steer;
+		out_thr = throttle;
+		out_dir = dir;
+		Car_Control(steer, throttle, dir);
+	}
+}
+
+void TIM2_IRQHandler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_TIM2, TIM2->CNT * (TIM2->PSC + 1));	// Cycles since update
+
+	if (TIM2->SR & TIM_SR_UIF)
+	{
+		TIM2->SR = ~TIM_SR_UIF;
+		if (interp_on) Interp_Frame();
+		Yaw_Frame();					// Servo correction from the gyro
+	}
+
+	IRQ_Measure_Exit(IRQ_Slot_TIM2);
+}
@@ -0,0 +1,57 @@
+#include "main.h"
+#include "irq_config.h"
+#include "link.h"
+
+volatile IRQ_Stat irq_stats[IRQ_Slot_Count];
+
+static void IRQ_Set(IRQn_Type irq, uint32_t preempt)
+{
+	NVIC_SetPriority(irq, NVIC_EncodePriority(IRQ_Priority_Grouping, preempt, 0));
+}
+
+void IRQ_Config_Init(void)
+{
+	// Call before any module enables its interrupt
+	NVIC_SetPriorityGrouping(IRQ_Priority_Grouping);
+
+	IRQ_Set(TIM1_UP_TIM10_IRQn, IRQ_Prio_Control);	// Current limit trip release
+	IRQ_Set(ADC_IRQn,           IRQ_Prio_Control);	// PWM synchronised current limit
+	IRQ_Set(EXTI15_10_IRQn,     IRQ_Prio_Control);	// Auto-baud edge timestamps, only while hunting
+	IRQ_Set(USART1_IRQn,        IRQ_Prio_UART_RX);	// HC-05 command bytes
+	IRQ_Set(USART2_IRQn,        IRQ_Prio_UART_RX);	// Wired controller / debug bytes
+	IRQ_Set(SysTick_IRQn,       IRQ_Prio_Scheduler);	// 1ms time base
+	IRQ_Set(TIM2_IRQn,          IRQ_Prio_Scheduler);	// Servo frame interpolation, yaw control
+	IRQ_Set(I2C1_EV_IRQn,       IRQ_Prio_Scheduler);	// IMU transfer steps
+	IRQ_Set(I2C1_ER_IRQn,       IRQ_Prio_Scheduler);	// IMU bus errors
+	IRQ_Set(DMA1_Stream0_IRQn,  IRQ_Prio_Scheduler);	// IMU gyro sample complete
+	IRQ_Set(TIM3_IRQn,          IRQ_Prio_Scheduler);	// Range echo capture, gates the drive mix (its level)
+}
+
+void IRQ_Record_Latency(IRQ_Slot slot, uint32_t cycles)
+{
+	// An untimed slot only ever passes IRQ_Latency_Unknown, the largest value: it stays the max
+	irq_stats[slot].count++;
+	if (cycles > irq_stats[slot].latency_max) irq_stats[slot].latency_max = cycles;
+}
+
+void IRQ_Record_Run(IRQ_Slot slot, uint32_t cycles)
+{
+	if (cycles > irq_stats[slot].run_max) irq_stats[slot].run_max = cycles;
+}
+
+void IRQ_Send_Stats(void)
+{
+	// Reply, one line per slot: <I,slot,count,latency_max,run_max>, latency_max empty if untimed
+	for (uint8_t slot = 0; slot < IRQ_Slot_Count; slot++)
+	{
+		Link_Send_Str("<I,");
+		Link_Send_Uint(slot);
+		Link_Send_Char(',');
+		Link_Send_Uint(irq_stats[slot].count);
+		Link_Send_Char(',');
+		if (irq_stats[slot].latency_max != IRQ_Latency_Unknown) Link_Send_Uint(irq_stats[slot].latency_max);
+		Link_Send_Char(',');
+		Link_Send_Uint(irq_stats[slot].run_max);
+		Link_Send_Str(">\r\n");
+	}
+}
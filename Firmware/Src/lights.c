@@ -0,0 +1,42 @@
+#include "main.h"
+#include "lights.h"
+#include "sched.h"
+
+static Lights_Mode lights_mode = Lights_Off;
+static uint32_t blink_next = 0;
+static bool lit = 0;
+
+static void Lights_Output(bool on)
+{
+	lit = on;
+	GPIOB->BSRR = on ? (1U << Lights_Pin) : (1U << (Lights_Pin + 16));
+	GPIOC->BSRR = on ? (1U << (B_LED + 16)) : (1U << B_LED);	// LED active low
+}
+
+void Lights_Init(void)
+{
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN;
+	GPIOB->MODER &= ~(3U << (Lights_Pin * 2));
+	GPIOB->MODER |=  (1U << (Lights_Pin * 2));		// 01: Output mode, push-pull
+	GPIOC->MODER &= ~(3U << (B_LED * 2));
+	GPIOC->MODER |=  (1U << (B_LED * 2));
+	Lights_Output(0);
+}
+
+void Lights_Set(Lights_Mode mode)
+{
+	lights_mode = mode;
+	blink_next = Sched_Millis();
+	Lights_Output(mode != Lights_Off);
+}
+
+Lights_Mode Lights_Get(void)
+{
+	return lights_mode;
+}
+
+void Lights_Poll(void)
+{
+	if (lights_mode == Lights_Blink && Sched_Every(&blink_next, Lights_Blink_ms))
+		Lights_Output(!lit);
+}
@@ -0,0 +1,909 @@
+#include "main.h"
+#include "link.h"
+#include "trace.h"
+#include "irq_config.h"
+#include "setpoint.h"
+#include "config.h"
+#include "boot.h"
+#include "autobaud.h"
+#include "sched.h"
+#include "yaw_ctrl.h"
+#include "maneuver.h"
+#include "failsafe.h"
+#include "drive_mix.h"
+#include "lights.h"
+#include "power_monitor.h"
+#include "update.h"
+#include "range.h"
+#include "curves.h"
+#include <string.h>
+
+// ----------------------------------------------------
+// Command registry: one const entry per command letter, fields checked as the bytes arrive
+// ----------------------------------------------------
+
+typedef enum
+{
+	Link_Field_Uint = 0,	// Decimal digits, min..max
+	Link_Field_Steer,		// Degrees with up to two decimals, stored in 0.01 degree, min..max
+	Link_Field_Char			// One letter out of set
+} Link_Field_Type;
+
+typedef struct
+{
+	uint8_t type;			// Link_Field_Type
+	uint32_t min, max;
+	const char *set;		// Link_Field_Char: accepted letters
+} Link_Field;
+
+typedef struct
+{
+	Link_Port_Id port;		// Port the frame came in on
+	uint8_t argc;			// Fields present
+	const uint32_t *arg;	// Validated fields (Link_Field_Char: the letter)
+} Link_Args;
+
+typedef enum
+{
+	Link_Done = 0,			// Handled, any reply queued
+	Link_Control,			// Control packet ready for Car_Loop()
+	Link_Rejected			// Refused: <X,E> queued unless the command is quiet
+} Link_Result;
+
+#define Link_Cmd_Control	0x01U	// Drives the car: arbitrated before the handler runs
+#define Link_Cmd_Quiet		0x02U	// No error reply (streamed control frames)
+
+typedef struct
+{
+	Link_Result (*handler)(const Link_Args *a);
+	uint8_t min_args, max_args;
+	uint8_t flags;
+	Link_Field field[Link_Max_Fields];
+} Link_Command;
+
+#define Link_Cmd_Index(c)	((uint8_t)((c) - 'A'))
+#define Link_Cmd_Count		26
+
+typedef struct
+{
+	// Byte stream: entry = byte | (USART SR error bits << 8)
+	bool (*rx_pop)(uint16_t *entry);
+	bool (*tx_try)(char c);
+	uint32_t (*rx_overflow)(void);
+
+	uint8_t priority;			// Link_Prio_*
+	Link_Role role;
+	bool autobaud;				// Feed errors / good frames to the auto-baud hunt
+
+	// Parser state: no frame buffer, each field is converted and range checked as it arrives
+	const Link_Command *cmd;	// Set by the command letter
+	char letter;
+	uint8_t index;				// Frame bytes after '<' (after the address)
+	bool in_frame;
+	bool bad;					// Schema violation, rest of the frame ignored
+	uint8_t argc;				// Fields started
+	uint8_t digits;				// In the current field
+	uint8_t frac;				// Steer decimals, Link_No_Point before the '.'
+	uint32_t acc;
+	uint32_t arg[Link_Max_Fields];
+
+	// Addressing: <@id,...> prefix, binary frames
+	uint8_t addr_state;			// Link_Addr_*
+	uint16_t addr;				// ID digits so far
+	bool broadcast;				// Frame for every car: no reply
+	uint8_t bin[Link_Bin_Size];
+	uint8_t bin_index;			// Binary frame bytes received, 0 outside one
+	bool bin_skip;				// ... addressed to another car
+
+	// Reply queue, drained by Link_Tx_Poll()
+	char tx[Link_Tx_Size];
+	uint16_t tx_head;
+	uint16_t tx_tail;
+
+	UART_Link_Stats stats;
+	uint32_t bytes_last;
+	uint32_t frames_last;
+} Link_Port;
+
+#define Link_No_Point		0xFFU
+
+static Link_Port ports[Link_Port_Count] =
+{
+	[Link_HC05]  = { UART1_Rx_Pop, UART1_Try_Send_Char, UART1_Rx_Overflow, Link_Prio_HC05, Link_Role_Control, 1 },
+	[Link_Wired] = { UART2_Rx_Pop, UART2_Try_Send_Char, UART2_Rx_Overflow, Link_Prio_Wired, Link_Role_Off, 0 },
+};
+
+// Text frame addressing state
+enum
+{
+	Link_Addr_None = 0,		// No prefix (yet), frame parsed
+	Link_Addr_Id,			// After <@, reading the ID digits
+	Link_Addr_Skip			// Another car's frame: bytes dropped until '>'
+};
+
+static Link_Port *reply = &ports[Link_HC05];			// Port replies are sent to
+static bool reply_mute = 0;								// Broadcast frame: nothing is sent
+static Link_Port *stream = 0;							// Port a streamed reply (<D>) is going out on
+static Link_Port_Id control_src = Link_HC05;			// Last accepted control source
+static uint32_t control_ms = 0;							// ... and when
+
+static uint16_t pkt_steer;								// Control packet from the <S> handler
+static uint8_t pkt_throttle, pkt_dir;
+
+static uint32_t cmd_count[Link_Cmd_Count];				// Frames handled per command (<X>)
+static uint32_t cmd_errors[Link_Cmd_Count];				// ... malformed or refused
+
+static uint32_t tele_period = 0;						// <R> telemetry, 0 off
+static uint32_t tele_next = 0;
+static Link_Port_Id tele_port = Link_HC05;
+
+void Link_Init(Link_Role wired_role)
+{
+	// USART1 is always the HC-05 command link, USART2 optional
+	ports[Link_Wired].role = wired_role;
+	if (wired_role != Link_Role_Off)
+		UART2_Init();
+}
+
+void Link_Set_Source(Link_Port_Id port, bool (*rx_pop)(uint16_t *entry))
+{
+	// Replace a port's byte source (benchmark build: canned frames into the parser)
+	ports[port].rx_pop = rx_pop;
+}
+
+static bool Link_For_Us(uint16_t addr)
+{
+	return addr == Link_Broadcast_Id || addr == Config_Get(Cfg_Car_Id);
+}
+
+uint8_t Link_Crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--)
+	{
+		crc ^= *data++;
+		for (uint8_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80U) ? (uint8_t)((crc << 1) ^ Link_Crc8_Poly) : (uint8_t)(crc << 1);
+	}
+	return crc;
+}
+
+static bool Link_Arbitrate(Link_Port_Id id)
+{
+	// A higher priority source keeps control while it keeps sending
+	Link_Port *p = &ports[id];
+	uint32_t now = Sched_Millis();
+
+	if (p->role != Link_Role_Control) return 0;
+
+	if (id != control_src && p->priority > ports[control_src].priority
+			&& (now - control_ms) < Link_Source_Timeout_ms)
+	{
+		p->stats.preempted++;
+		return 0;
+	}
+
+	control_src = id;
+	control_ms = now;
+	Failsafe_Feed();			// Valid control frame: link fresh
+	return 1;
+}
+
+// ----------------------------------------------------
+// Command handlers
+// ----------------------------------------------------
+
+static Link_Result Cmd_Steer(const Link_Args *a)
+{
+	// <S,steer,throttle,direction>
+	pkt_steer = (uint16_t)a->arg[0];
+	pkt_throttle = (uint8_t)a->arg[1];
+	pkt_dir = (uint8_t)a->arg[2];
+	return Link_Control;
+}
+
+static Link_Result Cmd_Timed(const Link_Args *a)
+{
+	// <T,time_ms,steer,throttle,direction>, queued, see setpoint.h
+	Setpoint_Queue_Push(a->arg[0], (uint16_t)a->arg[1], (uint8_t)a->arg[2], (uint8_t)a->arg[3]);
+	return Link_Done;
+}
+
+static Link_Result Cmd_Config(const Link_Args *a)
+{
+	// <C> list, <C,key> get, <C,key,value> set
+	if (a->argc == 0)
+	{
+		for (uint8_t key = 0; key < Cfg_Count; key++)
+			Config_Send((Config_Key)key);
+		return Link_Done;
+	}
+
+	if (a->argc == 2)
+	{
+		// Sets change how the car drives (and write flash): control ports only, as <O,profile>
+		if (!Link_Arbitrate(a->port)) return Link_Rejected;
+		if (!Config_Set((Config_Key)a->arg[0], a->arg[1])) return Link_Rejected;	// Out of range or flash error
+	}
+
+	Config_Send((Config_Key)a->arg[0]);	// Get, or echo of the stored value
+	return Link_Done;
+}
+
+static Link_Result Cmd_Maneuver(const Link_Args *a)
+{
+	// <M> status, <M,R> record, <M,S> stop, <M,P[,source]> play, <M,W> save, see maneuver.h
+	bool ok = 1;
+
+	if (a->argc == 0) ok = 1;							// Status only
+	else if (!Link_Arbitrate(a->port)) ok = 0;			// Drives the car: control ports only
+	else if (a->arg[0] == 'R') Maneuver_Record_Start();
+	else if (a->arg[0] == 'S') Maneuver_Stop();
+	else if (a->arg[0] == 'P') ok = Maneuver_Play((Maneuver_Source)(a->argc > 1 ? a->arg[1] : Maneuver_Src_RAM));
+	else ok = Maneuver_Save();
+
+	if (!ok) return Link_Rejected;
+	Maneuver_Send_Status();
+	return Link_Done;
+}
+
+static Link_Result Cmd_Mode(const Link_Args *a)
+{
+	// <O> get, <O,profile> switch the drive profile until the next boot (key 5 keeps it)
+	if (a->argc)
+	{
+		if (!Link_Arbitrate(a->port)) return Link_Rejected;
+		Drive_Mix_SetProfile((Drive_Profile)a->arg[0]);
+	}
+
+	Link_Send_Str("<O,");
+	Link_Send_Uint(Drive_Mix_GetProfile());
+	Link_Send_Str(">\r\n");
+	return Link_Done;
+}
+
+static Link_Result Cmd_Curve(const Link_Args *a)
+{
+	// <V> get, <V,curve> swap the response curve until the next boot (key 13 keeps it), no flash write
+	if (a->argc)
+	{
+		if (!Link_Arbitrate(a->port)) return Link_Rejected;
+		Curve_Select((Curve_Id)a->arg[0]);
+	}
+
+	Link_Send_Str("<V,");
+	Link_Send_Uint(Curve_Get());
+	Link_Send_Str(">\r\n");
+	return Link_Done;
+}
+
+static Link_Result Cmd_Lights(const Link_Args *a)
+{
+	// <H> get, <H,mode> 0 off, 1 on, 2 blink
+	if (a->argc) Lights_Set((Lights_Mode)a->arg[0]);
+
+	Link_Send_Str("<H,");
+	Link_Send_Uint(Lights_Get());
+	Link_Send_Str(">\r\n");
+	return Link_Done;
+}
+
+static Link_Result Cmd_Telemetry(const Link_Args *a)
+{
+	// <R> get, <R,period_ms> stream telemetry to this port, 0 off
+	if (a->argc)
+	{
+		uint32_t period = a->arg[0];
+		if (period && (period < Link_Telemetry_Min_ms || reply_mute))
+			return Link_Rejected;	// Too fast, or every car at once on a shared link
+
+		tele_period = period;
+		tele_port = a->port;
+		tele_next = Sched_Millis();
+	}
+
+	Link_Send_Str("<R,");
+	Link_Send_Uint(tele_period);
+	Link_Send_Str(">\r\n");
+	return Link_Done;
+}
+
+static Link_Result Cmd_Ping(const Link_Args *a)
+{
+	// <P[,token]> -> <P,token,uptime_ms>: round trip time on the host
+	Link_Send_Str("<P,");
+	Link_Send_Uint(a->argc ? a->arg[0] : 0);
+	Link_Send_Char(',');
+	Link_Send_Uint(Sched_Millis());
+	Link_Send_Str(">\r\n");
+	return Link_Done;
+}
+
+static Link_Result Cmd_Stats(const Link_Args *a);
+
+static Link_Result Cmd_Dump(const Link_Args *a)
+{
+	(void)a;
+	return Trace_Send_Dump() ? Link_Done : Link_Rejected;	// Stream the flight recorder
+}
+
+static Link_Result Cmd_Irq(const Link_Args *a)
+{
+	(void)a;
+	IRQ_Send_Stats();				// Interrupt latency / run time
+	return Link_Done;
+}
+
+static Link_Result Cmd_Boot(const Link_Args *a)
+{
+	(void)a;
+	Boot_Send_Times();				// Reset to PWM / UART ready
+	return Link_Done;
+}
+
+static Link_Result Cmd_Yaw(const Link_Args *a)
+{
+	(void)a;
+	Yaw_Send_Status();				// Gyro rate, requested rate, servo correction
+	return Link_Done;
+}
+
+static Link_Result Cmd_Failsafe(const Link_Args *a)
+{
+	(void)a;
+	Failsafe_Send_Status();			// Link-loss trips, watchdog resets, reaction times
+	return Link_Done;
+}
+
+static Link_Result Cmd_Range(const Link_Args *a)
+{
+	(void)a;
+	Range_Send_Status();			// Range, time to collision, interventions, reaction latency
+	return Link_Done;
+}
+
+static Link_Result Cmd_Link(const Link_Args *a)
+{
+	(void)a;
+	Link_Send_Stats();
+	return Link_Done;
+}
+
+static Link_Result Cmd_Update(const Link_Args *a)
+{
+	// <U> running slot, <U,baud> reset into the bootloader on USART1 (0: current rate), car stopped only
+	if (a->argc == 0)
+	{
+		Update_Send_Status();
+		return Link_Done;
+	}
+
+	uint32_t baud = a->arg[0];
+	if (a->port != Link_HC05 || Drive_Mix_Driving() || (baud && baud < Update_Min_Baud))
+		return Link_Rejected;
+
+	Link_Send_Str("<U,B>\r\n");
+	Update_Enter(baud);				// Does not return
+	return Link_Done;
+}
+
+#define Field_Uint(lo, hi)	{ Link_Field_Uint, (lo), (hi), NULL }
+#define Field_Steer			{ Link_Field_Steer, 0, 180 * Steer_Scale, NULL }
+#define Field_Char(s)		{ Link_Field_Char, 0, 0, (s) }
+
+static const Link_Command commands[Link_Cmd_Count] =
+{
+	//                           handler         args  flags
+	[Link_Cmd_Index('A')] = { Cmd_Range,     0, 0, 0 },
+	[Link_Cmd_Index('B')] = { Cmd_Boot,      0, 0, 0 },
+	[Link_Cmd_Index('C')] = { Cmd_Config,    0, 2, 0, { Field_Uint(0, Cfg_Count - 1), Field_Uint(0, 0xFFFFFFFFU) } },
+	[Link_Cmd_Index('D')] = { Cmd_Dump,      0, 0, 0 },
+	[Link_Cmd_Index('F')] = { Cmd_Failsafe,  0, 0, 0 },
+	[Link_Cmd_Index('H')] = { Cmd_Lights,    0, 1, 0, { Field_Uint(0, Lights_Mode_Count - 1) } },
+	[Link_Cmd_Index('I')] = { Cmd_Irq,       0, 0, 0 },
+	[Link_Cmd_Index('L')] = { Cmd_Link,      0, 0, 0 },
+	[Link_Cmd_Index('M')] = { Cmd_Maneuver,  0, 2, 0, { Field_Char("RSPW"), Field_Uint(0, Maneuver_Src_Count - 1) } },
+	[Link_Cmd_Index('O')] = { Cmd_Mode,      0, 1, 0, { Field_Uint(0, Drive_4WD) } },
+	[Link_Cmd_Index('P')] = { Cmd_Ping,      0, 1, 0, { Field_Uint(0, 0xFFFFFFFFU) } },
+	[Link_Cmd_Index('R')] = { Cmd_Telemetry, 0, 1, 0, { Field_Uint(0, 10000) } },
+	[Link_Cmd_Index('S')] = { Cmd_Steer,     3, 3, Link_Cmd_Control | Link_Cmd_Quiet,
+			{ Field_Steer, Field_Uint(0, 100), Field_Uint(0, Drive_Dir_Brake) } },
+	[Link_Cmd_Index('T')] = { Cmd_Timed,     4, 4, Link_Cmd_Control | Link_Cmd_Quiet,
+			{ Field_Uint(0, 0xFFFFFFFFU), Field_Steer, Field_Uint(0, 100), Field_Uint(0, Drive_Dir_Brake) } },
+	[Link_Cmd_Index('U')] = { Cmd_Update,    0, 1, 0, { Field_Uint(0, Update_Max_Baud) } },
+	[Link_Cmd_Index('V')] = { Cmd_Curve,     0, 1, 0, { Field_Uint(0, Curve_Count - 1) } },
+	[Link_Cmd_Index('X')] = { Cmd_Stats,     0, 0, 0 },
+	[Link_Cmd_Index('Y')] = { Cmd_Yaw,       0, 0, 0 },
+};
+
+static Link_Result Cmd_Stats(const Link_Args *a)
+{
+	// <X,letter,handled,errors> per registered command
+	(void)a;
+	for (uint8_t n = 0; n < Link_Cmd_Count; n++)
+	{
+		if (commands[n].handler == NULL) continue;
+		Link_Send_Str("<X,");
+		Link_Send_Char((char)('A' + n));
+		Link_Send_Char(',');
+		Link_Send_Uint(cmd_count[n]);
+		Link_Send_Char(',');
+		Link_Send_Uint(cmd_errors[n]);
+		Link_Send_Str(">\r\n");
+	}
+	return Link_Done;
+}
+
+// ----------------------------------------------------
+// Parser
+// ----------------------------------------------------
+
+static bool Field_Char_In(Link_Port *p, char c)
+{
+	// One byte of the current field, false: violates the schema
+	const Link_Field *f = &p->cmd->field[p->argc - 1];
+
+	if (f->type == Link_Field_Char)
+	{
+		if (p->digits++ || c == '\0' || strchr(f->set, c) == NULL) return 0;
+		p->acc = (uint8_t)c;
+		return 1;
+	}
+
+	if (c == '.' && f->type == Link_Field_Steer && p->frac == Link_No_Point && p->digits)
+	{
+		p->frac = 0;
+		return 1;
+	}
+
+	if (c < '0' || c > '9') return 0;
+	if (p->frac != Link_No_Point && ++p->frac > 2) return 0;	// 0.01 degree at most
+
+	uint64_t v = (uint64_t)p->acc * 10U + (uint32_t)(c - '0');
+	if (v > f->max) return 0;		// Steer: compared unscaled, never above the scaled value
+	p->acc = (uint32_t)v;
+	p->digits++;
+	return 1;
+}
+
+static bool Field_End(Link_Port *p)
+{
+	// ',' or '>' after a field: scale, range check and store it
+	const Link_Field *f = &p->cmd->field[p->argc - 1];
+
+	if (p->digits == 0 || (p->frac != Link_No_Point && p->frac == 0)) return 0;	// Empty, or "45."
+
+	if (f->type == Link_Field_Steer)
+	{
+		uint8_t frac = (p->frac == Link_No_Point) ? 0 : p->frac;
+		uint32_t scale = (frac == 0) ? Steer_Scale : (frac == 1) ? Steer_Scale / 10 : 1;
+		uint64_t v = (uint64_t)p->acc * scale;
+		if (v > f->max) return 0;
+		p->acc = (uint32_t)v;
+	}
+
+	if (f->type != Link_Field_Char && p->acc < f->min) return 0;
+	p->arg[p->argc - 1] = p->acc;
+	return 1;
+}
+
+static bool Link_Args_Valid(const Link_Command *cmd, uint8_t argc, const uint32_t *arg)
+{
+	// Fields that did not come through the text parser (binary frames)
+	for (uint8_t n = 0; n < argc; n++)
+	{
+		const Link_Field *f = &cmd->field[n];
+		if (f->type == Link_Field_Char || arg[n] < f->min || arg[n] > f->max) return 0;
+	}
+	return 1;
+}
+
+static bool Frame_Byte(Link_Port *p, char c)
+{
+	// One byte between '<' and '>' (address already taken off), false: violates the schema
+	if (p->index == 0)
+	{
+		// Command letter: the table slot, O(1)
+		if (c < 'A' || c > 'Z' || commands[Link_Cmd_Index(c)].handler == NULL) return 0;
+		p->cmd = &commands[Link_Cmd_Index(c)];
+		p->argc = 0;
+		return 1;
+	}
+
+	if (c == ',')
+	{
+		if (p->argc && !Field_End(p)) return 0;
+		if (p->argc == p->cmd->max_args) return 0;		// Too many fields
+		p->argc++;
+		p->digits = 0;
+		p->frac = Link_No_Point;
+		p->acc = 0;
+		return 1;
+	}
+
+	if (p->argc == 0) return 0;						// Letter must be followed by ',' or '>'
+	return Field_Char_In(p, c);
+}
+
+static bool Frame_End(Link_Port *p)
+{
+	if (p->index == 0) return 0;					// "<>"
+	if (p->argc && !Field_End(p)) return 0;
+	return p->argc >= p->cmd->min_args;
+}
+
+static void Link_Send_Error(char letter)
+{
+	Link_Send_Char('<');
+	Link_Send_Char(letter);
+	Link_Send_Str(",E>\r\n");
+}
+
+static bool Link_Dispatch(Link_Port_Id id, const Link_Command *cmd, char letter, uint8_t argc, const uint32_t *arg)
+{
+	// Validated frame to its handler, true: control packet in pkt_*
+	uint8_t n = Link_Cmd_Index(letter);
+	Link_Args a = { id, argc, arg };
+
+	cmd_count[n]++;
+	if ((cmd->flags & Link_Cmd_Control) && !Link_Arbitrate(id)) return 0;	// Lost to a higher priority port
+
+	Link_Result r = cmd->handler(&a);
+	if (r == Link_Rejected)
+	{
+		cmd_errors[n]++;
+		if (!(cmd->flags & Link_Cmd_Quiet)) Link_Send_Error(letter);
+	}
+	if (id == Link_HC05) Update_Confirm();		// A new image reached its host: keep it
+	return r == Link_Control;
+}
+
+static bool Link_Poll_Port(Link_Port_Id id, uint16_t *steer, uint8_t *throttle, uint8_t *dir)
+{
+	// Text frames: <letter[,field]...>, commands and their fields in commands[]
+	// Addressed: <@3,S,45,0,0>, any frame, <@0,...> for every car (not answered)
+	// Binary: A5 id steer_lo steer_hi throttle dir crc8, see link.h
+	Link_Port *p = &ports[id];
+	bool control = 0;
+
+	uint16_t entry;
+	while (!control && p->rx_pop(&entry))      // Check data available, stop at a control packet
+	{
+		char c = (char)(entry & 0xFF);
+		uint32_t sr = entry >> 8;		// ORE/NE/FE/PE latched by the ISR
+
+		if (sr & (USART_SR_ORE | USART_SR_NE | USART_SR_FE | USART_SR_PE)) {
+			if (sr & USART_SR_ORE) p->stats.overrun++;
+			if (sr & USART_SR_NE)  p->stats.noise++;
+			if (sr & USART_SR_FE)  p->stats.framing++;
+			if (sr & USART_SR_PE)  p->stats.parity++;
+			if (p->autobaud && (sr & (USART_SR_FE | USART_SR_NE))) Autobaud_Rx_Error();	// Baud mismatch looks like this
+			Trace_Log(Trace_Uart_Error, (uint8_t)p->in_frame, (uint16_t)sr);
+
+			if (p->in_frame || p->bin_index) p->stats.frames_dropped++;
+			p->in_frame = 0;			// Drop the frame, resync on the next '<'
+			p->bin_index = 0;
+			continue;
+		}
+
+		p->stats.bytes++;
+
+		if (p->bin_index) {
+			// Binary frame: fixed length, the ID byte decides whether the rest is looked at
+			p->bin[p->bin_index++] = (uint8_t)c;
+			if (p->bin_index == 2 && !Link_For_Us((uint8_t)c)) {
+				p->bin_skip = 1;
+				p->stats.foreign++;
+			}
+			if (p->bin_index < Link_Bin_Size) continue;
+
+			p->bin_index = 0;
+			if (p->bin_skip) continue;
+
+			// Same command as <S,steer,throttle,direction>, same field limits
+			const Link_Command *cmd = &commands[Link_Cmd_Index('S')];
+			const uint32_t arg[3] = { (uint32_t)(p->bin[2] | (p->bin[3] << 8)), p->bin[4], p->bin[5] };
+
+			if (Link_Crc8(p->bin + 1, Link_Bin_Size - 2) != p->bin[Link_Bin_Size - 1] || !Link_Args_Valid(cmd, 3, arg)) {
+				Trace_Log(Trace_Parse_Error, Link_Bin_Start, Link_Bin_Size);
+				p->stats.frames_dropped++;
+				continue;
+			}
+
+			Trace_Log(Trace_Packet_Rx, Link_Bin_Start, Link_Bin_Size);
+			if (p->autobaud) Autobaud_Frame_Ok();
+			p->stats.frames++;
+
+			reply = p;
+			reply_mute = 1;				// Never answered
+			control = Link_Dispatch(id, cmd, 'S', 3, arg);
+			continue;
+		}
+
+		if (c == '<') {
+			if (p->in_frame) p->stats.frames_dropped++;	// Previous frame never closed
+			p->index = 0;
+			p->in_frame = 1;
+			p->bad = 0;
+			p->addr_state = Link_Addr_None;
+			p->broadcast = 0;
+		}
+		else if (!p->in_frame) {
+			// Noise between frames, wait for '<' (or a binary frame start)
+			if ((uint8_t)c == Link_Bin_Start) {
+				p->bin[0] = (uint8_t)c;
+				p->bin_index = 1;
+				p->bin_skip = 0;
+			}
+		}
+		else if (p->addr_state == Link_Addr_Skip) {
+			if (c == '>') p->in_frame = 0;		// Another car's frame: nothing parsed
+		}
+		else if (p->addr_state == Link_Addr_Id) {
+			if (c >= '0' && c <= '9' && p->addr <= Link_Id_Max) {
+				p->addr = (uint16_t)(p->addr * 10 + (c - '0'));
+				p->index++;						// Digits, no command byte yet
+			}
+			else if (c == ',' && p->index && Link_For_Us(p->addr)) {
+				p->addr_state = Link_Addr_None;	// Ours: the command follows as an unaddressed frame
+				p->broadcast = (p->addr == Link_Broadcast_Id);
+				p->index = 0;
+			}
+			else if ((c == ',' && p->index) || (c >= '0' && c <= '9')) {
+				p->addr_state = Link_Addr_Skip;
+				p->stats.foreign++;
+			}
+			else {
+				Trace_Log(Trace_Parse_Error, '@', p->index);
+				p->stats.frames_dropped++;
+				p->in_frame = 0;
+			}
+		}
+		else if (c == '@' && p->index == 0) {
+			p->addr_state = Link_Addr_Id;
+			p->addr = 0;
+		}
+		else if (c == '>') {
+			p->in_frame = 0;
+
+			if (p->bad || !Frame_End(p)) {
+				Trace_Log(Trace_Parse_Error, (uint8_t)p->letter, p->index);
+				p->stats.frames_dropped++;
+				if (p->index && p->cmd) {
+					// Known command, fields off its schema: <letter,E>
+					cmd_errors[Link_Cmd_Index(p->letter)]++;
+					reply = p;
+					reply_mute = p->broadcast;
+					if (!(p->cmd->flags & Link_Cmd_Quiet)) Link_Send_Error(p->letter);
+				}
+				continue;
+			}
+
+			Trace_Log(Trace_Packet_Rx, (uint8_t)p->letter, p->index);
+			if (p->autobaud) Autobaud_Frame_Ok();	// Clean frame of a known command: the baud rate is right
+			p->stats.frames++;
+
+			reply = p;					// Answer on the port that asked
+			reply_mute = p->broadcast;	// ... unless every car was asked
+			control = Link_Dispatch(id, p->cmd, p->letter, p->argc, p->arg);
+		}
+		else if (p->index < Link_Frame_Size - 1) {
+			if (!p->bad && !Frame_Byte(p, c)) {
+				p->bad = 1;				// Rest of the frame ignored, dropped at '>'
+				if (p->index == 0) p->cmd = NULL;
+			}
+			if (p->index == 0) p->letter = c;
+			p->index++;
+		}
+		else {
+			// Frame longer than any command, resync
+			Trace_Log(Trace_Parse_Error, (uint8_t)p->letter, p->index);
+			p->stats.frames_dropped++;
+			p->in_frame = 0;
+		}
+	}
+
+	if (control)
+	{
+		*steer = pkt_steer;
+		*throttle = pkt_throttle;
+		*dir = pkt_dir;
+	}
+	return control;
+}
+
+bool Link_Receive_Packet(uint16_t *steer, uint8_t *throttle, uint8_t *dir)
+{
+	// Poll every port, first accepted control packet wins this pass
+	for (uint8_t id = 0; id < Link_Port_Count; id++)
+	{
+		if (ports[id].role == Link_Role_Off) continue;
+		if (Link_Poll_Port((Link_Port_Id)id, steer, throttle, dir))
+		{
+			reply = &ports[Link_HC05];
+			reply_mute = 0;
+			return 1;
+		}
+	}
+
+	reply = &ports[Link_HC05];
+	reply_mute = 0;
+	return 0;
+}
+
+void Link_Telemetry_Poll(void)
+{
+	// <R,ms,steer,throttle,dir,batt_mV,motor_mA,throttle_limit,failsafe> every tele_period
+	if (tele_period == 0 || !Sched_Every(&tele_next, tele_period)) return;
+
+	uint16_t steer;
+	uint8_t throttle, dir;
+	Car_Output(&steer, &throttle, &dir);
+
+	reply = &ports[tele_port];
+	Link_Send_Str("<R,");
+	Link_Send_Uint(Sched_Millis());
+	Link_Send_Char(',');
+	Link_Send_Uint(steer);
+	Link_Send_Char(',');
+	Link_Send_Uint(throttle);
+	Link_Send_Char(',');
+	Link_Send_Uint(dir);
+	Link_Send_Char(',');
+	Link_Send_Uint(Power_Battery_mV());
+	Link_Send_Char(',');
+	Link_Send_Uint(Power_Motor_mA());
+	Link_Send_Char(',');
+	Link_Send_Uint(Power_Throttle_Limit());
+	Link_Send_Char(',');
+	Link_Send_Uint(Failsafe_Active());
+	Link_Send_Str(">\r\n");
+	reply = &ports[Link_HC05];
+}
+
+Link_Port_Id Link_Control_Source(void)
+{
+	return control_src;
+}
+
+void Link_Stats_Update(void)
+{
+	// Call once per second: rates are the counter deltas since the last call
+	for (uint8_t id = 0; id < Link_Port_Count; id++)
+	{
+		Link_Port *p = &ports[id];
+		p->stats.ring_overflow = p->rx_overflow();
+		p->stats.bytes_per_s = p->stats.bytes - p->bytes_last;
+		p->stats.frames_per_s = p->stats.frames - p->frames_last;
+		p->bytes_last = p->stats.bytes;
+		p->frames_last = p->stats.frames;
+	}
+}
+
+const UART_Link_Stats *Link_Stats(Link_Port_Id port)
+{
+	return &ports[port].stats;
+}
+
+void Link_Send_Stats(void)
+{
+	// Reply, for the asking port: <L,overrun,noise,framing,parity,dropped,bytes/s,frames/s,ring_overflow,preempted,foreign>
+	const UART_Link_Stats *s = &reply->stats;
+	const uint32_t fields[] = {
+		s->overrun, s->noise, s->framing, s->parity,
+		s->frames_dropped, s->bytes_per_s, s->frames_per_s,
+		reply->rx_overflow(), s->preempted, s->foreign
+	};
+
+	Link_Send_Str("<L");
+	for (uint8_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+	{
+		Link_Send_Char(',');
+		Link_Send_Uint(fields[i]);
+	}
+	Link_Send_Str(">\r\n");
+}
+
+static bool Link_Tx_Port(Link_Port *p)
+{
+	// Queued reply bytes into the USART while it takes them, true: queue empty
+	while (p->tx_tail != p->tx_head)
+	{
+		if (!p->tx_try(p->tx[p->tx_tail])) return 0;
+		p->tx_tail = (p->tx_tail + 1) & (Link_Tx_Size - 1);
+	}
+	return 1;
+}
+
+void Link_Tx_Poll(void)
+{
+	// Car_Loop(): never waits, a long reply (<D>, <C>) goes out over several passes
+	Trace_Dump_Poll();
+	for (uint8_t id = 0; id < Link_Port_Count; id++)
+		Link_Tx_Port(&ports[id]);
+}
+
+void Link_Flush(void)
+{
+	// Everything queued on the wire (benchmark report, before a reset)
+	for (uint8_t id = 0; id < Link_Port_Count; id++)
+		while (!Link_Tx_Port(&ports[id])) {}
+}
+
+bool Link_Stream_Open(void)
+{
+	// Reply port handed to a streamed reply, one at a time, refused for a broadcast frame
+	if (reply_mute || stream) return 0;
+	stream = reply;
+	return 1;
+}
+
+bool Link_Stream_Write(const uint8_t *data, uint8_t len)
+{
+	// Whole chunk queued or nothing, never waits: retry on a later Link_Tx_Poll()
+	uint16_t room = (stream->tx_tail - stream->tx_head - 1) & (Link_Tx_Size - 1);
+	if (room < len) return 0;
+
+	for (uint8_t i = 0; i < len; i++)
+	{
+		stream->tx[stream->tx_head] = (char)data[i];
+		stream->tx_head = (stream->tx_head + 1) & (Link_Tx_Size - 1);
+	}
+	return 1;
+}
+
+void Link_Stream_Close(void)
+{
+	stream = 0;
+}
+
+void Link_Send_Char(char c)
+{
+	if (reply_mute) return;
+	if (reply == stream) return;	// Would land inside the streamed reply
+
+	uint16_t next = (reply->tx_head + 1) & (Link_Tx_Size - 1);
+	while (next == reply->tx_tail)
+		Link_Tx_Port(reply);		// Queue full: wait for the USART, as the blocking send did
+
+	reply->tx[reply->tx_head] = c;
+	reply->tx_head = next;
+}
+
+void Link_Send_Str(const char *str)
+{
+	while (*str)
+	{
+		Link_Send_Char(*str++);
+	}
+}
+
+void Link_Send_Int(int32_t value)
+{
+	if (value < 0)
+	{
+		Link_Send_Char('-');
+		Link_Send_Uint((uint32_t)-(int64_t)value);
+	}
+	else
+	{
+		Link_Send_Uint((uint32_t)value);
+	}
+}
+
+void Link_Send_Uint(uint32_t value)
+{
+	char digits[10];
+	uint8_t n = 0;
+
+	do {
+		digits[n++] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value);
+
+	while (n)
+	{
+		Link_Send_Char(digits[--n]);
+	}
+}
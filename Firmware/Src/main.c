@@ -1,93 +1,133 @@
-#include "stm32f4xx.h"
-#include <stdint.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdbool.h>
-
-#define SysClk 25000000U 	// 25MHz HSE system clock frequency
-
-#define B_LED 13U 			// PC13 Built-in LED
-#define Btn 0U 				// PA0 push-btn active low
-
-#define Motor 8U			// PA8 Tim1Ch1 PWM
-#define Servo 15U 			// PA15 Tim2Ch1 PWM
-
-#define Motor_PWM_Freq 1000	// 1KHz motor PWM frequency
-#define Servo_PWM_Freq 50	// 50Hz servo control frequency
-
-#define Tx1	9				// PA9 Tx UART1
-#define Rx1 10				// PA10 Rx UART1
-
-#define Motor_DC1	12		// PB12 Motor Direction Control
-#define Motor_DC2	13		// PB13 Motor Direction Control
-
-#define Car_Reset_Steer_Angle	60	// Straight facing
-#define Car_Reset_Throttle		0	// No Throttle
-#define Car_Reset_Direction 	0 	// Stop Condition
+#include "main.h"
+#include "drive_mix.h"
+#include "sched.h"
+#include "power_monitor.h"
+#include "trace.h"
+#include "irq_config.h"
+#include "setpoint.h"
+#include "interp.h"
+#include "config.h"
+#include "boot.h"
+#include "autobaud.h"
+#include "link.h"
+#include "imu.h"
+#include "curves.h"
+#include "maneuver.h"
+#include "bench.h"
+#include "failsafe.h"
+#include "lights.h"
+#include "update.h"
+#include "range.h"
 
 
 // Function Prototyping
-void SystemClock_Init(void);
-
 void B_LED_Init(void);
 void Btn_Init(void);
 
-void TIM3_Delay(uint16_t delay_ms);
+int main(void)
+{
+#if Bench_Build
+	Bench_Main();						// Driver cycle costs over USART1, never returns
+#endif
 
-void Motor_TIM1_PWM_Init(void);
-void Motor_TIM1_PWM_SetDutyCycle(uint8_t duty_cycle);
+	Car_Init();
 
-void Servo_TIM2_PWM_Init(void);
-void Servo_TIM2_PWM_SetDutyCycle(uint8_t duty_cycle);
-void Servo_TIM2_PWM_SetAngle(uint8_t angle);
+	while(1)
+	{
+		Car_Loop();
+	}
+}
 
-void UART1_Init(void);
-void UART1_Send_Char(char c);
-void UART1_Send_Str(char *str);
-char UART1_Receive_Char(void);
-void UART1_Receive_Str(char *str);
-bool UART1_Receive_Packet(uint8_t *steer, uint8_t *throttle, uint8_t *dir);
+void Car_Init(void)
+{
+	// Initialization
+	// SystemInit() already parked the outputs and started the HSE, still running on HSI here
+	Watchdog_Init();					// IWDG first: a hung init resets too (reads the reset flags)
+	Trace_Init();						// Flight recorder, DWT timestamps
+	IRQ_Config_Init();					// NVIC priorities, before any IRQ is enabled
+	Config_Init();						// Stored configuration, before any peripheral uses it
+	Update_Init();						// Slot the bootloader started (VTOR), trial or confirmed
+	Motor_Direction_Control_Init();		// Motor Direction GPIO Initialization
 
-void Motor_Direction_Control_Init(void);
-void Motor_Direction_Control(uint8_t Direction);
+	SystemClock_Init(); 				// Selecting HSE 25MHz (waits for the lock)
+	Motor_TIM1_PWM_Init();				// Motor PWM initialization
+	Servo_TIM2_PWM_Init();				// Motor PWM initialization
+	Drive_Mix_Init((Drive_Profile)Config_Get(Cfg_Drive_Profile));	// Extra wheel channels for the chassis profile
+	Curve_Select((Curve_Id)Config_Get(Cfg_Curve));					// Stick response tables
 
-void Car_Control(uint8_t Steer,uint8_t Throttle, uint8_t Dir);
+	// Reset Condition
+	Car_Control(Config_Get(Cfg_Steer_Reset), Car_Reset_Throttle, Car_Reset_Direction);
+	Boot_Mark_Time(Boot_First_PWM);
 
-// Checking/Testing Functions
-void CK_LED_Blink(void);	// LED blink
-void CK_LED_Btn(void); 		// Toggle LED with button press
-void CK_Servo(void);		// Check 9g servo
+	UART1_Init();						// UART1 initialization
+	Autobaud_Init(Config_Get(Cfg_Autobaud));	// Hunt for the host rate in parallel with reception
+	Link_Init((Link_Role)Config_Get(Cfg_Port2_Role));	// Parser per port, USART2 if enabled
+	Boot_Mark_Time(Boot_UART_Ready);
+
+	Power_Monitor_Init();				// Battery / motor current ADC+DMA sampling
+	IMU_Init();							// I2C1 gyro, probed and sampled from the SysTick
+	Lights_Init();						// PB10 light driver, PC13 LED
+	Sched_Init();						// 1ms SysTick time base
+	Interp_Init();						// Servo frame (TIM2 update) interpolation
+	Range_Init();						// TIM3 ultrasonic ping / echo capture, if Cfg_Range_Guard
+	Boot_Mark_Time(Boot_Main_Loop);
+}
 
-// Checking/Testing Car Functions
-void CK_Car_Servo(void);	// Car servo check
+static uint32_t power_next = 0;			// Next power monitor update (ms)
+static uint32_t stats_next = 0;			// Next link statistics update (ms)
+static volatile uint16_t car_steer = 0;	// Last Car_Control() output
+static volatile uint8_t car_throttle = 0;
+static volatile uint8_t car_dir = 0;
 
-int main(void)
+void Car_Loop(void)
 {
-	// Initialization
-	SystemClock_Init(); 				// Selecting HSE 25MHz
-	Motor_TIM1_PWM_Init();				// Motor PWM initialization
-	Servo_TIM2_PWM_Init();				// Motor PWM initialization
-	UART1_Init();						// UART1 initialization
-	Motor_Direction_Control_Init();		// Motor Direction GPIO Initialization
+	// One pass of the main loop, also stepped by the host simulator (Simulator/)
+	uint16_t steer;						// Steer in 0.01 deg
+	uint8_t throttle, dir;
 
-	// Reset Condition
-	Car_Control(Car_Reset_Steer_Angle, Car_Reset_Throttle, Car_Reset_Direction);
+	if (Link_Receive_Packet(&steer, &throttle, &dir))	// Checking Control Commands (all ports)
+	{
+		Setpoint_Queue_Flush();							// Live command overrides a trajectory
+		Maneuver_Live(steer, throttle, dir);			// Recorded, or takes over from a replay
+		Car_Command(steer, throttle, dir);				// Controlling the Car
+	}
 
-	uint8_t steer, throttle, dir;		// Initializing the variables
+	if (Setpoint_Queue_Poll(&steer, &throttle, &dir))	// Time-stamped setpoint due
+	{
+		Maneuver_Live(steer, throttle, dir);
+		Car_Command(steer, throttle, dir);
+	}
 
-	while(1)
+	if (Maneuver_Poll(&steer, &throttle, &dir))		// Replayed keyframe due
 	{
-	    if (UART1_Receive_Packet(&steer, &throttle, &dir))	// Checking Control Commands
-	    {
-	        Car_Control(steer, throttle, dir);				// Controlling the Car
-	    }
+		Car_Command(steer, throttle, dir);
+		Interp_Hold();									// Keyframes only mark changes
 	}
+
+	if (Sched_Every(&power_next, Power_Monitor_Period_ms))
+	{
+		Power_Monitor_Update();							// Filter ADC, derate throttle
+	}
+
+	if (Sched_Every(&stats_next, 1000))
+	{
+		Link_Stats_Update();							// Bytes/s, frames/s
+	}
+
+	Autobaud_Poll();									// Re-hunt if a new rate is not confirmed
+	Lights_Poll();										// Hazard blink
+
+	Link_Telemetry_Poll();								// <R> stream, if enabled
+	Link_Tx_Poll();										// Queued replies out, never waits
+
+	Failsafe_Poll();									// Link lost: ramp to a stop
+	Watchdog_Refresh();									// Loop and SysTick alive
 }
 
 
 void SystemClock_Init(void)
 {
-   // Enable HSE
+   // Enable HSE (already started in SystemInit, mostly locked by now)
    RCC->CR |= RCC_CR_HSEON;
    while (!(RCC->CR & RCC_CR_HSERDY)) { /* Wait until ready */ }
 
@@ -104,6 +144,7 @@ void SystemClock_Init(void)
 
    // Wait until HSE is used as system clock
    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSE) { /* Wait */ }
+   Boot_Clock_Switched();
 }
 
 void B_LED_Init(void)
@@ -124,25 +165,6 @@ void Btn_Init(void)
    GPIOA->PUPDR |= (1U << (Btn * 2));    	// Pull-up configuration
 }
 
-void TIM3_Delay(uint16_t delay_ms)
-{
-	 RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;		// Enable TIM3 Clock
-
-	 uint32_t prescaler = (SysClk / 1000) - 1;	// Timer clock = 1 KHz or 1ms
-	 TIM3->PSC = prescaler - 1;					// Pre-scaler update
-
-	 TIM3->ARR = delay_ms - 1;   			// Auto-reload 1 second delay (1ms * 999)
-	 TIM3->CNT = 0;							// Reset the counter
-	 TIM3->EGR |= (1 << 0);  				// Event generation
-
-	 TIM3->SR &= ~ (1 << 0);  				// Clear update interrupt flag
-	 TIM3->CR1 |= (1 << 0); 				// Enable Timer
-
-	 while (!(TIM3->SR & (1 << 0))){} 		// Until UIF NEQ 1
-	 TIM3->SR &= ~(1 << 0); 				//UIF is cleared manually
-	 TIM3->CR1 &= ~(1 << 0); 				//CEN is cleared
-}
-
 void Motor_TIM1_PWM_Init(void)
 {
   // Enable clocks for GPIOA and TIM1
@@ -158,11 +180,9 @@ void Motor_TIM1_PWM_Init(void)
   GPIOA->AFR[1] |=  (1U << 0);            		// 01: AF1 TIM1_CH1
 
   // Timer configuration
-  // Timer frequency = sysclk / (PSC+1) / (ARR+1)
+  // Timer frequency = sysclk / (PSC+1) / (ARR+1), ARR set by Motor_TIM1_PWM_Align()
   uint32_t prescaler = (SysClk / 1000000) - 1;			// Timer clock = 1 MHz
-  uint32_t period = (1000000 / Motor_PWM_Freq) - 1;		// ARR
   TIM1->PSC = prescaler;								// Pre-scaler update
-  TIM1->ARR = period;									// ARR update
   TIM1->CCR1 = 0;  										// 0% duty cycle
 
   // PWM mode 1, pre-load enable
@@ -178,15 +198,90 @@ void Motor_TIM1_PWM_Init(void)
   TIM1->BDTR = 0;				// Clear register
   TIM1->BDTR |= TIM_BDTR_MOE;	// Enable main output
 
-  // Enable timer
-  TIM1->CR1 |= TIM_CR1_ARPE;	// Auto-reload pre-load enable
-  TIM1->CR1 |= TIM_CR1_CEN;		// Start timer
+  // Counting mode, period, start timer
+  Motor_TIM1_PWM_Align(Config_Get(Cfg_Motor_PWM_Align));
+}
+
+static uint8_t motor_duty_cmd[4];	// Last commanded duty per TIM1 channel
+static bool motor_center = Motor_PWM_Center;	// TIM1 center-aligned
+
+void Motor_TIM1_PWM_Align(bool center)
+{
+  // Edge-aligned: counts up, every channel switches on together at the update
+  // Center-aligned (mode 1): counts up and down, CH1/CH4 pulses centred on the valley and CH2/CH3 on the
+  // peak, so the wheels switch at different times and the CH1 current sample sits away from their edges
+  uint32_t ticks = 1000000 / Config_Get(Cfg_Motor_PWM_Freq);	// Period in 1 MHz ticks
+
+  IRQ_Scheduler_Lock();					// No duty written by a scheduler ISR between ARR and the CCRs
+  TIM1->CR1 &= ~TIM_CR1_CEN;			// CMS only changes with the counter stopped
+  motor_center = center;
+  TIM1->CR1 = (TIM1->CR1 & ~TIM_CR1_CMS) | (center ? TIM_CR1_CMS_0 : 0U);
+  TIM1->ARR = center ? ticks / 2 : ticks - 1;		// Up and down: 2 x ARR ticks per period
+
+  TIM1->CCMR1 = (TIM1->CCMR1 & ~TIM_CCMR1_OC2M) | (Motor_TIM1_OC_Mode(2) << TIM_CCMR1_OC2M_Pos);
+  TIM1->CCMR2 = (TIM1->CCMR2 & ~TIM_CCMR2_OC3M) | (Motor_TIM1_OC_Mode(3) << TIM_CCMR2_OC3M_Pos);
+  Motor_TIM1_PWM_Refresh();				// Compare values for the new period
+
+  TIM1->CNT = 0;
+  TIM1->EGR = TIM_EGR_UG;				// Load ARR / CCR pre-loads now
+  TIM1->CR1 |= TIM_CR1_ARPE;			// Auto-reload pre-load enable
+  TIM1->CR1 |= TIM_CR1_CEN;				// Start timer
+  IRQ_Scheduler_Unlock();
+}
+
+uint32_t Motor_TIM1_OC_Mode(uint8_t channel)
+{
+  // OCxM: PWM mode 1 (active below CCR), center-aligned CH2/CH3 PWM mode 2 (active above it)
+  return (motor_center && (channel == 2 || channel == 3)) ? 7U : 6U;
 }
 
 void Motor_TIM1_PWM_SetDutyCycle(uint8_t duty_cycle)
 {
+  Motor_TIM1_PWM_SetChannelDutyCycle(1, duty_cycle);
+}
+
+void Motor_TIM1_PWM_SetChannelDutyCycle(uint8_t channel, uint8_t duty_cycle)
+{
+  // Channel: 1-4, TIM1 CCR1-CCR4
+  if(channel < 1 || channel > 4) return;
   if(duty_cycle > 100) duty_cycle = 100;
-  TIM1->CCR1 = ((TIM1->ARR + 1) * duty_cycle) / 100;
+  motor_duty_cmd[channel - 1] = duty_cycle;		// Commanded duty, before derating
+
+  uint8_t limit = Power_Throttle_Limit();		// Battery / current derating
+  if(duty_cycle > limit) duty_cycle = limit;
+
+  // Active ticks: edge-aligned duty x (ARR + 1), center-aligned duty x ARR on each slope
+  // Above ARR the output stays on: 100%
+  uint32_t ticks = motor_center ? TIM1->ARR : TIM1->ARR + 1;
+  uint32_t ccr = (duty_cycle == 100) ? TIM1->ARR + 1 : (ticks * duty_cycle) / 100;
+  if(Motor_TIM1_OC_Mode(channel) == 7U)
+    ccr = (ccr == 0) ? TIM1->ARR + 1 : (ccr > TIM1->ARR) ? 0 : TIM1->ARR - ccr;	// Mode 2: on from CCR to the peak
+
+  switch (channel)
+  {
+    case 1:
+      TIM1->CCR1 = ccr;
+      if(Drive_Mix_GetProfile() != Drive_4WD)
+        TIM1->CCR4 = motor_center ? 1 : ccr / 2;	// CC4 triggers the ADC at mid on-time (center: the valley, counting down)
+      break;
+    case 2: TIM1->CCR2 = ccr; break;
+    case 3: TIM1->CCR3 = ccr; break;
+    case 4:
+      if(Drive_Mix_GetProfile() == Drive_4WD)
+        TIM1->CCR4 = ccr;			// Otherwise CC4 is the ADC trigger, set with channel 1
+      break;
+    default: break;
+  }
+}
+
+void Motor_TIM1_PWM_Refresh(void)
+{
+  // Re-apply the commanded duty of every channel (after a derating change)
+  // Main loop: the TIM2 / SysTick / TIM3 ISRs write the same duties, a stale one must not overwrite theirs
+  IRQ_Scheduler_Lock();
+  for(uint8_t channel = 1; channel <= 4; channel++)
+    Motor_TIM1_PWM_SetChannelDutyCycle(channel, motor_duty_cmd[channel - 1]);
+  IRQ_Scheduler_Unlock();
 }
 
 void Servo_TIM2_PWM_Init(void)
@@ -205,11 +300,12 @@ void Servo_TIM2_PWM_Init(void)
 
   // Timer configuration
   // Timer frequency = sysclk / (PSC+1) / (ARR+1)
-  uint32_t prescaler = (SysClk / 1000000) - 1;			// Timer clock = 1MHz
-  uint32_t period = (1000000 / Servo_PWM_Freq) - 1;		// ARR
+  // TIM2 is 32-bit: in high resolution mode it counts the full timer clock (ARR = 499999 @25MHz)
+  uint32_t prescaler = (SysClk / Servo_Tick_Freq) - 1;			// Timer clock = 25MHz or 1MHz
+  uint32_t period = (Servo_Tick_Freq / Servo_PWM_Freq) - 1;		// ARR
   TIM2->PSC = prescaler;								// Pre-scaler update
   TIM2->ARR = period;									// ARR update
-  TIM2->CCR1 = period / 2;  							// default 50% duty cycle
+  TIM2->CCR1 = 0;  									// No pulse until the first angle, no twitch at power-on
 
   // PWM mode 1, pre-load enable
   TIM2->CCMR1 &= ~(7U << 4);			// Clear register
@@ -231,6 +327,12 @@ void Servo_TIM2_PWM_SetDutyCycle(uint8_t duty_cycle)
 }
 
 void Servo_TIM2_PWM_SetAngle(uint8_t angle)
+{
+	if(angle > 180) angle = 180;
+	Servo_TIM2_PWM_SetAngleFine((uint16_t)angle * Steer_Scale);
+}
+
+void Servo_TIM2_PWM_SetAngleFine(uint16_t angle_cdeg)
 {
 
 //	#define MIN_PULSE_WIDTH       544     // the shortest pulse sent to a servo
@@ -238,12 +340,17 @@ void Servo_TIM2_PWM_SetAngle(uint8_t angle)
 //	#define DEFAULT_PULSE_WIDTH  1500     // default pulse width when servo is attached
 //	#define REFRESH_INTERVAL    20000     // minimum time to refresh servos in microseconds
 
-	if(angle < 0) 	angle = 0;
-	if(angle > 180) angle = 180;
-
-	// CCR =  MIN_PULSE_WIDTH + ((MAX_PULSE_WIDTH - MIN_PULSE_WIDTH)/180)*angle
-	// TIM2->CCR1 = 544 + (10.312*angle);
-	 TIM2->CCR1 = 544 + (((2400-544)/180)*angle);
+	// angle_cdeg: 0-18000 (0.01 degree)
+	if(angle_cdeg > 180 * Steer_Scale) angle_cdeg = 180 * Steer_Scale;
+
+	// CCR =  MIN_PULSE + ((MAX_PULSE - MIN_PULSE) * angle) / 180, in timer ticks
+	// High resolution: 25 ticks/us, 45000 ticks over the default range (0.004 deg per step)
+	// Pulse limits are per servo, calibrated in the config store
+	const uint32_t ticks_us = Servo_Tick_Freq / 1000000U;
+	const uint32_t min_us = Config_Get(Cfg_Servo_Min_us);
+	const uint32_t max_us = Config_Get(Cfg_Servo_Max_us);
+	const uint32_t span = (max_us - min_us) * ticks_us;
+	TIM2->CCR1 = (min_us * ticks_us) + ((span * angle_cdeg) / (180 * Steer_Scale));
 }
 
 void UART1_Init(void)
@@ -261,15 +368,86 @@ void UART1_Init(void)
 
 	 // Configure USART1
 	 USART1->CR1 = 0;  								// Disable before configuration
-	 USART1->BRR = 0xA2C;  							// 9600 baud @25 MHz
+	 uint32_t baud = Config_Get(Cfg_Baud);
+	 USART1->BRR = (SysClk + baud / 2) / baud;		// Oversampling 16, 0xA2C = 9600 baud @25 MHz
 	 USART1->CR1 |= (USART_CR1_TE | USART_CR1_RE);  // Enable TX, RX
+	 USART1->CR1 |= USART_CR1_RXNEIE;               // RX interrupt (also raised by ORE)
 	 USART1->CR1 |= USART_CR1_UE;                   // Enable USART1
+
+	 NVIC_EnableIRQ(USART1_IRQn);					// Priority: IRQ_Config_Init()
+}
+
+// RX rings filled by the USART IRQ handlers, entry = byte | (SR error bits << 8)
+#define UART_Rx_Size	128U		// Power of two
+
+typedef struct
+{
+	volatile uint16_t buf[UART_Rx_Size];
+	volatile uint8_t head;			// Written by the ISR only
+	volatile uint8_t tail;			// Written by the main loop only
+	volatile uint32_t full;			// Bytes lost, main loop fell behind
+} UART_Rx_Ring;
+
+static UART_Rx_Ring uart1_rx;
+static UART_Rx_Ring uart2_rx;
+
+static void UART_Rx_Isr(USART_TypeDef *uart, UART_Rx_Ring *ring)
+{
+	uint32_t sr = uart->SR;
+	if (sr & (USART_SR_RXNE | USART_SR_ORE))
+	{
+		uint16_t entry = (uint16_t)((uart->DR & 0xFF) | ((sr & 0x0FU) << 8));	// SR then DR clears errors
+		uint8_t next = (ring->head + 1) & (UART_Rx_Size - 1);
+
+		if (next != ring->tail)
+		{
+			ring->buf[ring->head] = entry;
+			ring->head = next;
+		}
+		else
+		{
+			ring->full++;				// Main loop fell behind, byte lost
+		}
+	}
+}
+
+static bool UART_Rx_Ring_Pop(UART_Rx_Ring *ring, uint16_t *entry)
+{
+	if (ring->tail == ring->head) return 0;
+
+	*entry = ring->buf[ring->tail];
+	ring->tail = (ring->tail + 1) & (UART_Rx_Size - 1);
+	return 1;
+}
+
+void USART1_IRQHandler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_USART1, IRQ_Latency_Unknown);	// No hardware timestamp for RXNE
+	UART_Rx_Isr(USART1, &uart1_rx);
+	IRQ_Measure_Exit(IRQ_Slot_USART1);
+}
+
+bool UART1_Rx_Pop(uint16_t *entry)
+{
+	return UART_Rx_Ring_Pop(&uart1_rx, entry);
+}
+
+uint32_t UART1_Rx_Overflow(void)
+{
+	return uart1_rx.full;
 }
 
 void UART1_Send_Char(char c)
 {
-	while (!(USART1->SR & USART_SR_TXE));  // wait until TX buffer empty
-	USART1->DR = (c & 0xFF);
+	while (!UART_Tx_Ready(USART1));  // wait until TX buffer empty
+	UART_Tx_Write(USART1, c & 0xFF);
+}
+
+bool UART1_Try_Send_Char(char c)
+{
+	if (!UART_Tx_Ready(USART1)) return 0;	// Previous byte still in DR
+	UART_Tx_Write(USART1, c & 0xFF);
+	return 1;
 }
 
 void UART1_Send_Str(char *str)
@@ -280,10 +458,27 @@ void UART1_Send_Str(char *str)
 	 }
 }
 
+void UART1_Send_Uint(uint32_t value)
+{
+	char digits[10];
+	uint8_t n = 0;
+
+	do {
+		digits[n++] = (char)('0' + (value % 10));
+		value /= 10;
+	} while (value);
+
+	while (n)
+	{
+		UART1_Send_Char(digits[--n]);
+	}
+}
+
 char UART1_Receive_Char(void)
 {
-   while (!(USART1->SR & USART_SR_RXNE));  // wait until data received
-   return (char)(USART1->DR & 0xFF);
+   uint16_t entry;
+   while (!UART1_Rx_Pop(&entry));  // wait until data received
+   return (char)(entry & 0xFF);
 }
 
 void UART1_Receive_Str(char *buffer)
@@ -297,37 +492,59 @@ void UART1_Receive_Str(char *buffer)
    buffer[i] = '\0';  					// null terminate
 }
 
-bool UART1_Receive_Packet(uint8_t *steer, uint8_t *throttle, uint8_t *dir)
+void UART2_Init(void)
 {
-	// Packet: <S,45,0,0>
-    static char buffer[32];
-    static uint8_t index = 0;
+	 // Enable clocks for GPIOA and USART2
+	 RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;   // GPIOA clock enable
+	 RCC->APB1ENR |= RCC_APB1ENR_USART2EN;  // USART2 clock enable (APB1 = 25 MHz)
+
+	 // Configure PA2 (TX2) and PA3 (RX2) as Alternate Function 7 (AF7)
+	 GPIOA->MODER &= ~( (3U << (Tx2 * 2)) | (3U << (Rx2 * 2)) );  	// 00: Clear register
+	 GPIOA->MODER |=  ( (2U << (Tx2 * 2)) | (2U << (Rx2 * 2)) );  	// 10: AF mode
+	 GPIOA->AFR[0] &= ~( (0xFU << (Tx2 * 4)) | (0xFU << (Rx2 * 4)) );	// 00: Clear register
+	 GPIOA->AFR[0] |=  ( (7U << (Tx2 * 4)) | (7U << (Rx2 * 4)) );  	// AF7 for USART2
+	 GPIOA->OSPEEDR |= (3U << (Tx2 * 2)) | (3U << (Rx2 * 2));  		// High speed
+	 GPIOA->PUPDR &= ~(3U << (Rx2 * 2));
+	 GPIOA->PUPDR |= (1U << (Rx2 * 2));								// Pull-up: idle high when unplugged
+
+	 // Configure USART2
+	 USART2->CR1 = 0;  								// Disable before configuration
+	 USART2->BRR = (SysClk + UART2_Baud / 2) / UART2_Baud;	// Oversampling 16
+	 USART2->CR1 |= (USART_CR1_TE | USART_CR1_RE);  // Enable TX, RX
+	 USART2->CR1 |= USART_CR1_RXNEIE;               // RX interrupt (also raised by ORE)
+	 USART2->CR1 |= USART_CR1_UE;                   // Enable USART2
+
+	 NVIC_EnableIRQ(USART2_IRQn);					// Priority: IRQ_Config_Init()
+}
 
-    while (USART1->SR & USART_SR_RXNE)      // Check data available
-    {
-        char c = USART1->DR & 0xFF;
+void USART2_IRQHandler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_USART2, IRQ_Latency_Unknown);
+	UART_Rx_Isr(USART2, &uart2_rx);
+	IRQ_Measure_Exit(IRQ_Slot_USART2);
+}
 
-        if (c == '<') {
-            index = 0;
-        }
-        else if (c == '>') {
-            buffer[index] = '\0';
+bool UART2_Rx_Pop(uint16_t *entry)
+{
+	return UART_Rx_Ring_Pop(&uart2_rx, entry);
+}
 
-            // Parse: S,steer,throttle,direction
-            char *tok = strtok(buffer, ","); // skip 'S'
-            tok = strtok(NULL, ","); *steer = atoi(tok);
-            tok = strtok(NULL, ","); *throttle = atoi(tok);
-            tok = strtok(NULL, ","); *dir = atoi(tok);
+uint32_t UART2_Rx_Overflow(void)
+{
+	return uart2_rx.full;
+}
 
-            return 1;   // Packet ready
-        }
-        else {
-            if (index < 31)
-                buffer[index++] = c;
-        }
-    }
+void UART2_Send_Char(char c)
+{
+	while (!UART_Tx_Ready(USART2));  // wait until TX buffer empty
+	UART_Tx_Write(USART2, c & 0xFF);
+}
 
-    return 0; // No complete packet yet
+bool UART2_Try_Send_Char(char c)
+{
+	if (!UART_Tx_Ready(USART2)) return 0;
+	UART_Tx_Write(USART2, c & 0xFF);
+	return 1;
 }
 
 void Motor_Direction_Control_Init(void)
@@ -357,9 +574,10 @@ void Motor_Direction_Control_Init(void)
 void Motor_Direction_Control(uint8_t Direction)
 {
 	// Directions
-	// 0 = Stop
+	// 0 = Stop (coast, with the PWM at 0)
 	// 1 = Forward
 	// 2 = Backward
+	// 3 = Brake (L298N inputs both high: motor shorted while the PWM enables the bridge)
 
 	if (Direction==0)
 	{
@@ -378,81 +596,45 @@ void Motor_Direction_Control(uint8_t Direction)
 		GPIOB->ODR &= ~(1<<Motor_DC1);				// Motor_DC1 low
 		GPIOB->ODR |= (1<<Motor_DC2);				// Motor_DC2 high
 	}
-}
-
-
-// ----------------------------------------------------
-// Testing Functions
-// ----------------------------------------------------
-
-void CK_LED_Blink(void)
-{
-	GPIOC->ODR ^= (1<<B_LED);
-	TIM3_Delay(1000);
-}
 
-void CK_LED_Btn(void)
-{
-	if (!(GPIOA->IDR & (1<<Btn)))
+	else if (Direction==3)
 	{
-		while(!(GPIOA->IDR & (1<<Btn))){}
-		TIM3_Delay(20);
-		GPIOC->ODR ^= (1<<B_LED);
+		GPIOB->ODR |= (1<<Motor_DC1) | (1<<Motor_DC2);	// Both high
 	}
 }
 
-void CK_Servo(void)
-{
-	for (int angle = 0 ; angle<=180; angle+=30)
-	{
-		Servo_TIM2_PWM_SetAngle(angle);
-		TIM3_Delay(50);
-	}
-
-	TIM3_Delay(500);
 
-	for (int angle = 180; angle>=0; angle-=30)
-	{
-		Servo_TIM2_PWM_SetAngle(angle);
-		TIM3_Delay(50);
-	}
-	TIM3_Delay(500);
+void Car_Command(uint16_t Steer, uint8_t Throttle, uint8_t Dir)
+{
+	// New command target: shaped by the response curve, then smoothed per servo frame or applied directly
+	Steer = Curve_Steer(Steer);
+	Throttle = Curve_Throttle(Throttle);
+
+	if (Interp_Enabled())
+		Interp_Set_Target(Steer, Throttle, Dir);
+	else
+		Car_Control(Steer, Throttle, Dir);
 }
 
-void CK_Car_Servo(void)
+void Car_Output(uint16_t *Steer, uint8_t *Throttle, uint8_t *Dir)
 {
-	// 0  - Go Left
-	// 45 - Go Straight
-	// 90 -	Go Right
-
-	int max_angle = 90;
-
-	for (int angle = 0 ; angle<=max_angle; angle+=30)
-	{
-		Servo_TIM2_PWM_SetAngle(angle);
-		TIM3_Delay(50);
-	}
-
-	TIM3_Delay(500);
-
-	for (int angle = max_angle; angle>=0; angle-=30)
-	{
-		Servo_TIM2_PWM_SetAngle(angle);
-		TIM3_Delay(50);
-	}
-	TIM3_Delay(500);
+	// Last command applied by Car_Control() (telemetry)
+	*Steer = car_steer;
+	*Throttle = car_throttle;
+	*Dir = car_dir;
 }
 
-
-void Car_Control(uint8_t Steer,uint8_t Throttle, uint8_t Dir)
+void Car_Control(uint16_t Steer, uint8_t Throttle, uint8_t Dir)
 {
-	// Steer: 		0-90, 	0-Left, 45-Straight, 90-Right
+	// Steer: 		0-9000 (0.01 deg), 0-Left, 4500-Straight, 9000-Right
 	// Throttle: 	0-100
-	// Direction:	0-Stop, 1-Forward, 2-Backward
+	// Direction:	0-Stop, 1-Forward, 2-Backward, 3-Brake
 
-	Servo_TIM2_PWM_SetAngle(Steer);
-	Motor_Direction_Control(Dir);
-	Motor_TIM1_PWM_SetDutyCycle(Throttle);
+	Drive_Mix_Apply(Steer, Throttle, Dir);	// Ackermann / Differential / 4WD mixing
+	car_steer = Steer;
+	car_throttle = Throttle;
+	car_dir = Dir;
+	Trace_Log(Trace_Cmd_Applied, (uint8_t)(Steer / Steer_Scale), (uint16_t)(Throttle | (Dir << 8)));
 }
 
 
@@ -0,0 +1,341 @@
+#include "main.h"
+#include "maneuver.h"
+#include "sched.h"
+#include "flash.h"
+#include "config.h"
+#include "drive_mix.h"
+#include "link.h"
+
+// Flash image: magic (written last), length | keyframes << 16, check, then the keyframe bytes
+#define Image_Header_Size	12U
+#define Image_Check_Seed	5381U	// DJB2 over the image bytes
+
+// Built-in sequences in the same encoding, fields as 2-byte LEB128 (non-minimal) so they can be written by hand
+#define Key_V2(v)			(uint8_t)(((v) & 0x7FU) | 0x80U), (uint8_t)(((v) >> 7) & 0x7FU)
+#define Key_Zz(d)			((uint32_t)(((d) < 0) ? -2 * (d) - 1 : 2 * (d)))
+#define Key_Steer(dt, d)	Maneuver_Has_Steer, Key_V2(dt), Key_V2(Key_Zz(d))
+#define Key_Hold(dt)		0, Key_V2(dt)
+
+// Servo check (was CK_Car_Servo): 0-90 degrees in 30 degree steps every 50ms, hold 500ms, back, hold 500ms
+static const uint8_t sweep[] =
+{
+	Key_Steer(0,   -45 * Steer_Scale),		// 0, from the center start state
+	Key_Steer(50,   30 * Steer_Scale),		// 30
+	Key_Steer(50,   30 * Steer_Scale),		// 60
+	Key_Steer(50,   30 * Steer_Scale),		// 90
+	Key_Steer(600, -30 * Steer_Scale),		// 60
+	Key_Steer(50,  -30 * Steer_Scale),		// 30
+	Key_Steer(50,  -30 * Steer_Scale),		// 0
+	Key_Hold(550),
+};
+
+static uint8_t buf[Maneuver_Buffer_Size];	// RAM recording
+static uint16_t length = 0;
+static uint16_t keyframes = 0;
+
+static Maneuver_State state = Maneuver_Idle;
+
+// Previous keyframe: encoder (recording) or decoder (playback) reference
+static uint16_t k_steer = Drive_Steer_Center * Steer_Scale;
+static uint8_t k_thr = 0;
+static uint8_t k_dir = 0;
+static uint32_t k_ms = 0;
+
+// Playback
+static const uint8_t *play_data;
+static uint16_t play_len = 0;
+static uint16_t play_pos = 0;
+static uint8_t next_hdr;					// Decoded keyframe waiting for its time
+static uint16_t next_steer;
+static uint8_t next_thr;
+static uint32_t next_ms;
+
+static void Key_Reset(uint32_t now)
+{
+	// Sequences start from straight and stopped
+	k_steer = Drive_Steer_Center * Steer_Scale;
+	k_thr = 0;
+	k_dir = 0;
+	k_ms = now;
+}
+
+static uint8_t *Put_Varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80U)
+	{
+		*p++ = (uint8_t)(v | 0x80U);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static bool Get_Varint(uint32_t *v)
+{
+	uint32_t value = 0;
+
+	for (uint8_t shift = 0; shift < 32 && play_pos < play_len; shift += 7)
+	{
+		uint8_t b = play_data[play_pos++];
+		value |= (uint32_t)(b & 0x7FU) << shift;
+		if (!(b & 0x80U))
+		{
+			*v = value;
+			return 1;
+		}
+	}
+	return 0;		// Truncated
+}
+
+static uint32_t Zigzag(int32_t d)
+{
+	return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static int32_t Unzigzag(uint32_t z)
+{
+	return (int32_t)(z >> 1) ^ -(int32_t)(z & 1U);
+}
+
+// ----------------------------------------------------
+// Record
+// ----------------------------------------------------
+
+static void Record_Key(uint8_t hdr, uint16_t steer, uint8_t throttle, uint32_t now)
+{
+	if (length + Maneuver_Key_Max > Maneuver_Buffer_Size)
+	{
+		state = Maneuver_Idle;			// Full: keep what fits
+		return;
+	}
+
+	uint8_t *p = &buf[length];
+	*p++ = hdr;
+	p = Put_Varint(p, keyframes ? now - k_ms : 0);		// First keyframe starts the sequence
+	if (hdr & Maneuver_Has_Steer) p = Put_Varint(p, Zigzag((int32_t)steer - k_steer));
+	if (hdr & Maneuver_Has_Throttle) p = Put_Varint(p, Zigzag((int32_t)throttle - k_thr));
+
+	length = (uint16_t)(p - buf);
+	keyframes++;
+	k_ms = now;
+}
+
+void Maneuver_Record_Start(void)
+{
+	Maneuver_Stop();
+	length = 0;
+	keyframes = 0;
+	Key_Reset(Sched_Millis());
+	state = Maneuver_Recording;
+}
+
+void Maneuver_Live(uint16_t steer, uint8_t throttle, uint8_t dir)
+{
+	// Every live command: recorded, or it takes over from a replay
+	if (state == Maneuver_Playing)
+	{
+		state = Maneuver_Idle;
+		return;
+	}
+	if (state != Maneuver_Recording) return;
+
+	uint8_t hdr = 0;
+	if (steer != k_steer) hdr |= Maneuver_Has_Steer;
+	if (throttle != k_thr) hdr |= Maneuver_Has_Throttle;
+	if (dir != k_dir) hdr |= Maneuver_Has_Dir | (uint8_t)((dir & 3U) << Maneuver_Dir_Pos);
+	if (hdr == 0) return;				// Keep-alive repeat: the next change carries the time
+
+	Record_Key(hdr, steer, throttle, Sched_Millis());
+	k_steer = steer;
+	k_thr = throttle;
+	k_dir = dir;
+}
+
+// ----------------------------------------------------
+// Playback
+// ----------------------------------------------------
+
+static bool Decode_Next(void)
+{
+	// Next keyframe into next_*, due at the previous one's time + dt (no drift)
+	uint32_t dt, v;
+
+	if (play_pos >= play_len) return 0;
+	next_hdr = play_data[play_pos++];
+	if (!Get_Varint(&dt)) return 0;
+
+	next_steer = k_steer;
+	next_thr = k_thr;
+	if (next_hdr & Maneuver_Has_Steer)
+	{
+		if (!Get_Varint(&v)) return 0;
+		next_steer = (uint16_t)(k_steer + Unzigzag(v));
+	}
+	if (next_hdr & Maneuver_Has_Throttle)
+	{
+		if (!Get_Varint(&v)) return 0;
+		next_thr = (uint8_t)(k_thr + Unzigzag(v));
+	}
+
+	next_ms = k_ms + dt;
+	return 1;
+}
+
+static uint32_t Image_Check_Byte(uint32_t sum, uint8_t b)
+{
+	return (sum << 5) + sum + b;
+}
+
+static uint32_t Image_Check(const uint8_t *data, uint16_t len)
+{
+	uint32_t sum = Image_Check_Seed;
+	for (uint16_t i = 0; i < len; i++)
+		sum = Image_Check_Byte(sum, data[i]);
+	return sum;
+}
+
+static uint8_t Image_Byte(uint16_t i)
+{
+	// Saved image, little endian words after the header
+	return (uint8_t)(Flash_Word(Maneuver_Flash_Addr + Image_Header_Size + (i & ~3U)) >> (8 * (i & 3U)));
+}
+
+static bool Load_Flash(void)
+{
+	if (Flash_Word(Maneuver_Flash_Addr) != Maneuver_Magic) return 0;
+
+	uint32_t info = Flash_Word(Maneuver_Flash_Addr + 4);
+	uint16_t len = (uint16_t)(info & 0xFFFFU);
+	if (len == 0 || len > Maneuver_Buffer_Size) return 0;
+
+	// Checked in flash first: a corrupt save leaves the RAM recording as it was
+	uint32_t sum = Image_Check_Seed;
+	for (uint16_t i = 0; i < len; i++)
+		sum = Image_Check_Byte(sum, Image_Byte(i));
+	if (sum != Flash_Word(Maneuver_Flash_Addr + 8)) return 0;
+
+	for (uint16_t i = 0; i < len; i++)
+		buf[i] = Image_Byte(i);
+
+	length = len;
+	keyframes = (uint16_t)(info >> 16);
+	return 1;
+}
+
+bool Maneuver_Play(Maneuver_Source src)
+{
+	if ((uint32_t)src >= Maneuver_Src_Count) return 0;
+	Maneuver_Stop();
+
+	if (src == Maneuver_Src_Flash && !Load_Flash()) return 0;
+
+	if (src == Maneuver_Src_Sweep)
+	{
+		play_data = sweep;
+		play_len = sizeof(sweep);
+	}
+	else if (length)
+	{
+		play_data = buf;
+		play_len = length;
+	}
+	else
+	{
+		return 0;
+	}
+
+	play_pos = 0;
+	Key_Reset(Sched_Millis());
+	if (!Decode_Next()) return 0;
+
+	state = Maneuver_Playing;
+	return 1;
+}
+
+bool Maneuver_Poll(uint16_t *steer, uint8_t *throttle, uint8_t *dir)
+{
+	// Called from Car_Loop(): the command of the newest keyframe that has come due
+	if (state != Maneuver_Playing) return 0;
+
+	uint32_t now = Sched_Millis();
+	bool ready = 0;
+
+	while (state == Maneuver_Playing && (int32_t)(now - next_ms) >= 0)
+	{
+		k_steer = next_steer;
+		k_thr = next_thr;
+		if (next_hdr & Maneuver_Has_Dir) k_dir = (next_hdr >> Maneuver_Dir_Pos) & 3U;
+		k_ms = next_ms;
+		ready = 1;
+
+		if (!Decode_Next())
+		{
+			// End of the sequence: stop where it left the steering
+			state = Maneuver_Idle;
+			k_thr = 0;
+			k_dir = 0;
+		}
+	}
+
+	*steer = k_steer;
+	*throttle = k_thr;
+	*dir = k_dir;
+	return ready;
+}
+
+void Maneuver_Stop(void)
+{
+	if (state == Maneuver_Recording)
+	{
+		// Hold until now, so a replay lasts as long as the recording
+		uint32_t now = Sched_Millis();
+		if (keyframes && now != k_ms) Record_Key(0, k_steer, k_thr, now);
+	}
+	else if (state == Maneuver_Playing)
+	{
+		Car_Command(k_steer, 0, 0);		// Stopped mid-sequence: stop the car
+	}
+
+	state = Maneuver_Idle;
+}
+
+bool Maneuver_Save(void)
+{
+	// 128KB sector erase stalls the CPU for 1-2 s: park the car first
+	if (state != Maneuver_Idle || length == 0) return 0;
+	Car_Control((uint16_t)Config_Get(Cfg_Steer_Reset), 0, 0);
+
+	if (!Flash_Erase_Sector(Maneuver_Flash_Sector)) return 0;
+
+	for (uint16_t i = 0; i < length; i += 4)
+	{
+		uint32_t w = 0xFFFFFFFFU;
+		for (uint8_t b = 0; b < 4 && i + b < length; b++)
+			w = (w & ~(0xFFU << (8 * b))) | ((uint32_t)buf[i + b] << (8 * b));
+		if (!Flash_Program_Word(Maneuver_Flash_Addr + Image_Header_Size + i, w)) return 0;
+	}
+
+	// Magic last: a save cut short by a reset never loads
+	if (!Flash_Program_Word(Maneuver_Flash_Addr + 4, length | ((uint32_t)keyframes << 16))) return 0;
+	if (!Flash_Program_Word(Maneuver_Flash_Addr + 8, Image_Check(buf, length))) return 0;
+	return Flash_Program_Word(Maneuver_Flash_Addr, Maneuver_Magic);
+}
+
+Maneuver_State Maneuver_Get_State(void)
+{
+	return state;
+}
+
+void Maneuver_Send_Status(void)
+{
+	// Reply: <M,state,bytes,keyframes,play_pos>
+	Link_Send_Str("<M,");
+	Link_Send_Uint(state);
+	Link_Send_Char(',');
+	Link_Send_Uint(length);
+	Link_Send_Char(',');
+	Link_Send_Uint(keyframes);
+	Link_Send_Char(',');
+	Link_Send_Uint((state == Maneuver_Playing) ? play_pos : 0);
+	Link_Send_Str(">\r\n");
+}
@@ -0,0 +1,202 @@
+#include "main.h"
+#include "power_monitor.h"
+#include "drive_mix.h"
+#include "trace.h"
+#include "irq_config.h"
+
+// ADC1 scan results, written by DMA2 Stream0 in circular mode
+// Layout: [scan][0] = battery, [scan][1] = motor current
+static volatile uint16_t adc_ring[Power_ADC_Scans * Power_ADC_Channels];
+
+static uint32_t batt_filt_q4 = 0;		// Filtered ADC counts, Q4
+static uint32_t motor_filt_q4 = 0;		// Filtered ADC counts, Q4
+static uint8_t current_cap = 100;		// Throttle cap from the current limiter
+static volatile uint8_t throttle_limit = 100;	// Max throttle applied to TIM1
+static volatile uint16_t motor_sync_counts = 0;	// Last mid on-time current sample
+static volatile uint32_t current_trips = 0;		// PWM periods cut short by the limit
+
+void Power_Monitor_Init(void)
+{
+	// Enable clocks for GPIOA, DMA2 and ADC1
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_DMA2EN;
+	RCC->APB2ENR |= RCC_APB2ENR_ADC1EN;
+
+	// PA1, PA4 as analog inputs
+	GPIOA->MODER |= (3U << (Batt_Sense * 2)) | (3U << (Motor_Sense * 2));	// 11: Analog mode
+	GPIOA->PUPDR &= ~((3U << (Batt_Sense * 2)) | (3U << (Motor_Sense * 2)));	// No pull-up or pull-down
+
+	// DMA2 Stream0 Channel0: ADC1->DR to adc_ring, half-word, circular
+	DMA2_Stream0->CR &= ~DMA_SxCR_EN;
+	while (DMA2_Stream0->CR & DMA_SxCR_EN) {}
+	DMA2->LIFCR = 0x3DU;						// Clear stream0 flags
+	DMA2_Stream0->PAR = (uint32_t)&ADC1->DR;
+	DMA2_Stream0->M0AR = (uint32_t)adc_ring;
+	DMA2_Stream0->NDTR = Power_ADC_Scans * Power_ADC_Channels;
+	DMA2_Stream0->CR = (0U << DMA_SxCR_CHSEL_Pos)	// Channel 0 = ADC1
+			| DMA_SxCR_MSIZE_0 | DMA_SxCR_PSIZE_0		// 16-bit
+			| DMA_SxCR_MINC | DMA_SxCR_CIRC;			// Peripheral to memory
+	DMA2_Stream0->CR |= DMA_SxCR_EN;
+
+	// ADC clock = PCLK2 / 2 = 12.5MHz
+	ADC->CCR &= ~ADC_CCR_ADCPRE;
+
+	// Scan IN1, IN4 continuously, 480 cycle sample time for the divider impedance
+	ADC1->CR1 = ADC_CR1_SCAN;
+	ADC1->CR2 = ADC_CR2_CONT | ADC_CR2_DMA | ADC_CR2_DDS;
+	// Sense resistor is low impedance: 84 cycles keeps the injected sample inside short on-times
+	ADC1->SMPR2 = (7U << ADC_SMPR2_SMP1_Pos) | (4U << ADC_SMPR2_SMP4_Pos);
+	ADC1->SQR1 = ((Power_ADC_Channels - 1) << ADC_SQR1_L_Pos);
+	ADC1->SQR3 = (Batt_Sense << ADC_SQR3_SQ1_Pos) | (Motor_Sense << ADC_SQR3_SQ2_Pos);
+
+	// Injected IN4, one conversion, started by TIM1 CC4 rising edge
+	// CCR4 follows CCR1 / 2 (Motor_TIM1_PWM_SetChannelDutyCycle), the middle of the on-time
+	// Center-aligned, CCR4 = 1: one tick before the valley, CC events only come counting down (CMS = 01)
+	ADC1->JSQR = (0U << ADC_JSQR_JL_Pos) | (Motor_Sense << ADC_JSQR_JSQ4_Pos);
+	ADC1->CR2 &= ~(ADC_CR2_JEXTSEL | ADC_CR2_JEXTEN);
+	ADC1->CR2 |= (0U << ADC_CR2_JEXTSEL_Pos) | ADC_CR2_JEXTEN_0;	// TIM1_CC4, rising edge
+	ADC1->CR1 |= ADC_CR1_JEOCIE;
+
+	NVIC_EnableIRQ(ADC_IRQn);					// Priorities: IRQ_Config_Init()
+	NVIC_EnableIRQ(TIM1_UP_TIM10_IRQn);
+
+	ADC1->CR2 |= ADC_CR2_ADON;
+	for (volatile uint32_t i = 0; i < 100; i++) {}	// tSTAB
+	ADC1->CR2 |= ADC_CR2_SWSTART;
+}
+
+static uint16_t Counts_To_mV(uint32_t counts_q4)
+{
+	return (uint16_t)((counts_q4 * ADC_Vref_mV) / (ADC_Full_Scale << 4));
+}
+
+void Power_Monitor_Update(void)
+{
+	// Average the DMA ring, no CPU spent per sample
+	uint32_t batt_sum = 0, motor_sum = 0;
+	for (uint16_t i = 0; i < Power_ADC_Scans * Power_ADC_Channels; i += Power_ADC_Channels)
+	{
+		batt_sum += adc_ring[i];
+		motor_sum += adc_ring[i + 1];
+	}
+
+	// Average in Q4, then IIR low-pass
+	uint32_t batt_q4 = (batt_sum << 4) / Power_ADC_Scans;
+	uint32_t motor_q4 = (motor_sum << 4) / Power_ADC_Scans;
+
+	if (batt_filt_q4 == 0) batt_filt_q4 = batt_q4;		// First update: start at the reading
+	batt_filt_q4 = batt_filt_q4 + (((int32_t)batt_q4 - (int32_t)batt_filt_q4) >> Power_Filter_Shift);
+	motor_filt_q4 = motor_filt_q4 + (((int32_t)motor_q4 - (int32_t)motor_filt_q4) >> Power_Filter_Shift);
+
+	// Voltage derate: 100% at Batt_Derate_Start_mV, linear down to 0% at Batt_Cutoff_mV
+	uint16_t batt_mV = Power_Battery_mV();
+	uint8_t volt_cap = 100;
+	if (batt_mV <= Batt_Cutoff_mV)
+		volt_cap = 0;
+	else if (batt_mV < Batt_Derate_Start_mV)
+		volt_cap = (uint8_t)(((uint32_t)(batt_mV - Batt_Cutoff_mV) * 100) / (Batt_Derate_Start_mV - Batt_Cutoff_mV));
+
+	// Current limit: step the cap down while over the limit, recover slowly below it
+	if (Power_Motor_mA() > Motor_Current_Limit_mA)
+		current_cap = (current_cap > Current_Derate_Step) ? current_cap - Current_Derate_Step : 0;
+	else if (current_cap < 100)
+		current_cap = (current_cap + Current_Recover_Step > 100) ? 100 : current_cap + Current_Recover_Step;
+
+	uint8_t limit = (volt_cap < current_cap) ? volt_cap : current_cap;
+
+	if (limit != throttle_limit)
+	{
+		throttle_limit = limit;
+		Trace_Log(Trace_Derate, limit, batt_mV);
+		Motor_TIM1_PWM_Refresh();		// Re-apply commanded duty under the new cap
+	}
+}
+
+uint16_t Power_Battery_mV(void)
+{
+	return Counts_To_mV(batt_filt_q4) * Batt_Divider_Ratio;
+}
+
+uint16_t Power_Motor_mA(void)
+{
+	return (uint16_t)(((uint32_t)Counts_To_mV(motor_filt_q4) * 1000) / Motor_Sense_mOhm);
+}
+
+uint8_t Power_Throttle_Limit(void)
+{
+	return throttle_limit;
+}
+
+uint16_t Power_Motor_Sync_mA(void)
+{
+	return (uint16_t)(((uint32_t)Counts_To_mV((uint32_t)motor_sync_counts << 4) * 1000) / Motor_Sense_mOhm);
+}
+
+uint32_t Power_Current_Trips(void)
+{
+	return current_trips;
+}
+
+#if IRQ_Measure
+// Core cycles from the CC4 trigger to JEOC: (84 + 12) ADC cycles at PCLK2 / 2
+#define ADC_Inj_Conv_Cycles		192U
+
+static uint32_t ADC_Latency_Cycles(void)
+{
+	// Time since the CC4 trigger, minus the conversion itself
+	uint32_t ticks;
+	if (TIM1->CR1 & TIM_CR1_CMS)
+	{
+		// Triggered counting down: still down, or past the valley and counting up
+		ticks = (TIM1->CR1 & TIM_CR1_DIR) ? TIM1->CCR4 - TIM1->CNT : TIM1->CCR4 + TIM1->CNT;
+	}
+	else
+	{
+		ticks = TIM1->CNT - TIM1->CCR4;
+		if (TIM1->CNT < TIM1->CCR4) ticks += TIM1->ARR + 1;
+	}
+	uint32_t cycles = ticks * (TIM1->PSC + 1);
+	return (cycles > ADC_Inj_Conv_Cycles) ? cycles - ADC_Inj_Conv_Cycles : 0;
+}
+#endif
+
+void ADC_IRQHandler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_ADC, ADC_Latency_Cycles());
+
+	if (ADC1->SR & ADC_SR_JEOC)
+	{
+		ADC1->SR = ~ADC_SR_JEOC;			// rc_w0
+		uint16_t sample = (uint16_t)ADC1->JDR1;
+		motor_sync_counts = sample;
+
+		// 4WD drives CH4 as a wheel, so CC4 is not at the CH1 mid on-time there
+		if (sample > Motor_Current_Trip_Counts && Drive_Mix_GetProfile() != Drive_4WD)
+		{
+			// Force OC1REF inactive now, PWM mode 1 comes back on the next update
+			// Center-aligned: the valley update is already past (CC4 leads it by one tick), the next is the peak
+			TIM1->CCMR1 = (TIM1->CCMR1 & ~TIM_CCMR1_OC1M) | (4U << TIM_CCMR1_OC1M_Pos);
+			TIM1->SR = ~TIM_SR_UIF;
+			TIM1->DIER |= TIM_DIER_UIE;
+			current_trips++;
+			Trace_Log(Trace_Current_Trip, 0, sample);
+		}
+	}
+
+	IRQ_Measure_Exit(IRQ_Slot_ADC);
+}
+
+void TIM1_UP_TIM10_IRQHandler(void)
+{
+	// Cycles since update: counting down from the peak (center-aligned), else up from zero
+	IRQ_Measure_Enter(IRQ_Slot_TIM1_UP,
+			((TIM1->CR1 & TIM_CR1_DIR) ? TIM1->ARR - TIM1->CNT : TIM1->CNT) * (TIM1->PSC + 1));
+
+	if (TIM1->SR & TIM_SR_UIF)
+	{
+		TIM1->SR = ~TIM_SR_UIF;
+		TIM1->CCMR1 = (TIM1->CCMR1 & ~TIM_CCMR1_OC1M) | (6U << TIM_CCMR1_OC1M_Pos);	// PWM mode 1
+		TIM1->DIER &= ~TIM_DIER_UIE;		// Only needed after a trip
+	}
+
+	IRQ_Measure_Exit(IRQ_Slot_TIM1_UP);
+}
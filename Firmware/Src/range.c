@@ -0,0 +1,230 @@
+#include "main.h"
+#include "range.h"
+#include "drive_mix.h"
+#include "config.h"
+#include "irq_config.h"
+#include "trace.h"
+#include "link.h"
+
+static volatile uint8_t state = Range_Off;	// Range_State, changed at scheduler level only
+static Range_Stats stats;
+static uint16_t rise_t = 0;				// Echo rising edge capture
+static bool echo_high = 0;
+static uint8_t valid = 0;				// Pings of the same target behind stats: 1 range, 2 closing speed
+static int32_t closing = 0;				// mm/s, filtered
+static uint8_t missed = 0;				// Pings started since the last echo
+static bool released = 1;				// Forward command let go since the brake came on
+
+void Range_Init(void)
+{
+	// PA6 (CH1) trigger out, PA7 (CH2) echo in, both Alternate Function(AF2)
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN;
+	RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+
+	GPIOA->MODER &= ~((3U << (Range_Trig * 2)) | (3U << (Range_Echo * 2)));	// 00: Clear register
+	GPIOA->MODER |=  ((2U << (Range_Trig * 2)) | (2U << (Range_Echo * 2)));	// 10: Alternate function
+	GPIOA->OTYPER &= ~(1U << Range_Trig);										// Push-pull
+	GPIOA->PUPDR &= ~((3U << (Range_Trig * 2)) | (3U << (Range_Echo * 2)));
+	GPIOA->PUPDR |=  (2U << (Range_Echo * 2));		// Pull-down: no sensor, no echo
+	GPIOA->AFR[0] &= ~((0xFU << (Range_Trig * 4)) | (0xFU << (Range_Echo * 4)));
+	GPIOA->AFR[0] |=  ((2U << (Range_Trig * 4)) | (2U << (Range_Echo * 4)));	// AF2 TIM3_CH1/CH2
+
+	// 1us steps (APB1 timer clock = SysClk), one ping per update
+	TIM3->PSC = SysClk / Range_Tick_Freq - 1U;
+	TIM3->ARR = Range_Period_us - 1U;
+	TIM3->CCR1 = Range_Trigger_us;
+
+	// CH1 PWM mode 1: high for the first Range_Trigger_us of the period
+	// CH2 input capture on TI2, both edges (CC2P + CC2NP), the pin level tells which one
+	TIM3->CCMR1 = (6U << TIM_CCMR1_OC1M_Pos) | TIM_CCMR1_OC1PE
+			| TIM_CCMR1_CC2S_0 | (Range_Echo_Filter << TIM_CCMR1_IC2F_Pos);
+	TIM3->CCER = TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC2P | TIM_CCER_CC2NP;
+	TIM3->EGR = TIM_EGR_UG;
+	TIM3->SR = 0;
+	TIM3->DIER = TIM_DIER_UIE | TIM_DIER_CC2IE;
+	NVIC_EnableIRQ(TIM3_IRQn);			// Priority: IRQ_Config_Init()
+
+	Range_Enable(Config_Get(Cfg_Range_Guard));
+}
+
+static uint32_t Range_Ticks(uint16_t from, uint16_t to)
+{
+	// Counter steps between two captures, across the period wrap
+	return (to >= from) ? (uint32_t)(to - from) : (uint32_t)to + Range_Period_us - from;
+}
+
+static void Range_Set(Range_State s, uint8_t limit)
+{
+	// Scheduler level: a new gate is applied to the last command at once
+	if (s == state && limit == stats.limit) return;
+
+	if (s != state)
+	{
+		if (s == Range_Clamp) stats.clamps++;
+		if (s == Range_Brake)
+		{
+			stats.brakes++;
+			released = 0;
+		}
+		Trace_Log(Trace_Range, (uint8_t)s, stats.range_mm);
+	}
+	state = s;
+	stats.limit = limit;
+	Drive_Mix_Reapply();
+}
+
+void Range_Enable(bool on)
+{
+	// Range_Init(), Config_Set(Cfg_Range_Guard)
+	IRQ_Scheduler_Lock();
+
+	echo_high = 0;
+	valid = 0;
+	closing = 0;
+	missed = 0;
+	if (on)
+	{
+		TIM3->CNT = 0;
+		TIM3->CR1 |= TIM_CR1_CEN;
+		Range_Set(Range_Lost, 100);		// Until the first echo
+	}
+	else
+	{
+		TIM3->CR1 &= ~TIM_CR1_CEN;
+		Range_Set(Range_Off, 100);
+	}
+
+	IRQ_Scheduler_Unlock();
+}
+
+static void Range_Measured(uint32_t echo_us)
+{
+	uint32_t mm = echo_us * Range_Sound_mm_per_ms / 2000U;
+	if (mm > Range_Max_mm) mm = Range_Max_mm;
+
+	// Closing speed from ping to ping, averaged over two; a jump is another target, speed unknown
+	int32_t v = ((int32_t)stats.range_mm - (int32_t)mm) * 1000 / (int32_t)Range_Period_ms;
+	if (valid == 0 || v > Range_Max_Closing || v < -Range_Max_Closing)
+	{
+		closing = 0;
+		valid = 1;
+	}
+	else
+	{
+		closing = (valid == 1) ? v : (closing + v) / 2;
+		valid = 2;
+	}
+
+	uint32_t ttc = (closing > 0 && mm < Range_Max_mm) ? mm * 1000U / (uint32_t)closing : Range_TTC_None;
+	if (ttc > Range_TTC_None) ttc = Range_TTC_None;
+
+	stats.echoes++;
+	stats.range_mm = (uint16_t)mm;
+	stats.closing_mm_s = (int16_t)closing;
+	stats.ttc_ms = (uint16_t)ttc;
+
+	uint32_t stop_mm = Config_Get(Cfg_Range_Stop_mm);
+	uint32_t brake_ttc = Config_Get(Cfg_Range_TTC_ms);
+	uint32_t clamp_ttc = brake_ttc * Range_Clamp_Factor;
+
+	// The brake holds until forward is let go and the gap has opened again
+	if (mm <= stop_mm || ttc <= brake_ttc
+			|| (state == Range_Brake && (!released || mm <= stop_mm + Range_Release_mm)))
+		Range_Set(Range_Brake, 0);
+	else if (ttc < clamp_ttc)
+		Range_Set(Range_Clamp, (uint8_t)((ttc - brake_ttc) * 100U / (clamp_ttc - brake_ttc)));
+	else
+		Range_Set(Range_Clear, 100);
+}
+
+void TIM3_IRQHandler(void)
+{
+	uint32_t sr = TIM3->SR;
+	IRQ_Measure_Enter(IRQ_Slot_TIM3, Range_Ticks((sr & TIM_SR_CC2IF) ? (uint16_t)TIM3->CCR2 : 0,
+			Range_Count()) * (SysClk / Range_Tick_Freq));		// Cycles since the capture (or the update)
+
+	TIM3->SR = ~(sr & (TIM_SR_UIF | TIM_SR_CC2IF));
+
+	if (sr & TIM_SR_CC2IF)
+	{
+		uint16_t t = (uint16_t)TIM3->CCR2;
+		if (GPIOA->IDR & (1U << Range_Echo))
+		{
+			rise_t = t;
+			echo_high = 1;
+		}
+		else if (echo_high)
+		{
+			// Falling edge: range, closing speed, gate; latency counted to the drive output written
+			echo_high = 0;
+			missed = 0;
+			Range_Measured(Range_Ticks(rise_t, t));
+
+			uint32_t latency = Range_Ticks(t, Range_Count());
+			if (latency > stats.latency_max_us) stats.latency_max_us = latency;
+		}
+	}
+
+	if (sr & TIM_SR_UIF)
+	{
+		// New trigger pulse: the sensor answers every ping, even with nothing ahead
+		if (missed < Range_Stale_Pings) missed++;
+		else
+		{
+			echo_high = 0;
+			valid = 0;
+			Range_Set(Range_Lost, 100);
+		}
+	}
+
+	IRQ_Measure_Exit(IRQ_Slot_TIM3);
+}
+
+void Range_Gate(uint8_t *Throttle, uint8_t *Dir)
+{
+	// Drive_Mix_Output(), scheduler level or locked: the command asked for -> the command allowed
+	// Reverse and brake pass, the car can always back away
+	if (*Dir != 1 || *Throttle == 0) released = 1;
+
+	if (state == Range_Brake && (*Dir == 1 || *Dir == 0))
+	{
+		*Throttle = (uint8_t)Config_Get(Cfg_Brake_Force);
+		*Dir = Drive_Dir_Brake;
+	}
+	else if (state == Range_Clamp && *Dir == 1 && *Throttle > stats.limit)
+	{
+		*Throttle = stats.limit;
+	}
+}
+
+Range_State Range_Get_State(void)
+{
+	return (Range_State)state;
+}
+
+const Range_Stats *Range_Get_Stats(void)
+{
+	return &stats;
+}
+
+void Range_Send_Status(void)
+{
+	// <A,state,range_mm,closing_mm_s,ttc_ms,limit,clamps,brakes,latency_max_us>
+	Link_Send_Str("<A,");
+	Link_Send_Uint(state);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.range_mm);
+	Link_Send_Char(',');
+	Link_Send_Int(stats.closing_mm_s);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.ttc_ms);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.limit);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.clamps);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.brakes);
+	Link_Send_Char(',');
+	Link_Send_Uint(stats.latency_max_us);
+	Link_Send_Str(">\r\n");
+}
@@ -0,0 +1,44 @@
+#include "main.h"
+#include "sched.h"
+#include "irq_config.h"
+#include "imu.h"
+#include "drive_mix.h"
+
+static volatile uint32_t sched_ticks = 0;	// ms since Sched_Init()
+
+void Sched_Init(void)
+{
+	// Not SysTick_Config(): it would overwrite the priority set by IRQ_Config_Init()
+	SysTick->LOAD = (SysClk / Sched_Tick_Freq) - 1;	// Reload
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;	// Core clock
+}
+
+void SysTick_Handler(void)
+{
+	IRQ_Measure_Enter(IRQ_Slot_SysTick, SysTick->LOAD - SysTick->VAL);	// Cycles since reload
+	sched_ticks++;
+	IMU_Tick();				// Starts the next gyro read, the transfer runs on I2C1 / DMA1 interrupts
+	Drive_Mix_Tick();		// Brake-then-reverse timing
+	IRQ_Measure_Exit(IRQ_Slot_SysTick);
+}
+
+uint32_t Sched_Millis(void)
+{
+	return sched_ticks;
+}
+
+bool Sched_Every(uint32_t *next_ms, uint32_t period_ms)
+{
+	// True once per period, wrap safe
+	uint32_t now = sched_ticks;
+
+	if ((int32_t)(now - *next_ms) < 0)
+		return 0;
+
+	*next_ms += period_ms;
+	if ((int32_t)(now - *next_ms) >= 0)		// Fell behind, skip missed periods
+		*next_ms = now + period_ms;
+
+	return 1;
+}
@@ -0,0 +1,81 @@
+#include "main.h"
+#include "setpoint.h"
+#include "sched.h"
+#include "trace.h"
+
+static Setpoint queue[Setpoint_Queue_Size];
+static uint8_t q_head = 0;			// Next to apply
+static uint8_t q_tail = 0;			// Next free slot
+static bool anchored = 0;
+static int32_t offset_ms = 0;		// local = sender + offset
+static uint32_t last_activity_ms = 0;
+static uint32_t dropped = 0;
+
+static uint8_t Setpoint_Count(void)
+{
+	return (uint8_t)((q_tail - q_head) & (Setpoint_Queue_Size - 1));
+}
+
+void Setpoint_Queue_Push(uint32_t sender_ms, uint16_t steer, uint8_t throttle, uint8_t dir)
+{
+	uint32_t now = Sched_Millis();
+
+	// New stream: anchor the sender clock so this frame plays Setpoint_Lead_ms from now
+	if (!anchored || (Setpoint_Count() == 0 && (now - last_activity_ms) > Setpoint_Resync_ms))
+	{
+		offset_ms = (int32_t)(now + Setpoint_Lead_ms - sender_ms);
+		anchored = 1;
+	}
+	last_activity_ms = now;
+
+	uint32_t due = sender_ms + (uint32_t)offset_ms;
+
+	// Must be in order and not hopelessly late, and there must be room
+	bool late = (int32_t)(now - due) > Setpoint_Late_ms;
+	bool out_of_order = Setpoint_Count() && (int32_t)(due - queue[(q_tail - 1) & (Setpoint_Queue_Size - 1)].due_ms) < 0;
+	bool full = Setpoint_Count() == Setpoint_Queue_Size - 1;
+
+	if (late || out_of_order || full)
+	{
+		dropped++;
+		Trace_Log(Trace_Setpoint_Drop, (uint8_t)(late | (out_of_order << 1) | (full << 2)), (uint16_t)sender_ms);
+		return;
+	}
+
+	Setpoint *sp = &queue[q_tail];
+	sp->due_ms = due;
+	sp->steer = steer;
+	sp->throttle = throttle;
+	sp->dir = dir;
+	q_tail = (q_tail + 1) & (Setpoint_Queue_Size - 1);
+}
+
+bool Setpoint_Queue_Poll(uint16_t *steer, uint8_t *throttle, uint8_t *dir)
+{
+	// Returns the newest setpoint that has come due, skipping any older ones also due
+	uint32_t now = Sched_Millis();
+	bool ready = 0;
+
+	while (q_head != q_tail && (int32_t)(now - queue[q_head].due_ms) >= 0)
+	{
+		*steer = queue[q_head].steer;
+		*throttle = queue[q_head].throttle;
+		*dir = queue[q_head].dir;
+		q_head = (q_head + 1) & (Setpoint_Queue_Size - 1);
+		last_activity_ms = now;
+		ready = 1;
+	}
+
+	return ready;
+}
+
+void Setpoint_Queue_Flush(void)
+{
+	q_head = q_tail;
+	anchored = 0;
+}
+
+uint32_t Setpoint_Dropped(void)
+{
+	return dropped;
+}
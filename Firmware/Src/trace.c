@@ -0,0 +1,99 @@
+#include "main.h"
+#include "trace.h"
+#include "link.h"
+#include <string.h>
+
+static Trace_Record trace_ring[Trace_Depth];
+static volatile uint32_t trace_head = 0;		// Total events ever logged
+static volatile uint8_t trace_paused = 0;		// Set while the ring is being dumped
+static uint32_t dump_next, dump_end;			// Dump in progress: next record, head at the request
+static uint16_t dump_count;
+static bool dump_header;						// Header still to send
+
+void Trace_Init(void)
+{
+	// DWT cycle counter as the event timestamp, counting since reset (SystemInit)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	Trace_Log(Trace_Boot, 0, (uint16_t)(RCC->CSR >> 16));
+	RCC->CSR |= RCC_CSR_RMVF;		// Clear reset flags for the next boot
+}
+
+void Trace_Log(uint8_t event, uint8_t a, uint16_t b)
+{
+	// Claim a slot with LDREX/STREX, safe from thread and ISR context without masking
+	uint32_t idx;
+
+	if (trace_paused) return;
+
+	do {
+		idx = __LDREXW(&trace_head);
+	} while (__STREXW(idx + 1, &trace_head));
+
+	Trace_Record *rec = &trace_ring[idx & (Trace_Depth - 1)];
+	rec->cycles = DWT->CYCCNT;
+	rec->event = event;
+	rec->a = a;
+	rec->b = b;
+}
+
+static void Trace_Put_U32(uint8_t *b, uint32_t v)
+{
+	// Little endian
+	b[0] = (uint8_t)v;
+	b[1] = (uint8_t)(v >> 8);
+	b[2] = (uint8_t)(v >> 16);
+	b[3] = (uint8_t)(v >> 24);
+}
+
+bool Trace_Send_Dump(void)
+{
+	// Dump: "TRC1", u32 clock Hz, u32 events logged, u16 count, count * 8 byte records (oldest first)
+	// ~2KB against a 256 byte reply queue: streamed by Trace_Dump_Poll(), the ring paused until it is out
+	if (!Link_Stream_Open()) return 0;
+
+	trace_paused = 1;
+	dump_end = trace_head;
+	dump_count = (dump_end < Trace_Depth) ? (uint16_t)dump_end : Trace_Depth;
+	dump_next = dump_end - dump_count;
+	dump_header = 1;
+
+	Trace_Dump_Poll();
+	return 1;
+}
+
+void Trace_Dump_Poll(void)
+{
+	// Link_Tx_Poll(): as much of the dump as the reply queue takes, never waits
+	uint8_t b[14];
+
+	if (!trace_paused) return;
+
+	if (dump_header)
+	{
+		memcpy(b, Trace_Magic, 4);
+		Trace_Put_U32(&b[4], SysClk);
+		Trace_Put_U32(&b[8], dump_end);
+		b[12] = (uint8_t)(dump_count & 0xFF);
+		b[13] = (uint8_t)(dump_count >> 8);
+		if (!Link_Stream_Write(b, 14)) return;
+		dump_header = 0;
+	}
+
+	while (dump_next != dump_end)
+	{
+		Trace_Record *rec = &trace_ring[dump_next & (Trace_Depth - 1)];
+		Trace_Put_U32(b, rec->cycles);
+		b[4] = rec->event;
+		b[5] = rec->a;
+		b[6] = (uint8_t)(rec->b & 0xFF);
+		b[7] = (uint8_t)(rec->b >> 8);
+		if (!Link_Stream_Write(b, 8)) return;
+		dump_next++;
+	}
+
+	Link_Stream_Close();
+	trace_paused = 0;
+	Trace_Log(Trace_Dump, 0, dump_count);
+}
@@ -0,0 +1,72 @@
+#include "main.h"
+#include "update.h"
+#include "flash.h"
+#include "link.h"
+
+static uint8_t running_slot = Update_No_Slot;
+static bool confirmed = 0;				// This image's confirmed word programmed (or nothing to confirm)
+
+static uint32_t Update_Header_Word(const volatile uint32_t *field)
+{
+	return Flash_Word((uint32_t)field);
+}
+
+void Update_Init(void)
+{
+	// The bootloader points VTOR at the slot's vector table before jumping, 0 when linked at 0x08000000
+	confirmed = 1;
+
+	for (uint8_t slot = 0; slot < Update_Slot_Count; slot++)
+	{
+		if (SCB->VTOR == Update_Slot_Addr(slot) + Update_Header_Size)
+		{
+			const Update_Header *h = (const Update_Header *)Update_Slot_Addr(slot);
+			running_slot = slot;
+			confirmed = Update_Header_Word(&h->confirmed) != Flash_Erased;
+		}
+	}
+}
+
+uint8_t Update_Running_Slot(void)
+{
+	return running_slot;
+}
+
+void Update_Confirm(void)
+{
+	// Link: a frame from the host arrived over USART1, so this image can take the next update
+	if (confirmed) return;
+	confirmed = 1;
+
+	const Update_Header *h = (const Update_Header *)Update_Slot_Addr(running_slot);
+	Flash_Program_Word((uint32_t)&h->confirmed, 0);
+}
+
+void Update_Enter(uint32_t baud)
+{
+	// Reset into the bootloader, USART1 at baud (0: the current rate, auto-baud included)
+	uint32_t brr = baud ? (SysClk + baud / 2) / baud : USART1->BRR;
+
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+	PWR->CR |= PWR_CR_DBP;					// Backup domain write access
+	RTC->BKP1R = brr;
+	RTC->BKP0R = Update_Request_Magic;
+
+	Link_Flush();
+	while (!(USART1->SR & USART_SR_TC)) {}	// Last reply on the wire before the reset
+	NVIC_SystemReset();
+}
+
+void Update_Send_Status(void)
+{
+	// Reply: <U,slot,version,confirmed>, slot 2: no bootloader
+	const Update_Header *h = (const Update_Header *)Update_Slot_Addr(running_slot);
+
+	Link_Send_Str("<U,");
+	Link_Send_Uint(running_slot);
+	Link_Send_Char(',');
+	Link_Send_Uint(running_slot == Update_No_Slot ? 0 : Update_Header_Word(&h->version));
+	Link_Send_Char(',');
+	Link_Send_Uint(confirmed);
+	Link_Send_Str(">\r\n");
+}
@@ -0,0 +1,141 @@
+#include "main.h"
+#include "yaw_ctrl.h"
+#include "imu.h"
+#include "interp.h"
+#include "drive_mix.h"
+#include "config.h"
+#include "link.h"
+
+// Last driver command (Drive_Mix_Apply), the reset state is applied in Car_Init()
+static volatile uint16_t cmd_steer = Drive_Steer_Center * Steer_Scale;
+static volatile uint8_t cmd_thr = 0;
+static volatile uint8_t cmd_dir = 0;
+
+static int32_t bias_q4 = 0;			// Gyro Z zero-rate output, raw counts Q4
+static bool bias_valid = 0;
+static int32_t rate = 0;			// Measured rate, 0.01 deg/s, + right
+static int32_t target = 0;			// Requested rate, 0.01 deg/s, + right
+static int32_t integ_q8 = 0;		// PI integral, 0.01 degree Q8
+static volatile int32_t correction = 0;	// Added to the servo command, 0.01 degree
+static uint16_t servo_out = Drive_Steer_Center * Steer_Scale;
+
+static int32_t Clamp(int32_t v, int32_t lo, int32_t hi)
+{
+	return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+static uint16_t Servo_Steer(void)
+{
+	return (uint16_t)Clamp((int32_t)cmd_steer + correction,
+			(Drive_Steer_Center - Drive_Steer_Span) * Steer_Scale,
+			(Drive_Steer_Center + Drive_Steer_Span) * Steer_Scale);
+}
+
+uint16_t Yaw_Command(uint16_t steer, uint8_t throttle, uint8_t dir)
+{
+	// New driver command: returns the servo steer with the current correction
+	cmd_steer = steer;
+	cmd_thr = throttle;
+	cmd_dir = dir;
+
+	if (dir != 1)
+	{
+		// Stop / reverse: straight pass-through, the controller restarts from zero
+		integ_q8 = 0;
+		correction = 0;
+	}
+
+	servo_out = Servo_Steer();
+	return servo_out;
+}
+
+void Yaw_Frame(void)
+{
+	// Once per servo frame (TIM2 update, IRQ_Prio_Scheduler)
+	int32_t sum;
+	uint16_t count;
+	bool fresh = IMU_Gyro_Take(&sum, &count);
+
+	if (fresh)
+	{
+		int32_t raw_q4 = (sum << 4) / count;		// Mean of the frame's samples
+
+		// Zero-rate offset tracked while stopped
+		if (cmd_dir == 0)
+		{
+			bias_q4 = bias_valid ? bias_q4 + ((raw_q4 - bias_q4) >> Yaw_Bias_Shift) : raw_q4;
+			bias_valid = 1;
+		}
+
+		rate = Yaw_Gyro_Sign * ((raw_q4 - bias_q4) * 1000) / (IMU_Gyro_LSB_x10 << 4);
+	}
+
+	// Requested rate: turn (-256..256) x throttle (speed stand-in) x rate at full lock and throttle
+	int32_t turn = (((int32_t)cmd_steer - Drive_Steer_Center * Steer_Scale) * 256) / (Drive_Steer_Span * Steer_Scale);
+	target = (turn * cmd_thr * (int32_t)Config_Get(Cfg_Yaw_Full_Rate)) >> 8;
+
+	bool active = fresh && Config_Get(Cfg_Yaw_Stab) && IMU_Get_State() == IMU_Running
+			&& cmd_dir == 1 && cmd_thr >= Yaw_Min_Throttle && Drive_Mix_GetProfile() != Drive_Differential;
+
+	if (!active)
+	{
+		integ_q8 = 0;
+		correction = 0;
+	}
+	else
+	{
+		// Turning faster than asked (oversteer): err < 0, steer back toward straight
+		int32_t err = target - rate;
+		int32_t limit_q8 = Yaw_Max_Correction << 8;
+
+		integ_q8 += (int32_t)(((int64_t)Config_Get(Cfg_Yaw_Ki) * err * Interp_Frame_ms * 256) / 100000);
+		integ_q8 = Clamp(integ_q8, -limit_q8, limit_q8);
+
+		int32_t p = (int32_t)(((int64_t)Config_Get(Cfg_Yaw_Kp) * err) / 100);
+		correction = Clamp(p + (integ_q8 >> 8), -Yaw_Max_Correction, Yaw_Max_Correction);
+	}
+
+	uint16_t servo = Servo_Steer();
+	if (servo != servo_out && Drive_Mix_GetProfile() != Drive_Differential)
+	{
+		servo_out = servo;
+		Servo_TIM2_PWM_SetAngleFine(servo);
+	}
+}
+
+int32_t Yaw_Rate(void)
+{
+	return rate;
+}
+
+int32_t Yaw_Target(void)
+{
+	return target;
+}
+
+int32_t Yaw_Correction(void)
+{
+	return correction;
+}
+
+void Yaw_Send_Status(void)
+{
+	// Reply: <Y,rate,target,correction,imu_state,samples,errors,timeouts>
+	const IMU_Stats *s = IMU_Get_Stats();
+
+	Link_Send_Str("<Y,");
+	Link_Send_Int(rate);
+	Link_Send_Char(',');
+	Link_Send_Int(target);
+	Link_Send_Char(',');
+	Link_Send_Int(correction);
+	Link_Send_Char(',');
+	Link_Send_Uint(IMU_Get_State());
+	Link_Send_Char(',');
+	Link_Send_Uint(s->samples);
+	Link_Send_Char(',');
+	Link_Send_Uint(s->errors);
+	Link_Send_Char(',');
+	Link_Send_Uint(s->timeouts);
+	Link_Send_Str(">\r\n");
+}
@@ -0,0 +1,106 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Host simulator: the firmware (Firmware/Src) runs unchanged against RAM peripherals (stm32f4xx.h),
+// stepped in 1 ms slices, driving a motor / battery / bicycle vehicle model
+#define Sim_Step_us			1000U		// Simulation slice, one main loop pass per slice
+#define Sim_Uart_Ports		2			// USART1 (HC-05), USART2 (wired)
+#define Sim_Mcu_Slowdown	100.0		// The 25 MHz core against one host core, for handler run times
+
+// What the firmware drives, read back from the peripheral registers each slice
+typedef struct
+{
+	double duty[4];			// Wheel PWM 0..1 (TIM1 CH1, CH2N, CH3N, CH4)
+	int8_t dir[4];			// +1 forward, -1 reverse, 0 coast, 2 brake (both inputs high)
+	double servo_us;		// TIM2 CH1 pulse, 0 = no pulses
+	uint8_t profile;		// Drive_Profile
+} Sim_Outputs;
+
+// What the firmware measures, written into the ADC / DMA registers each slice
+typedef struct
+{
+	double batt_V;			// Pack voltage at the divider
+	double motor_A_peak;	// Wheel 0 winding current during the on-time (injected ADC)
+	double motor_A_avg;		// Sense resistor current averaged over the PWM period (regular ADC)
+	double yaw_rate_dps;	// Body yaw rate, counter-clockwise positive (IMU gyro Z, face up)
+	double range_m;			// Ultrasonic sensor to the obstacle ahead (TIM3 echo), < 0 nothing in the beam
+} Sim_Sensors;
+
+// Switching within one TIM1 period (sim_hw.c), from the waveform the registers produce
+typedef struct
+{
+	double supply_mean_A;		// Bridge supply current, period average
+	double supply_ripple_A;		// ... RMS around it
+	double supply_step_A;		// Largest net supply current change in one timer tick
+	double sample_noise_mA;		// Edge ringing left at the injected ADC sample, -1 no sample
+} Sim_Pwm_Stats;
+
+// Vehicle parameters, see sim_vehicle.c for the defaults
+typedef struct
+{
+	double mass_kg;
+	double wheelbase_m;
+	double track_m;
+	double wheel_r_m;
+	double gear;			// Motor turns per wheel turn
+	double gear_eff;
+	double motor_R;			// Winding resistance (ohm)
+	double motor_K;			// Back-EMF / torque constant (V.s/rad = N.m/A)
+	double bridge_drop_V;	// L298N saturation, both transistors
+	double batt_full_V;
+	double batt_empty_V;
+	double batt_R;			// Internal resistance (ohm)
+	double batt_mAh;
+	double crr;				// Rolling resistance coefficient
+	double drag;			// Viscous drag (N per m/s)
+	double max_lock_deg;	// Wheel angle at full servo span
+	double servo_min_us;	// Physical servo: 0 degree pulse
+	double servo_max_us;	// Physical servo: 180 degree pulse
+	double servo_slew_dps;	// Servo slew rate (deg/s)
+	double oversteer_v_mps;	// Critical speed: yaw gain 1 / (1 - (v / v_crit)^2) over kinematic
+	double yaw_tau_s;		// Yaw rate lag behind the steady state
+	double gyro_bias_dps;	// IMU zero-rate offset
+	double gyro_noise_dps;	// IMU noise, peak
+	double range_offset_m;	// Ultrasonic sensor ahead of the position (x, y)
+	double range_cone_deg;	// Sensor beam half angle
+} Sim_Vehicle_Params;
+
+typedef struct
+{
+	double x, y;			// m
+	double heading;			// rad, counter-clockwise from +x
+	double yaw_rate;		// rad/s, counter-clockwise
+	double v;				// Forward speed (m/s), left / right side for skid steering
+	double v_left, v_right;
+	double servo_deg;		// Servo horn angle
+	double motor_A[4];		// Winding current per wheel motor
+	double batt_A;			// Pack current
+	double batt_V;			// Pack terminal voltage
+	double used_mAh;
+	double distance_m;
+} Sim_Vehicle;
+
+// sim_hw.c
+void Sim_Hw_Init(void);
+void Sim_Hw_Step(const Sim_Sensors *sensors);
+void Sim_Hw_Imu_Fitted(bool fitted);
+void Sim_Hw_Outputs(Sim_Outputs *out);
+void Sim_Hw_Pwm_Stats(const double amps[4], Sim_Pwm_Stats *s);
+uint32_t Sim_Hw_Stall_Max_ms(void);
+void Sim_Uart_Send(uint8_t port, const char *text);
+void Sim_Uart_Send_Bytes(uint8_t port, const uint8_t *data, size_t n);
+uint64_t Sim_Time_us(void);
+
+// sim_vehicle.c
+extern const Sim_Vehicle_Params Sim_Default_Params;
+void Sim_Vehicle_Init(Sim_Vehicle *car, const Sim_Vehicle_Params *p);
+void Sim_Vehicle_Step(Sim_Vehicle *car, const Sim_Vehicle_Params *p, const Sim_Outputs *out, double dt);
+void Sim_Vehicle_Sensors(const Sim_Vehicle *car, const Sim_Vehicle_Params *p, const Sim_Outputs *out, Sim_Sensors *s);
+double Sim_Vehicle_Wall_Gap(const Sim_Vehicle *car, const Sim_Vehicle_Params *p, double wall_x);
+double Sim_Vehicle_Range(const Sim_Vehicle *car, const Sim_Vehicle_Params *p, double wall_x);
+
+#endif /* SIM_H */
@@ -0,0 +1,777 @@
+#include "main.h"
+#include "drive_mix.h"
+#include "power_monitor.h"
+#include "imu.h"
+#include "failsafe.h"
+#include "range.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// ----------------------------------------------------
+// Peripheral instances (stm32f4xx.h)
+// ----------------------------------------------------
+
+GPIO_TypeDef Sim_GPIOA, Sim_GPIOB, Sim_GPIOC;
+RCC_TypeDef Sim_RCC;
+FLASH_TypeDef Sim_FLASH;
+TIM_TypeDef Sim_TIM1, Sim_TIM2, Sim_TIM3, Sim_TIM4, Sim_TIM5, Sim_TIM9, Sim_TIM10, Sim_TIM11;
+USART_TypeDef Sim_USART1, Sim_USART2, Sim_USART6;
+ADC_TypeDef Sim_ADC1;
+ADC_Common_TypeDef Sim_ADC1_COMMON;
+DMA_TypeDef Sim_DMA1, Sim_DMA2;
+DMA_Stream_TypeDef Sim_DMA1_Stream[8], Sim_DMA2_Stream[8];
+I2C_TypeDef Sim_I2C1;
+IWDG_TypeDef Sim_IWDG;
+EXTI_TypeDef Sim_EXTI;
+SYSCFG_TypeDef Sim_SYSCFG;
+CRC_TypeDef Sim_CRC;
+PWR_TypeDef Sim_PWR;
+RTC_TypeDef Sim_RTC;
+DBGMCU_TypeDef Sim_DBGMCU;
+SysTick_Type Sim_SysTick;
+SCB_Type Sim_SCB;
+DWT_Type Sim_DWT;
+CoreDebug_Type Sim_CoreDebug;
+
+// Firmware interrupt handlers driven by the simulator
+void SysTick_Handler(void);
+void TIM2_IRQHandler(void);
+void TIM3_IRQHandler(void);
+void TIM1_UP_TIM10_IRQHandler(void);
+void ADC_IRQHandler(void);
+void USART1_IRQHandler(void);
+void USART2_IRQHandler(void);
+void I2C1_EV_IRQHandler(void);
+void I2C1_ER_IRQHandler(void);
+void DMA1_Stream0_IRQHandler(void);
+
+// ----------------------------------------------------
+// Core functions: single threaded, interrupts run to completion between main loop passes
+// ----------------------------------------------------
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) {}
+void NVIC_DisableIRQ(IRQn_Type IRQn) {}
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {}
+uint32_t NVIC_GetPriority(IRQn_Type IRQn) { return 0; }
+void NVIC_SetPriorityGrouping(uint32_t PriorityGroup) {}
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {}
+uint32_t NVIC_GetActive(IRQn_Type IRQn) { return 0; }
+
+uint32_t NVIC_EncodePriority(uint32_t PriorityGroup, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	uint32_t sub_bits = (PriorityGroup > 3U) ? PriorityGroup - 3U : 0U;
+	return (PreemptPriority << sub_bits) | (SubPriority & ((1U << sub_bits) - 1U));
+}
+
+void NVIC_SystemReset(void)
+{
+	fprintf(stderr, "sim: firmware requested a system reset at %.3f s\n", Sim_Time_us() / 1e6);
+	exit(2);
+}
+
+uint32_t SysTick_Config(uint32_t ticks)
+{
+	SysTick->LOAD = ticks - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+	return 0;
+}
+
+void __disable_irq(void) {}
+void __enable_irq(void) {}
+uint32_t __get_PRIMASK(void) { return 0; }
+void __set_PRIMASK(uint32_t m) {}
+uint32_t __get_BASEPRI(void) { return 0; }
+void __set_BASEPRI(uint32_t m) {}
+uint32_t __get_IPSR(void) { return 0; }
+void __set_MSP(uint32_t v) {}
+void __DSB(void) {}
+void __ISB(void) {}
+void __DMB(void) {}
+void __WFI(void) {}
+void __NOP(void) {}
+uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr) { *addr = value; return 0; }
+void __CLREX(void) {}
+uint32_t __REV(uint32_t v) { return __builtin_bswap32(v); }
+
+// ----------------------------------------------------
+// Internal flash: configuration sectors 1-2 up to the maneuver sector 7, erased at start
+// ----------------------------------------------------
+
+#define Sim_Flash_Base	0x08004000U
+#define Sim_Flash_Size	0x7C000U
+
+static uint32_t sim_flash[Sim_Flash_Size / 4];
+
+uint32_t *Sim_Flash_Word(uint32_t addr)
+{
+	if (addr < Sim_Flash_Base || addr >= Sim_Flash_Base + Sim_Flash_Size || (addr & 3U))
+	{
+		fprintf(stderr, "sim: flash access outside sectors 1-7: 0x%08X\n", addr);
+		exit(2);
+	}
+	return &sim_flash[(addr - Sim_Flash_Base) / 4];
+}
+
+// ----------------------------------------------------
+// UART receive: text queued by the script, delivered at the programmed baud rate
+// UART transmit: DR takes a byte once the previous one is on the wire, at the same rate
+// ----------------------------------------------------
+
+#define Sim_Tx_Spin_Polls	16		// TXE polls in one slice that count as a busy wait
+
+static void Sim_Hw_Stall(void);
+
+typedef struct
+{
+	USART_TypeDef *uart;
+	void (*isr)(void);
+	char *buf;
+	size_t len, pos, cap;
+	uint64_t next_us;			// Earliest time for the next byte
+	uint64_t tx_free_us;		// Transmitter done with the bytes written so far
+	uint32_t tx_polls;			// Not ready answers in this slice
+} Sim_Uart;
+
+static Sim_Uart sim_uart[Sim_Uart_Ports] =
+{
+	{ USART1, USART1_IRQHandler, NULL, 0, 0, 0, 0, 0, 0 },
+	{ USART2, USART2_IRQHandler, NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+static uint64_t sim_us = 0;				// Simulated time since reset
+static uint64_t servo_frame_us = 0;		// Time into the current TIM2 period
+static bool current_trip = 0;			// Injected ADC cut the CH1 on-time in this slice
+
+uint64_t Sim_Time_us(void)
+{
+	return sim_us;
+}
+
+void Sim_Uart_Send(uint8_t port, const char *text)
+{
+	Sim_Uart_Send_Bytes(port, (const uint8_t *)text, strlen(text));
+}
+
+void Sim_Uart_Send_Bytes(uint8_t port, const uint8_t *data, size_t n)
+{
+	Sim_Uart *u = &sim_uart[port];
+
+	if (u->len == 0 && u->next_us < sim_us) u->next_us = sim_us;	// Line idle until now
+
+	if (u->len + n > u->cap)
+	{
+		u->cap = (u->len + n) * 2 + 64;
+		u->buf = realloc(u->buf, u->cap);
+	}
+	memcpy(u->buf + u->len, data, n);
+	u->len += n;
+}
+
+static uint64_t Sim_Uart_Byte_us(const Sim_Uart *u)
+{
+	// 10 bits per byte (8N1)
+	return (10ULL * 1000000ULL * u->uart->BRR) / SysClk;
+}
+
+static Sim_Uart *Sim_Uart_Of(USART_TypeDef *uart)
+{
+	return (uart == USART1) ? &sim_uart[0] : &sim_uart[1];
+}
+
+bool Sim_Uart_Tx_Ready(USART_TypeDef *uart)
+{
+	// TXE: the firmware runs at the start of the slice, DR is free if the byte before is out within it
+	Sim_Uart *u = Sim_Uart_Of(uart);
+	uint32_t cr1 = uart->CR1;
+	if (!(cr1 & USART_CR1_UE) || !(cr1 & USART_CR1_TE) || uart->BRR == 0) return 1;
+	if (u->tx_free_us < sim_us + Sim_Step_us) return 1;
+
+	// Polled over and over within one slice: the firmware is spinning on TXE, time runs on without it
+	if (++u->tx_polls > Sim_Tx_Spin_Polls) Sim_Hw_Stall();
+	return 0;
+}
+
+void Sim_Uart_Tx_Write(USART_TypeDef *uart, uint32_t c)
+{
+	Sim_Uart *u = Sim_Uart_Of(uart);
+	if (u->tx_free_us < sim_us) u->tx_free_us = sim_us;
+	if (uart->BRR) u->tx_free_us += Sim_Uart_Byte_us(u);
+	uart->DR = c;
+}
+
+static void Sim_Uart_Step(Sim_Uart *u)
+{
+	u->tx_polls = 0;
+
+	uint32_t cr1 = u->uart->CR1;
+	if (!(cr1 & USART_CR1_UE) || !(cr1 & USART_CR1_RE) || u->uart->BRR == 0) return;
+
+	uint64_t byte_us = Sim_Uart_Byte_us(u);
+
+	while (u->pos < u->len && u->next_us + byte_us <= sim_us)
+	{
+		u->next_us += byte_us;
+		u->uart->DR = (uint8_t)u->buf[u->pos++];
+		u->uart->SR |= USART_SR_RXNE;
+		if (cr1 & USART_CR1_RXNEIE) u->isr();
+		u->uart->SR &= ~USART_SR_RXNE;
+	}
+
+	if (u->pos == u->len) u->pos = u->len = 0;
+}
+
+// ----------------------------------------------------
+// I2C1 + DMA1 Stream0 with an MPU-6050 at IMU_Addr: each transfer the firmware starts runs to
+// completion within the slice, one event interrupt per bus step, as the peripheral would raise them
+// ----------------------------------------------------
+
+#define Sim_DR_Empty	0x100U		// Not a byte: the handler wrote nothing to DR
+
+static uint8_t mpu_regs[128];
+static uint8_t mpu_ptr = 0;
+static bool mpu_fitted = 1;
+
+static void Sim_Mpu_Reset(void)
+{
+	memset(mpu_regs, 0, sizeof(mpu_regs));
+	mpu_regs[MPU_PWR_MGMT_1] = 0x40;		// Sleep
+	mpu_regs[MPU_WHO_AM_I] = IMU_Addr;
+}
+
+static void Sim_Mpu_Write(uint8_t reg, uint8_t value)
+{
+	if (reg == MPU_PWR_MGMT_1 && (value & MPU_PWR_RESET))
+		Sim_Mpu_Reset();
+	else if (reg < sizeof(mpu_regs) && reg != MPU_WHO_AM_I)
+		mpu_regs[reg] = value;
+}
+
+static void Sim_Mpu_Gyro(double rate_dps)
+{
+	// Z only, at the configured full scale, while awake
+	double lsb = 131.0 / (1 << ((mpu_regs[MPU_GYRO_CONFIG] >> 3) & 3U));
+	double raw = (mpu_regs[MPU_PWR_MGMT_1] & 0x40) ? 0.0 : rate_dps * lsb;
+	int16_t z = (int16_t)((raw > 32767) ? 32767 : (raw < -32768) ? -32768 : raw);
+	mpu_regs[MPU_GYRO_XOUT_H + 4] = (uint8_t)((uint16_t)z >> 8);
+	mpu_regs[MPU_GYRO_XOUT_H + 5] = (uint8_t)z;
+}
+
+void Sim_Hw_Imu_Fitted(bool fitted)
+{
+	mpu_fitted = fitted;
+}
+
+static void Sim_I2C_Event(uint32_t sr1, uint32_t sr2)
+{
+	I2C1->SR1 = sr1;
+	I2C1->SR2 = sr2;
+	if (I2C1->CR2 & I2C_CR2_ITEVTEN) I2C1_EV_IRQHandler();
+	I2C1->SR1 = 0;
+}
+
+static void Sim_I2C_Step(void)
+{
+	// A repeated start loops back here, the guard bounds a handler that never stops
+	for (uint8_t guard = 0; guard < 8 && (I2C1->CR1 & I2C_CR1_PE) && (I2C1->CR1 & I2C_CR1_START); guard++)
+	{
+		I2C1->CR1 &= ~I2C_CR1_START;
+		I2C1->DR = Sim_DR_Empty;
+		Sim_I2C_Event(I2C_SR1_SB, I2C_SR2_MSL | I2C_SR2_BUSY);
+		uint32_t addr = I2C1->DR;
+
+		if (addr == Sim_DR_Empty || (addr >> 1) != IMU_Addr || !mpu_fitted)
+		{
+			// No device: address NACK
+			I2C1->SR1 = I2C_SR1_AF;
+			if (I2C1->CR2 & I2C_CR2_ITERREN) I2C1_ER_IRQHandler();
+			I2C1->SR1 = 0;
+		}
+		else if (addr & 1U)
+		{
+			// Read: DMA takes NDTR bytes from the register pointer
+			Sim_I2C_Event(I2C_SR1_ADDR, I2C_SR2_MSL | I2C_SR2_BUSY);
+			DMA_Stream_TypeDef *s = DMA1_Stream0;
+			if ((I2C1->CR2 & I2C_CR2_DMAEN) && (s->CR & DMA_SxCR_EN) && s->M0AR)
+			{
+				volatile uint8_t *dst = (volatile uint8_t *)(uintptr_t)s->M0AR;
+				for (; s->NDTR; s->NDTR--)
+					*dst++ = mpu_regs[mpu_ptr++ & 0x7FU];
+				s->CR &= ~DMA_SxCR_EN;
+				DMA1->LISR |= DMA_LISR_TCIF0;
+				if (s->CR & DMA_SxCR_TCIE) DMA1_Stream0_IRQHandler();
+				DMA1->LISR = 0;
+			}
+		}
+		else
+		{
+			// Write: register pointer, then data, until the handler sets START or STOP
+			I2C1->DR = Sim_DR_Empty;
+			Sim_I2C_Event(I2C_SR1_ADDR, I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+			bool first = 1;
+			while (I2C1->DR != Sim_DR_Empty && !(I2C1->CR1 & (I2C_CR1_START | I2C_CR1_STOP)))
+			{
+				uint8_t byte = (uint8_t)I2C1->DR;
+				if (first) mpu_ptr = byte;
+				else Sim_Mpu_Write(mpu_ptr++ & 0x7FU, byte);
+				first = 0;
+				I2C1->DR = Sim_DR_Empty;
+				Sim_I2C_Event(I2C_SR1_TXE | I2C_SR1_BTF, I2C_SR2_MSL | I2C_SR2_BUSY | I2C_SR2_TRA);
+			}
+		}
+
+		I2C1->CR1 &= ~I2C_CR1_STOP;
+	}
+}
+
+// ----------------------------------------------------
+// Hardware step
+// ----------------------------------------------------
+
+// Ultrasonic rangefinder: a ping on each TIM3 update (CH1 trigger), both echo edges captured on CH2
+#define Sim_Echo_Delay_us	460.0		// Trigger to echo rising: 40kHz burst and sensor processing
+#define Sim_Echo_None_us	38000.0		// Echo pulse with nothing in range
+#define Sim_Sound_mps		343.0
+
+static int64_t echo_rise = -1, echo_fall = -1;	// Pending edges, TIM3 ticks into the period
+
+// Handler run time: the counter keeps going while TIM3_IRQHandler() runs, by the host CPU time it
+// takes scaled to the 25 MHz core (less the cost of reading the clock)
+// A host context switch in between disturbs the caches: that reading counts no run time
+static uint64_t tim3_isr_ns = 0;		// Thread CPU time at the handler call
+static long tim3_isr_switches = 0;		// Involuntary context switches by then
+static uint64_t clock_read_ns = 0;
+
+static long Sim_Cpu_Switches(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_nivcsw;
+}
+
+static uint64_t Sim_Cpu_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void Sim_Tim3_Isr(void)
+{
+	if (clock_read_ns == 0)
+	{
+		clock_read_ns = UINT64_MAX;
+		for (uint8_t i = 0; i < 16; i++)
+		{
+			uint64_t t0 = Sim_Cpu_ns(), t1 = Sim_Cpu_ns();
+			if (t1 - t0 < clock_read_ns) clock_read_ns = t1 - t0;
+		}
+	}
+	tim3_isr_switches = Sim_Cpu_Switches();
+	tim3_isr_ns = Sim_Cpu_ns();
+	TIM3_IRQHandler();
+}
+
+uint16_t Sim_Range_Count(void)
+{
+	uint64_t ns = Sim_Cpu_ns() - tim3_isr_ns;
+	ns = (ns > clock_read_ns && Sim_Cpu_Switches() == tim3_isr_switches) ? ns - clock_read_ns : 0;
+
+	double tick_us = (TIM3->PSC + 1.0) * 1e6 / SysClk;
+	uint64_t ticks = (uint64_t)(ns * Sim_Mcu_Slowdown / 1000.0 / tick_us);
+	return (uint16_t)((TIM3->CNT + ticks) % (TIM3->ARR + 1));
+}
+
+static void Sim_Tim3_Capture(uint32_t tick, bool high)
+{
+	// Edge at tick: captured into CCR2, the handler entered at once (nothing else runs in between)
+	TIM3->CNT = tick;
+	TIM3->CCR2 = tick;
+	if (high) GPIOA->IDR |= 1U << Range_Echo;
+	else GPIOA->IDR &= ~(1U << Range_Echo);
+	TIM3->SR |= TIM_SR_CC2IF;
+	if (TIM3->DIER & TIM_DIER_CC2IE) Sim_Tim3_Isr();
+}
+
+static void Sim_Range_Step(double range_m)
+{
+	if (!(TIM3->CR1 & TIM_CR1_CEN)) return;
+
+	uint32_t period = TIM3->ARR + 1;
+	double tick_us = (TIM3->PSC + 1.0) * 1e6 / SysClk;
+	uint32_t end = TIM3->CNT + (uint32_t)(Sim_Step_us / tick_us + 0.5);
+
+	for (;;)
+	{
+		// Next event in this slice: the pending echo edge, else the update
+		int64_t edge = (echo_rise >= 0) ? echo_rise : echo_fall;
+		uint32_t next = (edge >= 0 && edge < period) ? (uint32_t)edge : period;
+		if (next > end) break;
+
+		if (next == period)
+		{
+			end -= period;
+			TIM3->CNT = 0;
+			TIM3->SR |= TIM_SR_UIF;
+			if (TIM3->DIER & TIM_DIER_UIE) Sim_Tim3_Isr();
+			if ((TIM3->CCER & TIM_CCER_CC1E) && TIM3->CCR1)
+			{
+				// Trigger pulse out, the sensor answers after its burst
+				double echo_us = (range_m < 0) ? Sim_Echo_None_us : 2.0 * range_m / Sim_Sound_mps * 1e6;
+				echo_rise = (int64_t)((TIM3->CCR1 * tick_us + Sim_Echo_Delay_us) / tick_us);
+				echo_fall = echo_rise + (int64_t)(echo_us / tick_us + 0.5);
+			}
+			continue;
+		}
+
+		bool rising = echo_rise >= 0;
+		if (rising) echo_rise = -1;
+		else echo_fall = -1;
+		Sim_Tim3_Capture(next, rising);
+	}
+	TIM3->CNT = end;
+}
+
+// IWDG: counts down at nominal LSI once configured, a missed refresh ends the run like a reset
+static uint64_t iwdg_left_us = 0;
+
+static void Sim_Iwdg_Step(void)
+{
+	if (IWDG->RLR == 0) return;		// Not started
+	if (IWDG->KR == Watchdog_Key_Reload)
+	{
+		iwdg_left_us = (uint64_t)(IWDG->RLR + 1) * (4U << IWDG->PR) * 1000000ULL / LSI_Freq;
+		IWDG->KR = 0;
+	}
+	else if (iwdg_left_us <= Sim_Step_us)
+	{
+		fprintf(stderr, "sim: IWDG expired (main loop not refreshing) at %.3f s\n", Sim_Time_us() / 1e6);
+		exit(2);
+	}
+	else iwdg_left_us -= Sim_Step_us;
+}
+
+static uint16_t Sim_ADC_Counts(double volts)
+{
+	double counts = volts / (ADC_Vref_mV / 1000.0) * ADC_Full_Scale;
+	return (uint16_t)((counts < 0) ? 0 : (counts > ADC_Full_Scale) ? ADC_Full_Scale : counts + 0.5);
+}
+
+void Sim_Hw_Init(void)
+{
+	// Clocks lock immediately, TC stays set (transmit timing: Sim_Uart_Tx_Ready())
+	RCC->CR = RCC_CR_HSION | RCC_CR_HSIRDY | RCC_CR_HSERDY;
+	RCC->CFGR = RCC_CFGR_SWS_HSE;
+	RCC->CSR = RCC_CSR_PORRSTF;
+	USART1->SR = USART_SR_TXE | USART_SR_TC;
+	USART2->SR = USART_SR_TXE | USART_SR_TC;
+	FLASH->CR = FLASH_CR_LOCK;
+	memset(sim_flash, 0xFF, sizeof(sim_flash));
+	Sim_Mpu_Reset();
+}
+
+// Busy wait in the firmware: the hardware runs on slice by slice (timers, interrupts, IWDG),
+// the main loop and the vehicle wait for it to return
+static Sim_Sensors stall_sensors;			// Sensors of the slice the wait started in
+static bool stalled = 0;
+static uint32_t stall_ms = 0, stall_max_ms = 0;
+
+static void Sim_Hw_Slice(const Sim_Sensors *sensors);
+
+static void Sim_Hw_Stall(void)
+{
+	if (stalled) return;		// Interrupt sending from within the wait
+	stalled = 1;
+	if (++stall_ms > stall_max_ms) stall_max_ms = stall_ms;
+	Sim_Hw_Slice(&stall_sensors);
+	stalled = 0;
+}
+
+uint32_t Sim_Hw_Stall_Max_ms(void)
+{
+	return stall_max_ms;
+}
+
+void Sim_Hw_Step(const Sim_Sensors *sensors)
+{
+	stall_sensors = *sensors;
+	stall_ms = 0;
+	Sim_Hw_Slice(sensors);
+}
+
+static void Sim_Hw_Slice(const Sim_Sensors *sensors)
+{
+	sim_us += Sim_Step_us;
+	DWT->CYCCNT += (SysClk / 1000000U) * Sim_Step_us;
+
+	Sim_Iwdg_Step();
+
+	for (uint8_t port = 0; port < Sim_Uart_Ports; port++)
+		Sim_Uart_Step(&sim_uart[port]);
+
+	// ADC1 regular scan, DMA2 Stream0 into the firmware ring (host build is non-PIE, addresses fit 32 bits)
+	if ((ADC1->CR2 & ADC_CR2_ADON) && (DMA2_Stream0->CR & DMA_SxCR_EN) && DMA2_Stream0->M0AR)
+	{
+		volatile uint16_t *ring = (volatile uint16_t *)(uintptr_t)DMA2_Stream0->M0AR;
+		uint16_t batt = Sim_ADC_Counts(sensors->batt_V / Batt_Divider_Ratio);
+		uint16_t motor = Sim_ADC_Counts(sensors->motor_A_avg * Motor_Sense_mOhm / 1000.0);
+
+		for (uint32_t i = 0; i + 1 < DMA2_Stream0->NDTR; i += Power_ADC_Channels)
+		{
+			ring[i] = batt;
+			ring[i + 1] = motor;
+		}
+	}
+
+	// Injected conversion at mid on-time (TIM1 CC4), once per slice, then the TIM1 update
+	if ((ADC1->CR2 & ADC_CR2_ADON) && (ADC1->CR1 & ADC_CR1_JEOCIE) && TIM1->CCR1)
+	{
+		ADC1->JDR1 = Sim_ADC_Counts(sensors->motor_A_peak * Motor_Sense_mOhm / 1000.0);
+		ADC1->SR |= ADC_SR_JEOC;
+		ADC_IRQHandler();
+	}
+	current_trip = ((TIM1->CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos) == 4U;	// Forced inactive
+	if (TIM1->DIER & TIM_DIER_UIE)
+	{
+		TIM1->SR |= TIM_SR_UIF;
+		TIM1_UP_TIM10_IRQHandler();
+	}
+
+	// SysTick (1 ms time base)
+	if ((SysTick->CTRL & SysTick_CTRL_ENABLE_Msk) && (SysTick->CTRL & SysTick_CTRL_TICKINT_Msk))
+		SysTick_Handler();
+
+	// IMU transfer started by the SysTick
+	Sim_Mpu_Gyro(sensors->yaw_rate_dps);
+	Sim_I2C_Step();
+
+	// TIM2 update once per servo frame
+	if (TIM2->CR1 & TIM_CR1_CEN)
+	{
+		uint64_t frame_us = ((uint64_t)(TIM2->ARR + 1) * (TIM2->PSC + 1) * 1000000ULL) / SysClk;
+		servo_frame_us += Sim_Step_us;
+		if (frame_us && servo_frame_us >= frame_us)
+		{
+			servo_frame_us -= frame_us;
+			TIM2->SR |= TIM_SR_UIF;
+			if (TIM2->DIER & TIM_DIER_UIE) TIM2_IRQHandler();
+		}
+		TIM2->CNT = (uint32_t)((servo_frame_us * SysClk) / 1000000ULL / (TIM2->PSC + 1));
+	}
+
+	Sim_Range_Step(sensors->range_m);
+
+	// GPIO set / reset register writes land in ODR
+	GPIO_TypeDef *ports[] = { GPIOA, GPIOB, GPIOC };
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		uint32_t bsrr = ports[i]->BSRR;
+		ports[i]->ODR = (ports[i]->ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFFU);
+		ports[i]->BSRR = 0;
+	}
+}
+
+static int8_t Sim_Dir(uint8_t dc1, uint8_t dc2)
+{
+	uint8_t a = (GPIOB->ODR >> dc1) & 1U;
+	uint8_t b = (GPIOB->ODR >> dc2) & 1U;
+	return (a && b) ? 2 : a ? 1 : b ? -1 : 0;
+}
+
+// ----------------------------------------------------
+// TIM1 waveform: one PWM period as runs of ticks with the same outputs, as the counting mode, OCxM and
+// CCRx produce it, rebuilt only when those registers change
+// ----------------------------------------------------
+
+#define Sim_Pwm_Max_Ticks	10000U		// 100 Hz at the 1 MHz timer clock
+#define Sim_Pwm_Max_Runs	12			// Two edges per channel and a wrap: 9 at most
+#define Sim_Ring_Tau_us		1.0			// Sense line ringing after a switching edge, decay time
+#define Sim_Ring_Gain		0.2			// ... peak, as a fraction of the current switched
+#define Sim_Adc_Window_us	6.72		// Injected sample time, 84 ADC cycles at 12.5 MHz (power_monitor.c)
+
+// Registers the waveform and the sample point follow
+typedef struct
+{
+	uint32_t arr, psc, cr1, bdtr, ccer;
+	uint32_t ccr[4], mode[4];
+	uint32_t adc_cr1, adc_cr2;
+} Sim_Tim1_Regs;
+
+typedef struct
+{
+	uint32_t start, len;		// Ticks into the period
+	uint8_t on;					// Bit per channel (CH1 = bit 0): output active
+} Sim_Pwm_Run;
+
+static Sim_Tim1_Regs pwm_regs;				// Registers the runs were built from
+static bool pwm_built = 0;
+static Sim_Pwm_Run pwm_run[Sim_Pwm_Max_Runs];
+static uint32_t pwm_runs = 0;
+static uint32_t pwm_ticks = 0;				// Ticks in the period
+static int32_t pwm_sample = -1;				// Tick of the CC4 ADC trigger, -1 none
+
+static Sim_Pwm_Stats pwm_stats;				// Last Sim_Hw_Pwm_Stats() result ...
+static double pwm_amps[4];					// ... for these currents
+static bool pwm_stats_valid = 0;
+
+static uint8_t Sim_Tim1_On(const Sim_Tim1_Regs *r, uint32_t t)
+{
+	// Outputs active at tick t: edge-aligned 0..ARR, center-aligned 0..ARR..1
+	const uint32_t enable[4] = { TIM_CCER_CC1E, TIM_CCER_CC2NE, TIM_CCER_CC3NE, TIM_CCER_CC4E };
+	bool run = (r->cr1 & TIM_CR1_CEN) && (r->bdtr & TIM_BDTR_MOE);
+	uint32_t cnt = (t <= r->arr) ? t : 2 * r->arr - t;
+	uint8_t on = 0;
+
+	for (uint8_t ch = 0; ch < 4; ch++)
+	{
+		bool active = (r->mode[ch] == 6U) ? cnt < r->ccr[ch] : (r->mode[ch] == 7U) ? cnt >= r->ccr[ch] : 0;
+		if (run && (r->ccer & enable[ch]) && active) on |= (uint8_t)(1U << ch);
+	}
+	return on;
+}
+
+static int Sim_Tick_Compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void Sim_Tim1_Wave(void)
+{
+	Sim_Tim1_Regs r = {
+		.arr = TIM1->ARR, .psc = TIM1->PSC, .cr1 = TIM1->CR1, .bdtr = TIM1->BDTR, .ccer = TIM1->CCER,
+		.ccr = { TIM1->CCR1, TIM1->CCR2, TIM1->CCR3, TIM1->CCR4 },
+		.mode = {
+			(TIM1->CCMR1 & TIM_CCMR1_OC1M) >> TIM_CCMR1_OC1M_Pos, (TIM1->CCMR1 & TIM_CCMR1_OC2M) >> TIM_CCMR1_OC2M_Pos,
+			(TIM1->CCMR2 & TIM_CCMR2_OC3M) >> TIM_CCMR2_OC3M_Pos, (TIM1->CCMR2 & TIM_CCMR2_OC4M) >> TIM_CCMR2_OC4M_Pos },
+		.adc_cr1 = ADC1->CR1, .adc_cr2 = ADC1->CR2 };
+
+	if (pwm_built && memcmp(&r, &pwm_regs, sizeof(r)) == 0) return;
+	pwm_regs = r;
+	pwm_built = 1;
+	pwm_stats_valid = 0;
+
+	bool center = (r.cr1 & TIM_CR1_CMS) != 0;
+	pwm_ticks = center ? 2 * r.arr : r.arr + 1;
+	if (pwm_ticks > Sim_Pwm_Max_Ticks) pwm_ticks = Sim_Pwm_Max_Ticks;
+	if (pwm_ticks == 0) pwm_ticks = 1;
+
+	// The outputs can only change where the counter meets a CCR: counting up at CCR, down one tick later
+	uint32_t edge[10];
+	uint8_t n = 0;
+	edge[n++] = 0;
+	edge[n++] = r.arr + 1;
+	for (uint8_t ch = 0; ch < 4; ch++)
+	{
+		edge[n++] = r.ccr[ch];
+		edge[n++] = (r.ccr[ch] <= r.arr) ? 2 * r.arr - r.ccr[ch] + 1 : 0;
+	}
+	qsort(edge, n, sizeof(edge[0]), Sim_Tick_Compare);
+
+	pwm_runs = 0;
+	for (uint8_t i = 0; i < n; i++)
+	{
+		uint32_t t = edge[i];
+		if (t >= pwm_ticks || (i > 0 && t == edge[i - 1])) continue;
+
+		uint8_t on = Sim_Tim1_On(&r, t);
+		if (pwm_runs && pwm_run[pwm_runs - 1].on == on) continue;
+		if (pwm_runs) pwm_run[pwm_runs - 1].len = t - pwm_run[pwm_runs - 1].start;
+		pwm_run[pwm_runs++] = (Sim_Pwm_Run){ t, 0, on };
+	}
+	pwm_run[pwm_runs - 1].len = pwm_ticks - pwm_run[pwm_runs - 1].start;
+
+	// Injected ADC trigger: CC4 match counting up (edge), counting down (center, CMS = 01)
+	pwm_sample = -1;
+	if ((r.adc_cr2 & ADC_CR2_ADON) && (r.adc_cr1 & ADC_CR1_JEOCIE) && r.ccr[0] && r.ccr[3] <= r.arr)
+		pwm_sample = (int32_t)(center ? 2 * r.arr - r.ccr[3] : r.ccr[3]) % (int32_t)pwm_ticks;
+}
+
+void Sim_Hw_Pwm_Stats(const double amps[4], Sim_Pwm_Stats *s)
+{
+	// Supply current is the sum of the wheel currents whose outputs are on
+	// Its step is the net change at an edge tick, ringing counts every edge (each one disturbs the ground)
+	if (pwm_stats_valid && memcmp(amps, pwm_amps, sizeof(pwm_amps)) == 0)
+	{
+		*s = pwm_stats;
+		return;
+	}
+
+	double sum = 0.0, sq = 0.0, step_max = 0.0, noise = 0.0;
+	double tick_us = (pwm_regs.psc + 1.0) * 1e6 / SysClk;
+
+	for (uint32_t r = 0; r < pwm_runs; r++)
+	{
+		uint8_t on = pwm_run[r].on;
+		uint8_t prev = pwm_run[(r + pwm_runs - 1) % pwm_runs].on;
+		uint32_t t = pwm_run[r].start;
+		double i = 0.0, step = 0.0, edges = 0.0;
+
+		for (uint8_t ch = 0; ch < 4; ch++)
+		{
+			if (on & (1U << ch)) i += amps[ch];
+			if ((on ^ prev) & (1U << ch))
+			{
+				step += (on & (1U << ch)) ? amps[ch] : -amps[ch];
+				edges += amps[ch];
+			}
+		}
+		sum += i * pwm_run[r].len;
+		sq += i * i * pwm_run[r].len;
+		if (fabs(step) > step_max) step_max = fabs(step);
+
+		// Ringing from the run's first tick edges, averaged over the sample window (the period repeats)
+		if (pwm_sample >= 0 && edges > 0.0)
+		{
+			double d = (double)((t + pwm_ticks - (uint32_t)pwm_sample) % pwm_ticks) * tick_us;
+			if (d > Sim_Adc_Window_us) d -= pwm_ticks * tick_us;		// Edge before the window
+			double from = (d > 0.0) ? d : 0.0;
+			noise += edges * Sim_Ring_Gain * Sim_Ring_Tau_us / Sim_Adc_Window_us
+					* (exp(-(from - d) / Sim_Ring_Tau_us) - exp(-(Sim_Adc_Window_us - d) / Sim_Ring_Tau_us));
+		}
+	}
+
+	double mean = sum / pwm_ticks;
+	double var = sq / pwm_ticks - mean * mean;
+	s->supply_mean_A = mean;
+	s->supply_ripple_A = (var > 0) ? sqrt(var) : 0.0;
+	s->supply_step_A = step_max;
+	s->sample_noise_mA = (pwm_sample >= 0) ? noise * 1000.0 : -1.0;
+
+	pwm_stats = *s;
+	memcpy(pwm_amps, amps, sizeof(pwm_amps));
+	pwm_stats_valid = 1;
+}
+
+void Sim_Hw_Outputs(Sim_Outputs *out)
+{
+	Sim_Tim1_Wave();
+
+	// Duty: active ticks over the period
+	uint32_t count[4] = { 0, 0, 0, 0 };
+	for (uint32_t r = 0; r < pwm_runs; r++)
+		for (uint8_t ch = 0; ch < 4; ch++)
+			if (pwm_run[r].on & (1U << ch)) count[ch] += pwm_run[r].len;
+
+	// Current trip: output cut at mid on-time
+	double trip_scale = current_trip ? 0.5 : 1.0;
+
+	out->duty[0] = (double)count[0] / pwm_ticks * trip_scale;
+	for (uint8_t ch = 1; ch < 4; ch++)
+		out->duty[ch] = (double)count[ch] / pwm_ticks;
+
+	out->dir[0] = Sim_Dir(Motor_DC1, Motor_DC2);
+	out->dir[1] = Sim_Dir(Motor_W1_DC1, Motor_W1_DC2);
+	out->dir[2] = Sim_Dir(Motor_W2_DC1, Motor_W2_DC2);
+	out->dir[3] = Sim_Dir(Motor_W3_DC1, Motor_W3_DC2);
+
+	bool servo_on = (TIM2->CR1 & TIM_CR1_CEN) && (TIM2->CCER & TIM_CCER_CC1E);
+	out->servo_us = servo_on ? (TIM2->CCR1 * (TIM2->PSC + 1.0) * 1e6) / SysClk : 0.0;
+	out->profile = Drive_Mix_GetProfile();
+}
@@ -0,0 +1,480 @@
+#include "main.h"
+#include "drive_mix.h"
+#include "power_monitor.h"
+#include "boot.h"
+#include "imu.h"
+#include "yaw_ctrl.h"
+#include "failsafe.h"
+#include "maneuver.h"
+#include "link.h"
+#include "config.h"
+#include "range.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdarg.h>
+
+// Script, one event per line ('#' starts a comment):
+//   <ms> [u2] <frame>                    send once at <ms>, on USART1 (default) or USART2
+//   <ms>-<end_ms>/<period_ms> [u2] <frame>   send every period from <ms> to <end_ms>
+//   <ms> [u2] bin <id>,<steer>,<throttle>,<dir>   binary control frame (link.h), steer in degrees
+//   <ms> wall <x_m> | off                obstacle across the track at x (rangefinder stand-in)
+//   <ms> end                             stop the run
+//   expect <metric> <op> <value>         after the run, op one of < <= > >= ==: the run fails otherwise
+#define Sim_Gate_Half_Width_m	1.0		// Lap gate: start line x = 0, |y| below this
+#define Sim_Min_Lap_m			3.0		// Path length before the gate counts again
+#define Sim_Max_Laps			64
+#define Sim_Moving_mps			0.05	// A stop command counts from this speed
+#define Sim_Standstill_mps		0.01	// ... and ends below this speed (or on a reversal)
+#define Sim_Max_Expects			32
+#define Sim_Max_Metrics			64
+
+typedef struct
+{
+	uint32_t ms;
+	uint8_t port;
+	char text[64];
+} Sim_Event;
+
+static Sim_Event *events = NULL;
+static size_t event_count = 0, event_cap = 0;
+static uint32_t end_ms = 60000;
+static bool wall = 0;
+static double wall_x = 0.0;
+
+typedef struct
+{
+	char name[40];
+	char op[3];
+	double value;
+} Sim_Expect;
+
+static Sim_Expect expects[Sim_Max_Expects];
+static size_t expect_count = 0;
+
+typedef struct
+{
+	const char *name;
+	double value;
+} Sim_Metric;
+
+static Sim_Metric metrics[Sim_Max_Metrics];
+static size_t metric_count = 0;
+
+static int Event_Compare(const void *a, const void *b)
+{
+	const Sim_Event *x = a, *y = b;
+	return (x->ms > y->ms) - (x->ms < y->ms);
+}
+
+static void Event_Add(uint32_t ms, uint8_t port, const char *text)
+{
+	if (event_count == event_cap)
+	{
+		event_cap = event_cap ? event_cap * 2 : 256;
+		events = realloc(events, event_cap * sizeof(Sim_Event));
+	}
+	events[event_count].ms = ms;
+	events[event_count].port = port;
+	snprintf(events[event_count].text, sizeof(events[event_count].text), "%s", text);
+	event_count++;
+}
+
+static bool Script_Load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		perror(path);
+		return 0;
+	}
+
+	char line[256];
+	unsigned lineno = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		lineno++;
+		char *hash = strchr(line, '#');
+		if (hash) *hash = '\0';
+		line[strcspn(line, "\r\n")] = '\0';
+
+		Sim_Expect x;
+		if (sscanf(line, " expect %39s %2[<>=] %lf", x.name, x.op, &x.value) == 3)
+		{
+			if (expect_count < Sim_Max_Expects) expects[expect_count++] = x;
+			else fprintf(stderr, "%s:%u: too many expects\n", path, lineno);
+			continue;
+		}
+
+		unsigned start, stop = 0, period = 0;
+		int used = 0;
+		if (sscanf(line, " %u-%u/%u %n", &start, &stop, &period, &used) != 3 || period == 0)
+		{
+			used = 0;
+			if (sscanf(line, " %u %n", &start, &used) != 1)
+			{
+				if (strspn(line, " \t") != strlen(line))
+					fprintf(stderr, "%s:%u: ignored: %s\n", path, lineno, line);
+				continue;
+			}
+			stop = start;
+			period = 1;
+		}
+
+		char *text = line + used;
+		uint8_t port = 0;
+		if (strncmp(text, "u2 ", 3) == 0)
+		{
+			port = 1;
+			text += 3;
+		}
+
+		if (strncmp(text, "end", 3) == 0)
+		{
+			end_ms = start;
+			continue;
+		}
+
+		for (unsigned ms = start; ms <= stop; ms += period)
+			Event_Add(ms, port, text);
+	}
+
+	fclose(f);
+	qsort(events, event_count, sizeof(Sim_Event), Event_Compare);
+	return 1;
+}
+
+static bool Stop_Command(const char *text, double v)
+{
+	// <S> frame that stops, brakes or reverses the car while it moves
+	double steer;
+	unsigned thr, dir;
+	if (sscanf(text, "<S,%lf,%u,%u>", &steer, &thr, &dir) != 3) return 0;
+	if (fabs(v) < Sim_Moving_mps) return 0;
+	return thr == 0 || dir == 0 || dir == 3 || (dir == 1 && v < 0) || (dir == 2 && v > 0);
+}
+
+static bool Control_Frame(const char *text)
+{
+	// Frame that feeds this car's failsafe: <S>, <T>, <M>, addressed to it or not, or binary
+	unsigned id;
+	if (sscanf(text, "<@%u,", &id) == 1 || sscanf(text, "bin %u,", &id) == 1)
+		return (id == Link_Broadcast_Id || id == Config_Get(Cfg_Car_Id))
+				&& (text[0] == 'b' || strpbrk(text, "STM") != NULL);
+	return text[1] && strchr("STM", text[1]);
+}
+
+static bool Wall_Event(const char *text)
+{
+	// "wall <x_m>" places the obstacle, "wall off" removes it: nothing is sent
+	if (strncmp(text, "wall", 4) != 0) return 0;
+	wall = sscanf(text, "wall %lf", &wall_x) == 1;
+	return 1;
+}
+
+static void Send_Event(const Sim_Event *e)
+{
+	// Text as it is, "bin ..." encoded as a binary control frame
+	unsigned id, thr, dir;
+	double steer;
+
+	if (sscanf(e->text, "bin %u,%lf,%u,%u", &id, &steer, &thr, &dir) == 4)
+	{
+		uint16_t cdeg = (uint16_t)(steer * Steer_Scale + 0.5);
+		uint8_t frame[Link_Bin_Size] = { Link_Bin_Start, (uint8_t)id, (uint8_t)cdeg, (uint8_t)(cdeg >> 8),
+				(uint8_t)thr, (uint8_t)dir, 0 };
+		frame[Link_Bin_Size - 1] = Link_Crc8(frame + 1, Link_Bin_Size - 2);
+		Sim_Uart_Send_Bytes(e->port, frame, sizeof(frame));
+	}
+	else
+	{
+		Sim_Uart_Send(e->port, e->text);
+	}
+}
+
+static void Metric(const char *name, const char *fmt, ...)
+{
+	// key=value line, the value kept for the script's expects
+	char text[32];
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(text, sizeof(text), fmt, ap);
+	va_end(ap);
+
+	printf("%s=%s\n", name, text);
+	if (metric_count < Sim_Max_Metrics)
+	{
+		metrics[metric_count].name = name;
+		metrics[metric_count].value = strtod(text, NULL);
+		metric_count++;
+	}
+}
+
+static bool Expects_Met(void)
+{
+	bool ok = 1;
+	for (size_t i = 0; i < expect_count; i++)
+	{
+		const Sim_Expect *x = &expects[i];
+		const Sim_Metric *m = NULL;
+		for (size_t j = 0; j < metric_count && !m; j++)
+			if (strcmp(metrics[j].name, x->name) == 0) m = &metrics[j];
+
+		bool met = m && ((strcmp(x->op, "<") == 0 && m->value < x->value)
+				|| (strcmp(x->op, "<=") == 0 && m->value <= x->value)
+				|| (strcmp(x->op, ">") == 0 && m->value > x->value)
+				|| (strcmp(x->op, ">=") == 0 && m->value >= x->value)
+				|| (strcmp(x->op, "==") == 0 && m->value == x->value));
+		if (!met)
+		{
+			if (m) fprintf(stderr, "expect failed: %s=%g, wanted %s %g\n", x->name, m->value, x->op, x->value);
+			else fprintf(stderr, "expect failed: no metric %s\n", x->name);
+			ok = 0;
+		}
+	}
+	return ok;
+}
+
+static void Usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-c trace.csv] [-q] [-n] script.txt\n", prog);
+	fprintf(stderr, "  -c  write the vehicle state every 10 ms as CSV\n");
+	fprintf(stderr, "  -q  metrics only, no lap log\n");
+	fprintf(stderr, "  -n  no IMU fitted (address NACK)\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *csv_path = NULL;
+	const char *script = NULL;
+	bool quiet = 0;
+	bool imu = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) csv_path = argv[++i];
+		else if (strcmp(argv[i], "-q") == 0) quiet = 1;
+		else if (strcmp(argv[i], "-n") == 0) imu = 0;
+		else if (argv[i][0] == '-') Usage(argv[0]);
+		else script = argv[i];
+	}
+	if (!script || !Script_Load(script)) Usage(argv[0]);
+
+	FILE *csv = NULL;
+	if (csv_path)
+	{
+		csv = fopen(csv_path, "w");
+		if (!csv) { perror(csv_path); return 1; }
+		fprintf(csv, "t_s,x_m,y_m,heading_deg,v_mps,servo_deg,duty,motor_A,batt_A,batt_V,throttle_limit\n");
+	}
+
+	const Sim_Vehicle_Params *params = &Sim_Default_Params;
+	Sim_Vehicle car;
+	Sim_Outputs out;
+	Sim_Sensors sensors;
+
+	// Reset: SystemInit() as called by Reset_Handler, then the firmware init
+	Sim_Hw_Init();
+	Sim_Hw_Imu_Fitted(imu);
+	SystemInit();
+	Car_Init();
+	Sim_Vehicle_Init(&car, params);
+
+	double lap_times[Sim_Max_Laps];
+	uint32_t laps = 0;
+	double lap_start_s = 0.0, lap_start_dist = 0.0;
+	double peak_A = 0.0, sq_A = 0.0, max_v = 0.0, min_V = car.batt_V;
+	uint8_t min_limit = 100;
+	double yaw_sq = 0.0, max_corr = 0.0;
+	uint32_t yaw_n = 0;
+	uint32_t stops = 0, stop_ms = 0, stop_max_ms = 0;
+	double stop_v = 0.0, stop_dist = 0.0, stop_max_m = 0.0;
+	bool stopping = 0;
+	uint32_t frame_ms = 0, loss_max_ms = 0;
+	double frame_dist = 0.0, loss_max_m = 0.0;
+	bool lost = 0, tripped = 0;
+	double ripple_sq = 0.0, step_max_A = 0.0, noise_sq = 0.0, noise_max = 0.0;
+	uint32_t ripple_n = 0, noise_n = 0;
+	double gap_min = 0.0;
+	bool gap_seen = 0;
+	double record_m = 0.0, replay_m = 0.0;
+	size_t next_event = 0;
+	const double dt = Sim_Step_us / 1e6;
+	clock_t wall_start = clock();
+
+	for (uint32_t ms = 0; ms < end_ms; ms++)
+	{
+		while (next_event < event_count && events[next_event].ms <= ms)
+		{
+			if (Wall_Event(events[next_event].text))
+			{
+				next_event++;
+				continue;
+			}
+			Send_Event(&events[next_event]);
+			if (!stopping && Stop_Command(events[next_event].text, car.v))
+			{
+				stopping = 1;				// Latency from the frame leaving the driver to standstill
+				stop_ms = ms;
+				stop_v = car.v;
+				stop_dist = car.distance_m;
+			}
+			if (Control_Frame(events[next_event].text))
+			{
+				frame_ms = ms;				// Last control frame, the failsafe counts from here
+				frame_dist = car.distance_m;
+			}
+			next_event++;
+		}
+
+		Sim_Vehicle_Sensors(&car, params, &out, &sensors);
+		if (wall) sensors.range_m = Sim_Vehicle_Range(&car, params, wall_x);
+		Sim_Hw_Step(&sensors);
+		Car_Loop();
+		Sim_Hw_Outputs(&out);
+
+		double prev_x = car.x;
+		double prev_dist = car.distance_m;
+		Sim_Vehicle_Step(&car, params, &out, dt);
+
+		// Maneuver: distance driven while recording, and while playing it back
+		if (Maneuver_Get_State() == Maneuver_Recording) record_m += car.distance_m - prev_dist;
+		if (Maneuver_Get_State() == Maneuver_Playing) replay_m += car.distance_m - prev_dist;
+
+		// Lap: forward crossing of the start line, after a minimum path length
+		if (prev_x < 0 && car.x >= 0 && fabs(car.y) < Sim_Gate_Half_Width_m
+				&& car.distance_m - lap_start_dist > Sim_Min_Lap_m)
+		{
+			double t = (ms + 1) * dt;
+			if (laps < Sim_Max_Laps) lap_times[laps] = t - lap_start_s;
+			if (!quiet) printf("lap %u %.3f s\n", laps + 1, t - lap_start_s);
+			laps++;
+			lap_start_s = t;
+			lap_start_dist = car.distance_m;
+		}
+
+		if (stopping && (fabs(car.v) < Sim_Standstill_mps || car.v * stop_v < 0))
+		{
+			stopping = 0;
+			stops++;
+			if (ms + 1 - stop_ms > stop_max_ms) stop_max_ms = ms + 1 - stop_ms;
+			if (car.distance_m - stop_dist > stop_max_m) stop_max_m = car.distance_m - stop_dist;
+		}
+
+		// Link loss: last control frame (or replayed keyframe) to standstill, while the failsafe is tripped
+		if (Maneuver_Get_State() == Maneuver_Playing)
+		{
+			frame_ms = ms + 1;
+			frame_dist = car.distance_m;
+		}
+		if (Failsafe_Active() && !tripped) lost = 1;
+		tripped = Failsafe_Active();
+		if (lost && (fabs(car.v) < Sim_Standstill_mps || !Failsafe_Active()))
+		{
+			lost = 0;
+			if (ms + 1 - frame_ms > loss_max_ms) loss_max_ms = ms + 1 - frame_ms;
+			if (car.distance_m - frame_dist > loss_max_m) loss_max_m = car.distance_m - frame_dist;
+		}
+
+		// Switching: supply ripple and edge noise at the current sample, driven wheels only
+		double wheel_A[4];
+		for (uint8_t w = 0; w < 4; w++)
+			wheel_A[w] = (out.dir[w] == 1 || out.dir[w] == -1) ? fabs(car.motor_A[w]) : 0.0;
+		Sim_Pwm_Stats pwm;
+		Sim_Hw_Pwm_Stats(wheel_A, &pwm);
+		if (pwm.supply_mean_A > 0.0)
+		{
+			ripple_sq += pwm.supply_ripple_A * pwm.supply_ripple_A;
+			ripple_n++;
+			if (pwm.supply_step_A > step_max_A) step_max_A = pwm.supply_step_A;
+		}
+		if (pwm.sample_noise_mA >= 0.0 && wheel_A[0] > 0.0 && out.profile != Drive_4WD)	// 4WD: CC4 is a wheel
+		{
+			noise_sq += pwm.sample_noise_mA * pwm.sample_noise_mA;
+			noise_n++;
+			if (pwm.sample_noise_mA > noise_max) noise_max = pwm.sample_noise_mA;
+		}
+
+		// Rangefinder: closest the front bumper came to the wall (negative: driven through it)
+		if (wall)
+		{
+			double gap = Sim_Vehicle_Wall_Gap(&car, params, wall_x);
+			if (!gap_seen || gap < gap_min) gap_min = gap;
+			gap_seen = 1;
+		}
+
+		double amps = fabs(car.motor_A[0]);
+		if (amps > peak_A) peak_A = amps;
+		sq_A += amps * amps;
+		if (fabs(car.v) > max_v) max_v = fabs(car.v);
+		if (car.batt_V < min_V) min_V = car.batt_V;
+		if (Power_Throttle_Limit() < min_limit) min_limit = Power_Throttle_Limit();
+
+		// Yaw: actual rate (right positive) against the rate the driver command asks for
+		if (Yaw_Target() != 0)
+		{
+			double err = -car.yaw_rate * 180.0 / M_PI - Yaw_Target() / 100.0;
+			yaw_sq += err * err;
+			yaw_n++;
+		}
+		if (fabs(Yaw_Correction() / 100.0) > max_corr) max_corr = fabs(Yaw_Correction() / 100.0);
+
+		if (csv && (ms % 10) == 9)
+			fprintf(csv, "%.3f,%.4f,%.4f,%.2f,%.4f,%.2f,%.3f,%.4f,%.4f,%.3f,%u\n",
+					(ms + 1) * dt, car.x, car.y, car.heading * 180.0 / M_PI, car.v, car.servo_deg,
+					out.duty[0], car.motor_A[0], car.batt_A, car.batt_V, Power_Throttle_Limit());
+	}
+
+	double wall_s = (double)(clock() - wall_start) / CLOCKS_PER_SEC;
+	double sim_s = end_ms / 1000.0;
+	double best = 0.0;
+	for (uint32_t i = 0; i < laps && i < Sim_Max_Laps; i++)
+		if (best == 0.0 || lap_times[i] < best) best = lap_times[i];
+
+	// Metrics, one key=value per line
+	Metric("sim_time_s", "%.3f", sim_s);
+	Metric("speedup", "%.0f", wall_s > 0 ? sim_s / wall_s : 0.0);
+	Metric("distance_m", "%.3f", car.distance_m);
+	Metric("max_speed_mps", "%.3f", max_v);
+	Metric("laps", "%u", laps);
+	Metric("best_lap_s", "%.3f", best);
+	Metric("motor_peak_A", "%.3f", peak_A);
+	Metric("motor_rms_A", "%.3f", sqrt(sq_A / (end_ms ? end_ms : 1)));
+	Metric("batt_used_mAh", "%.2f", car.used_mAh);
+	Metric("batt_min_V", "%.3f", min_V);
+	Metric("throttle_limit_min", "%u", min_limit);
+	Metric("current_trips", "%u", Power_Current_Trips());
+	Metric("imu_samples", "%u", IMU_Get_Stats()->samples);
+	Metric("yaw_error_rms_dps", "%.2f", yaw_n ? sqrt(yaw_sq / yaw_n) : 0.0);
+	Metric("yaw_correction_max_deg", "%.2f", max_corr);
+	Metric("stops", "%u", stops);
+	Metric("stop_time_max_ms", "%u", stop_max_ms);
+	Metric("stop_distance_max_m", "%.3f", stop_max_m);
+	Metric("link_frames", "%u", Link_Stats(Link_HC05)->frames);
+	Metric("link_frames_dropped", "%u", Link_Stats(Link_HC05)->frames_dropped);
+	Metric("link_foreign", "%u", Link_Stats(Link_HC05)->foreign);
+	Metric("failsafe_trips", "%u", Failsafe_Get_Stats()->trips);
+	Metric("failsafe_reaction_max_ms", "%u", Failsafe_Get_Stats()->reaction_max_ms);
+	Metric("link_loss_stop_max_ms", "%u", loss_max_ms);
+	Metric("link_loss_distance_max_m", "%.3f", loss_max_m);
+	Metric("pwm_supply_ripple_rms_A", "%.3f", ripple_n ? sqrt(ripple_sq / ripple_n) : 0.0);
+	Metric("pwm_supply_step_max_A", "%.3f", step_max_A);
+	Metric("adc_sample_noise_rms_mA", "%.2f", noise_n ? sqrt(noise_sq / noise_n) : 0.0);
+	Metric("adc_sample_noise_max_mA", "%.2f", noise_max);
+	Metric("range_echoes", "%u", Range_Get_Stats()->echoes);
+	Metric("range_clamps", "%u", Range_Get_Stats()->clamps);
+	Metric("range_brakes", "%u", Range_Get_Stats()->brakes);
+	Metric("range_latency_max_us", "%u", Range_Get_Stats()->latency_max_us);
+	if (gap_seen) Metric("wall_gap_min_m", "%.3f", gap_min);
+	if (record_m > 0.0) Metric("record_distance_m", "%.3f", record_m);
+	if (replay_m > 0.0) Metric("replay_distance_m", "%.3f", replay_m);
+
+	Metric("uart_tx_stall_max_ms", "%u", Sim_Hw_Stall_Max_ms());
+
+	if (csv) fclose(csv);
+	return Expects_Met() ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+#include "sim.h"
+#include "drive_mix.h"
+#include <math.h>
+
+// BO gear motor car on a 2S Li-ion pack, L298N bridge, MG995 steering
+const Sim_Vehicle_Params Sim_Default_Params =
+{
+	.mass_kg        = 0.8,
+	.wheelbase_m    = 0.16,
+	.track_m        = 0.13,
+	.wheel_r_m      = 0.033,
+	.gear           = 48.0,
+	.gear_eff       = 0.6,
+	.motor_R        = 2.5,
+	.motor_K        = 0.0045,
+	.bridge_drop_V  = 2.0,
+	.batt_full_V    = 8.4,
+	.batt_empty_V   = 6.0,
+	.batt_R         = 0.15,
+	.batt_mAh       = 2000.0,
+	.crr            = 0.03,
+	.drag           = 0.5,
+	.max_lock_deg   = 30.0,
+	.servo_min_us   = 544.0,
+	.servo_max_us   = 2344.0,
+	.servo_slew_dps = 350.0,
+	.oversteer_v_mps = 1.1,
+	.yaw_tau_s      = 0.08,
+	.gyro_bias_dps  = 1.5,
+	.gyro_noise_dps = 0.3,
+	.range_offset_m = 0.12,
+	.range_cone_deg = 15.0,
+};
+
+#define G	9.81
+
+void Sim_Vehicle_Init(Sim_Vehicle *car, const Sim_Vehicle_Params *p)
+{
+	*car = (Sim_Vehicle){ 0 };
+	car->servo_deg = Drive_Steer_Center;
+	car->batt_V = p->batt_full_V;
+}
+
+static double Open_Circuit_V(const Sim_Vehicle *car, const Sim_Vehicle_Params *p)
+{
+	// Linear discharge curve
+	double soc = 1.0 - car->used_mAh / p->batt_mAh;
+	if (soc < 0) soc = 0;
+	return p->batt_empty_V + (p->batt_full_V - p->batt_empty_V) * soc;
+}
+
+static double Motor_Step(const Sim_Vehicle_Params *p, double duty, int8_t dir, double wheel_v, double batt_V,
+		double *winding_A, double *batt_A)
+{
+	// Averaged H-bridge: winding sees duty * supply, returns the wheel force
+	double omega = wheel_v / p->wheel_r_m * p->gear;
+	double emf = p->motor_K * omega;
+	double i = 0.0, ib = 0.0;
+
+	if (dir == 1 || dir == -1)
+	{
+		double supply = batt_V - p->bridge_drop_V;
+		if (supply < 0) supply = 0;
+		i = (duty * dir * supply - emf) / p->motor_R;
+		ib = duty * dir * i;
+	}
+	else if (dir == 2)
+	{
+		i = -duty * emf / p->motor_R;		// Both inputs high: windings shorted while enabled
+	}
+
+	*winding_A = i;
+	*batt_A = ib;
+	return p->motor_K * i * p->gear * p->gear_eff / p->wheel_r_m;
+}
+
+static double Resist(const Sim_Vehicle_Params *p, double mass, double v, double force)
+{
+	// Rolling resistance holds a stopped car until the drive overcomes it
+	double roll = p->crr * mass * G;
+	if (v == 0.0 && fabs(force) <= roll) return force;
+	return roll * ((v > 0) ? 1.0 : (v < 0) ? -1.0 : (force > 0) ? 1.0 : -1.0) + p->drag * v;
+}
+
+static double Integrate_Speed(double v, double accel, double dt)
+{
+	double next = v + accel * dt;
+	if ((v > 0 && next < 0) || (v < 0 && next > 0)) next = 0;	// Friction stops, never reverses
+	return next;
+}
+
+void Sim_Vehicle_Step(Sim_Vehicle *car, const Sim_Vehicle_Params *p, const Sim_Outputs *out, double dt)
+{
+	double batt_V = car->batt_V;
+	double batt_A = 0.0;
+	double ib;
+
+	// Servo: follows the pulse at its slew rate
+	if (out->servo_us > 0)
+	{
+		double target = (out->servo_us - p->servo_min_us) / (p->servo_max_us - p->servo_min_us) * 180.0;
+		double step = p->servo_slew_dps * dt;
+		double err = target - car->servo_deg;
+		car->servo_deg += (err > step) ? step : (err < -step) ? -step : err;
+	}
+
+	if (out->profile == Drive_Differential)
+	{
+		// Skid steer: left (wheel 0) and right (wheel 1) halves, scrub couples them
+		double fl = Motor_Step(p, out->duty[0], out->dir[0], car->v_left, batt_V, &car->motor_A[0], &ib);
+		batt_A += ib;
+		double fr = Motor_Step(p, out->duty[1], out->dir[1], car->v_right, batt_V, &car->motor_A[1], &ib);
+		batt_A += ib;
+
+		double half = p->mass_kg / 2;
+		double scrub = 4.0 * (car->v_left - car->v_right);
+		fl -= scrub;
+		fr += scrub;
+		car->v_left = Integrate_Speed(car->v_left, (fl - Resist(p, half, car->v_left, fl)) / half, dt);
+		car->v_right = Integrate_Speed(car->v_right, (fr - Resist(p, half, car->v_right, fr)) / half, dt);
+		car->v = (car->v_left + car->v_right) / 2;
+		car->yaw_rate = (car->v_right - car->v_left) / p->track_m;
+	}
+	else
+	{
+		// Bicycle model: rear drive (Ackermann) or all four wheels (4WD)
+		double force = Motor_Step(p, out->duty[0], out->dir[0], car->v, batt_V, &car->motor_A[0], &ib);
+		batt_A += ib;
+
+		if (out->profile == Drive_4WD)
+		{
+			for (uint8_t w = 1; w < 4; w++)
+			{
+				force += Motor_Step(p, out->duty[w], out->dir[w], car->v, batt_V, &car->motor_A[w], &ib);
+				batt_A += ib;
+			}
+		}
+
+		car->v = Integrate_Speed(car->v, (force - Resist(p, p->mass_kg, car->v, force)) / p->mass_kg, dt);
+		car->v_left = car->v_right = car->v;
+
+		// Servo left of center turns left (counter-clockwise)
+		double lock = (Drive_Steer_Center - car->servo_deg) / Drive_Steer_Span * p->max_lock_deg;
+		if (lock > p->max_lock_deg) lock = p->max_lock_deg;
+		if (lock < -p->max_lock_deg) lock = -p->max_lock_deg;
+		// Yaw rate lags the steady state, which grows past kinematic with speed (oversteer)
+		double ratio = car->v / p->oversteer_v_mps;
+		double gain = 1.0 / fmax(1.0 - ratio * ratio, 0.25);
+		double steady = car->v * tan(lock * M_PI / 180.0) / p->wheelbase_m * gain;
+		car->yaw_rate += (steady - car->yaw_rate) * dt / p->yaw_tau_s;
+	}
+
+	car->heading += car->yaw_rate * dt;
+
+	car->x += car->v * cos(car->heading) * dt;
+	car->y += car->v * sin(car->heading) * dt;
+	car->distance_m += fabs(car->v) * dt;
+
+	// Battery: sag under load, charge counted out
+	car->batt_A = batt_A;
+	car->used_mAh += (batt_A > 0 ? batt_A : 0) * dt * 1000.0 / 3600.0;
+	car->batt_V = Open_Circuit_V(car, p) - batt_A * p->batt_R;
+}
+
+void Sim_Vehicle_Sensors(const Sim_Vehicle *car, const Sim_Vehicle_Params *p, const Sim_Outputs *out, Sim_Sensors *s)
+{
+	// L298N sense resistor only carries current while the bridge is driven
+	double peak = fabs(car->motor_A[0]);
+
+	s->batt_V = car->batt_V;
+	s->motor_A_peak = (out->dir[0] != 0) ? peak : 0.0;
+	s->motor_A_avg = s->motor_A_peak * out->duty[0];
+
+	// Gyro: offset plus a deterministic noise sequence
+	static uint32_t lcg = 12345;
+	lcg = lcg * 1664525U + 1013904223U;
+	double noise = ((double)(lcg >> 8) / (1 << 24) * 2.0 - 1.0) * p->gyro_noise_dps;
+	s->yaw_rate_dps = car->yaw_rate * 180.0 / M_PI + p->gyro_bias_dps + noise;
+	s->range_m = -1.0;				// Nothing ahead unless the script places a wall
+}
+
+double Sim_Vehicle_Wall_Gap(const Sim_Vehicle *car, const Sim_Vehicle_Params *p, double wall_x)
+{
+	// Sensor (front bumper) to a wall across the track at x = wall_x, negative once through it
+	return wall_x - (car->x + p->range_offset_m * cos(car->heading));
+}
+
+double Sim_Vehicle_Range(const Sim_Vehicle *car, const Sim_Vehicle_Params *p, double wall_x)
+{
+	// First echo: the perpendicular path, while the wall normal lies inside the beam
+	double gap = Sim_Vehicle_Wall_Gap(car, p, wall_x);
+	if (gap < 0 || cos(car->heading) < cos(p->range_cone_deg * M_PI / 180.0)) return -1.0;
+	return gap;
+}
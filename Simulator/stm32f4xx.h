@@ -0,0 +1,478 @@
+// Host replacement for the CMSIS device header, used by the simulator build only
+// Peripherals are plain structs in RAM (sim_hw.c): firmware register accesses compile unchanged,
+// the simulator reads the outputs and drives the inputs between main loop passes
+// Only the registers, bits and core functions the firmware uses are defined
+#ifndef STM32F4XX_SIM_H
+#define STM32F4XX_SIM_H
+#include <stdint.h>
+#include <stdbool.h>
+#define __IO volatile
+#define __I volatile const
+#define __O volatile
+
+typedef enum {
+  NonMaskableInt_IRQn = -14, MemoryManagement_IRQn = -12, BusFault_IRQn = -11,
+  UsageFault_IRQn = -10, SVCall_IRQn = -5, DebugMonitor_IRQn = -4, PendSV_IRQn = -2,
+  SysTick_IRQn = -1, WWDG_IRQn = 0, PVD_IRQn = 1, FLASH_IRQn = 4, RCC_IRQn = 5,
+  EXTI0_IRQn = 6, DMA1_Stream0_IRQn = 11, DMA1_Stream5_IRQn = 16, DMA1_Stream6_IRQn = 17,
+  ADC_IRQn = 18, EXTI9_5_IRQn = 23, TIM1_BRK_TIM9_IRQn = 24, TIM1_UP_TIM10_IRQn = 25,
+  TIM1_TRG_COM_TIM11_IRQn = 26, TIM1_CC_IRQn = 27, TIM2_IRQn = 28, TIM3_IRQn = 29,
+  TIM4_IRQn = 30, I2C1_EV_IRQn = 31, I2C1_ER_IRQn = 32, USART1_IRQn = 37, USART2_IRQn = 38,
+  EXTI15_10_IRQn = 40, DMA1_Stream7_IRQn = 47, TIM5_IRQn = 50, DMA2_Stream0_IRQn = 56,
+  DMA2_Stream2_IRQn = 58, DMA2_Stream5_IRQn = 68, DMA2_Stream7_IRQn = 70, USART6_IRQn = 71
+} IRQn_Type;
+
+typedef struct { __IO uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2]; } GPIO_TypeDef;
+typedef struct { __IO uint32_t CR, PLLCFGR, CFGR, CIR, AHB1RSTR, AHB2RSTR, RESERVED0[2], APB1RSTR, APB2RSTR, RESERVED1[2],
+  AHB1ENR, AHB2ENR, RESERVED2[2], APB1ENR, APB2ENR, RESERVED3[2], AHB1LPENR, AHB2LPENR, RESERVED4[2], APB1LPENR, APB2LPENR,
+  RESERVED5[2], BDCR, CSR, RESERVED6[2], SSCGR, PLLI2SCFGR, RESERVED7, DCKCFGR; } RCC_TypeDef;
+typedef struct { __IO uint32_t ACR, KEYR, OPTKEYR, SR, CR, OPTCR; } FLASH_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR, OR; } TIM_TypeDef;
+typedef struct { __IO uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR; } USART_TypeDef;
+typedef struct { __IO uint32_t SR, CR1, CR2, SMPR1, SMPR2, JOFR1, JOFR2, JOFR3, JOFR4, HTR, LTR, SQR1, SQR2, SQR3, JSQR, JDR1, JDR2, JDR3, JDR4, DR; } ADC_TypeDef;
+typedef struct { __IO uint32_t CSR, CCR, CDR; } ADC_Common_TypeDef;
+typedef struct { __IO uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR; } DMA_Stream_TypeDef;
+typedef struct { __IO uint32_t LISR, HISR, LIFCR, HIFCR; } DMA_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, OAR1, OAR2, DR, SR1, SR2, CCR, TRISE, FLTR; } I2C_TypeDef;
+typedef struct { __IO uint32_t KR, PR, RLR, SR; } IWDG_TypeDef;
+typedef struct { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR; } EXTI_TypeDef;
+typedef struct { __IO uint32_t MEMRMP, PMC, EXTICR[4], RESERVED[2], CMPCR; } SYSCFG_TypeDef;
+typedef struct { __IO uint32_t DR, IDR, CR; } CRC_TypeDef;
+typedef struct { __IO uint32_t CR, CSR; } PWR_TypeDef;
+typedef struct { __IO uint32_t TR, DR, CR, ISR, PRER, WUTR, CALIBR, ALRMAR, ALRMBR, WPR, SSR, SHIFTR, TSTR, TSDR, TSSSR, CALR, TAFCR, ALRMASSR, ALRMBSSR, RESERVED7, BKP0R, BKP1R; } RTC_TypeDef;
+typedef struct { __IO uint32_t IDCODE, CR, APB1FZ, APB2FZ; } DBGMCU_TypeDef;
+typedef struct { __IO uint32_t CTRL, LOAD, VAL; __I uint32_t CALIB; } SysTick_Type;
+typedef struct { __I uint32_t CPUID; __IO uint32_t ICSR, VTOR, AIRCR, SCR, CCR; __IO uint8_t SHP[12]; __IO uint32_t SHCSR, CFSR, HFSR, DFSR, MMFAR, BFAR, AFSR; } SCB_Type;
+typedef struct { __IO uint32_t CTRL, CYCCNT, CPICNT, EXCCNT, SLEEPCNT, LSUCNT, FOLDCNT; __I uint32_t PCSR; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+
+extern GPIO_TypeDef Sim_GPIOA, Sim_GPIOB, Sim_GPIOC;
+extern RCC_TypeDef Sim_RCC; extern FLASH_TypeDef Sim_FLASH;
+extern TIM_TypeDef Sim_TIM1, Sim_TIM2, Sim_TIM3, Sim_TIM4, Sim_TIM5, Sim_TIM9, Sim_TIM10, Sim_TIM11;
+extern USART_TypeDef Sim_USART1, Sim_USART2, Sim_USART6;
+extern ADC_TypeDef Sim_ADC1; extern ADC_Common_TypeDef Sim_ADC1_COMMON;
+extern DMA_TypeDef Sim_DMA1, Sim_DMA2;
+extern DMA_Stream_TypeDef Sim_DMA1_Stream[8], Sim_DMA2_Stream[8];
+extern I2C_TypeDef Sim_I2C1; extern IWDG_TypeDef Sim_IWDG; extern EXTI_TypeDef Sim_EXTI;
+extern SYSCFG_TypeDef Sim_SYSCFG; extern CRC_TypeDef Sim_CRC; extern PWR_TypeDef Sim_PWR; extern RTC_TypeDef Sim_RTC; extern DBGMCU_TypeDef Sim_DBGMCU;
+extern SysTick_Type Sim_SysTick; extern SCB_Type Sim_SCB; extern DWT_Type Sim_DWT; extern CoreDebug_Type Sim_CoreDebug;
+
+#define GPIOA (&Sim_GPIOA)
+#define GPIOB (&Sim_GPIOB)
+#define GPIOC (&Sim_GPIOC)
+#define RCC (&Sim_RCC)
+#define FLASH (&Sim_FLASH)
+#define TIM1 (&Sim_TIM1)
+#define TIM2 (&Sim_TIM2)
+#define TIM3 (&Sim_TIM3)
+#define TIM4 (&Sim_TIM4)
+#define TIM5 (&Sim_TIM5)
+#define TIM9 (&Sim_TIM9)
+#define TIM10 (&Sim_TIM10)
+#define TIM11 (&Sim_TIM11)
+#define USART1 (&Sim_USART1)
+#define USART2 (&Sim_USART2)
+#define USART6 (&Sim_USART6)
+#define ADC1 (&Sim_ADC1)
+#define ADC1_COMMON (&Sim_ADC1_COMMON)
+#define ADC (&Sim_ADC1_COMMON)
+#define DMA1 (&Sim_DMA1)
+#define DMA2 (&Sim_DMA2)
+#define DMA1_Stream5 (&Sim_DMA1_Stream[5])
+#define DMA1_Stream6 (&Sim_DMA1_Stream[6])
+#define DMA1_Stream0 (&Sim_DMA1_Stream[0])
+#define DMA2_Stream0 (&Sim_DMA2_Stream[0])
+#define DMA2_Stream2 (&Sim_DMA2_Stream[2])
+#define DMA2_Stream5 (&Sim_DMA2_Stream[5])
+#define DMA2_Stream7 (&Sim_DMA2_Stream[7])
+#define I2C1 (&Sim_I2C1)
+#define IWDG (&Sim_IWDG)
+#define EXTI (&Sim_EXTI)
+#define SYSCFG (&Sim_SYSCFG)
+#define CRC (&Sim_CRC)
+#define PWR (&Sim_PWR)
+#define RTC (&Sim_RTC)
+#define DBGMCU (&Sim_DBGMCU)
+#define SysTick (&Sim_SysTick)
+#define SCB (&Sim_SCB)
+#define DWT (&Sim_DWT)
+#define CoreDebug (&Sim_CoreDebug)
+
+// Internal flash, backing store for config.c (Config_Word override in the Makefile)
+uint32_t *Sim_Flash_Word(uint32_t addr);
+
+// USART transmit timing (UART_Tx_Ready / UART_Tx_Write overrides in the Makefile)
+bool Sim_Uart_Tx_Ready(USART_TypeDef *uart);
+void Sim_Uart_Tx_Write(USART_TypeDef *uart, uint32_t c);
+
+// TIM3 count during the range handler (Range_Count override in the Makefile)
+uint16_t Sim_Range_Count(void);
+
+// Core functions
+#define __NVIC_PRIO_BITS 4U
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority);
+uint32_t NVIC_GetPriority(IRQn_Type IRQn);
+void NVIC_SetPriorityGrouping(uint32_t PriorityGroup);
+uint32_t NVIC_EncodePriority(uint32_t PriorityGroup, uint32_t PreemptPriority, uint32_t SubPriority);
+void NVIC_SystemReset(void);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+uint32_t NVIC_GetActive(IRQn_Type IRQn);
+uint32_t SysTick_Config(uint32_t ticks);
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t m);
+uint32_t __get_BASEPRI(void);
+void __set_BASEPRI(uint32_t m);
+uint32_t __get_IPSR(void);
+void __set_MSP(uint32_t v);
+void __DSB(void);
+void __ISB(void);
+void __DMB(void);
+void __WFI(void);
+void __NOP(void);
+uint32_t __LDREXW(volatile uint32_t *addr);
+uint32_t __STREXW(uint32_t value, volatile uint32_t *addr);
+void __CLREX(void);
+uint32_t __REV(uint32_t v);
+
+#define SysTick_CTRL_ENABLE_Msk (1U<<0)
+#define SysTick_CTRL_TICKINT_Msk (1U<<1)
+#define SysTick_CTRL_CLKSOURCE_Msk (1U<<2)
+#define SysTick_CTRL_COUNTFLAG_Msk (1U<<16)
+#define SCB_ICSR_VECTACTIVE_Msk 0x1FFU
+#define DWT_CTRL_CYCCNTENA_Msk 1U
+#define CoreDebug_DEMCR_TRCENA_Msk (1U<<24)
+#define SCB_AIRCR_VECTKEY_Pos 16U
+
+// RCC
+#define RCC_CR_HSION (1U<<0)
+#define RCC_CR_HSIRDY (1U<<1)
+#define RCC_CR_HSEON (1U<<16)
+#define RCC_CR_HSERDY (1U<<17)
+#define RCC_CR_HSEBYP (1U<<18)
+#define RCC_CR_CSSON (1U<<19)
+#define RCC_CR_PLLON (1U<<24)
+#define RCC_CR_PLLRDY (1U<<25)
+#define RCC_PLLCFGR_PLLM_Pos 0U
+#define RCC_PLLCFGR_PLLM (0x3FU<<0)
+#define RCC_PLLCFGR_PLLN_Pos 6U
+#define RCC_PLLCFGR_PLLN (0x1FFU<<6)
+#define RCC_PLLCFGR_PLLP_Pos 16U
+#define RCC_PLLCFGR_PLLP (3U<<16)
+#define RCC_PLLCFGR_PLLSRC (1U<<22)
+#define RCC_PLLCFGR_PLLSRC_HSE (1U<<22)
+#define RCC_PLLCFGR_PLLQ_Pos 24U
+#define RCC_PLLCFGR_PLLQ (0xFU<<24)
+#define RCC_CFGR_SW (3U<<0)
+#define RCC_CFGR_SW_HSI 0U
+#define RCC_CFGR_SW_HSE 1U
+#define RCC_CFGR_SW_PLL 2U
+#define RCC_CFGR_SWS (3U<<2)
+#define RCC_CFGR_SWS_HSI 0U
+#define RCC_CFGR_SWS_HSE (1U<<2)
+#define RCC_CFGR_SWS_PLL (2U<<2)
+#define RCC_CFGR_HPRE (0xFU<<4)
+#define RCC_CFGR_HPRE_DIV1 0U
+#define RCC_CFGR_PPRE1 (7U<<10)
+#define RCC_CFGR_PPRE1_DIV1 0U
+#define RCC_CFGR_PPRE1_DIV2 (4U<<10)
+#define RCC_CFGR_PPRE2 (7U<<13)
+#define RCC_CFGR_PPRE2_DIV1 0U
+#define RCC_CIR_HSERDYIE (1U<<11)
+#define RCC_CIR_PLLRDYIE (1U<<12)
+#define RCC_CIR_HSERDYF (1U<<3)
+#define RCC_CIR_PLLRDYF (1U<<4)
+#define RCC_CIR_HSERDYC (1U<<19)
+#define RCC_CIR_PLLRDYC (1U<<20)
+#define RCC_CSR_LSION (1U<<0)
+#define RCC_CSR_LSIRDY (1U<<1)
+#define RCC_CSR_RMVF (1U<<24)
+#define RCC_CSR_BORRSTF (1U<<25)
+#define RCC_CSR_PINRSTF (1U<<26)
+#define RCC_CSR_PORRSTF (1U<<27)
+#define RCC_CSR_SFTRSTF (1U<<28)
+#define RCC_CSR_IWDGRSTF (1U<<29)
+#define RCC_CSR_WWDGRSTF (1U<<30)
+#define RCC_AHB1ENR_GPIOAEN (1U<<0)
+#define RCC_AHB1ENR_GPIOBEN (1U<<1)
+#define RCC_AHB1ENR_GPIOCEN (1U<<2)
+#define RCC_AHB1ENR_CRCEN (1U<<12)
+#define RCC_AHB1ENR_DMA1EN (1U<<21)
+#define RCC_AHB1ENR_DMA2EN (1U<<22)
+#define RCC_APB1ENR_TIM2EN (1U<<0)
+#define RCC_APB1ENR_TIM3EN (1U<<1)
+#define RCC_APB1ENR_TIM4EN (1U<<2)
+#define RCC_APB1ENR_TIM5EN (1U<<3)
+#define RCC_APB1ENR_USART2EN (1U<<17)
+#define RCC_APB1ENR_I2C1EN (1U<<21)
+#define RCC_APB1ENR_PWREN (1U<<28)
+#define PWR_CR_DBP (1U<<8)
+#define RCC_APB1RSTR_I2C1RST (1U<<21)
+#define RCC_APB2ENR_TIM1EN (1U<<0)
+#define RCC_APB2ENR_USART1EN (1U<<4)
+#define RCC_APB2ENR_USART6EN (1U<<5)
+#define RCC_APB2ENR_ADC1EN (1U<<8)
+#define RCC_APB2ENR_SYSCFGEN (1U<<14)
+#define RCC_APB2ENR_TIM9EN (1U<<16)
+#define RCC_APB2ENR_TIM10EN (1U<<17)
+#define RCC_APB2ENR_TIM11EN (1U<<18)
+
+// FLASH
+#define FLASH_ACR_LATENCY (0xFU<<0)
+#define FLASH_ACR_LATENCY_0WS 0U
+#define FLASH_ACR_LATENCY_1WS 1U
+#define FLASH_ACR_LATENCY_2WS 2U
+#define FLASH_ACR_LATENCY_3WS 3U
+#define FLASH_ACR_PRFTEN (1U<<8)
+#define FLASH_ACR_ICEN (1U<<9)
+#define FLASH_ACR_DCEN (1U<<10)
+#define FLASH_ACR_ICRST (1U<<11)
+#define FLASH_ACR_DCRST (1U<<12)
+#define FLASH_KEY1 0x45670123U
+#define FLASH_KEY2 0xCDEF89ABU
+#define FLASH_SR_EOP (1U<<0)
+// The simulated flash never fails: error flags 0, so the rc_w1 clear in Flash_Wait() cannot latch them in RAM
+#define FLASH_SR_OPERR 0U
+#define FLASH_SR_WRPERR 0U
+#define FLASH_SR_PGAERR 0U
+#define FLASH_SR_PGPERR 0U
+#define FLASH_SR_PGSERR 0U
+#define FLASH_SR_BSY (1U<<16)
+#define FLASH_CR_PG (1U<<0)
+#define FLASH_CR_SER (1U<<1)
+#define FLASH_CR_SNB_Pos 3U
+#define FLASH_CR_SNB (0xFU<<3)
+#define FLASH_CR_PSIZE_Pos 8U
+#define FLASH_CR_PSIZE (3U<<8)
+#define FLASH_CR_PSIZE_1 (2U<<8)
+#define FLASH_CR_STRT (1U<<16)
+#define FLASH_CR_EOPIE (1U<<24)
+#define FLASH_CR_LOCK (1U<<31)
+
+// TIM
+#define TIM_CR1_CEN (1U<<0)
+#define TIM_CR1_UDIS (1U<<1)
+#define TIM_CR1_URS (1U<<2)
+#define TIM_CR1_OPM (1U<<3)
+#define TIM_CR1_DIR (1U<<4)
+#define TIM_CR1_CMS_Pos 5U
+#define TIM_CR1_CMS (3U<<5)
+#define TIM_CR1_CMS_0 (1U<<5)
+#define TIM_CR1_CMS_1 (2U<<5)
+#define TIM_CR1_ARPE (1U<<7)
+#define TIM_CR2_MMS_Pos 4U
+#define TIM_CR2_MMS (7U<<4)
+#define TIM_SMCR_SMS (7U<<0)
+#define TIM_SMCR_TS (7U<<4)
+#define TIM_DIER_UIE (1U<<0)
+#define TIM_DIER_CC1IE (1U<<1)
+#define TIM_DIER_CC2IE (1U<<2)
+#define TIM_DIER_CC3IE (1U<<3)
+#define TIM_DIER_CC4IE (1U<<4)
+#define TIM_SR_UIF (1U<<0)
+#define TIM_SR_CC1IF (1U<<1)
+#define TIM_SR_CC2IF (1U<<2)
+#define TIM_SR_CC3IF (1U<<3)
+#define TIM_SR_CC4IF (1U<<4)
+#define TIM_SR_CC1OF (1U<<9)
+#define TIM_SR_CC2OF (1U<<10)
+#define TIM_EGR_UG (1U<<0)
+#define TIM_CCMR1_CC1S (3U<<0)
+#define TIM_CCMR1_CC1S_0 (1U<<0)
+#define TIM_CCMR1_CC1S_1 (2U<<0)
+#define TIM_CCMR1_OC1PE (1U<<3)
+#define TIM_CCMR1_OC1M (7U<<4)
+#define TIM_CCMR1_OC1M_Pos 4U
+#define TIM_CCMR1_IC1F (0xFU<<4)
+#define TIM_CCMR1_IC1F_Pos 4U
+#define TIM_CCMR1_CC2S (3U<<8)
+#define TIM_CCMR1_CC2S_0 (1U<<8)
+#define TIM_CCMR1_OC2PE (1U<<11)
+#define TIM_CCMR1_OC2M (7U<<12)
+#define TIM_CCMR1_OC2M_Pos 12U
+#define TIM_CCMR1_IC2F (0xFU<<12)
+#define TIM_CCMR1_IC2F_Pos 12U
+#define TIM_CCMR2_CC3S (3U<<0)
+#define TIM_CCMR2_OC3PE (1U<<3)
+#define TIM_CCMR2_OC3M (7U<<4)
+#define TIM_CCMR2_OC3M_Pos 4U
+#define TIM_CCMR2_CC4S (3U<<8)
+#define TIM_CCMR2_OC4PE (1U<<11)
+#define TIM_CCMR2_OC4M (7U<<12)
+#define TIM_CCMR2_OC4M_Pos 12U
+#define TIM_CCER_CC1E (1U<<0)
+#define TIM_CCER_CC1P (1U<<1)
+#define TIM_CCER_CC1NE (1U<<2)
+#define TIM_CCER_CC1NP (1U<<3)
+#define TIM_CCER_CC2E (1U<<4)
+#define TIM_CCER_CC2P (1U<<5)
+#define TIM_CCER_CC2NE (1U<<6)
+#define TIM_CCER_CC2NP (1U<<7)
+#define TIM_CCER_CC3E (1U<<8)
+#define TIM_CCER_CC3P (1U<<9)
+#define TIM_CCER_CC3NE (1U<<10)
+#define TIM_CCER_CC3NP (1U<<11)
+#define TIM_CCER_CC4E (1U<<12)
+#define TIM_CCER_CC4P (1U<<13)
+#define TIM_BDTR_MOE (1U<<15)
+#define TIM_BDTR_OSSR (1U<<11)
+
+// USART
+#define USART_SR_PE (1U<<0)
+#define USART_SR_FE (1U<<1)
+#define USART_SR_NE (1U<<2)
+#define USART_SR_ORE (1U<<3)
+#define USART_SR_IDLE (1U<<4)
+#define USART_SR_RXNE (1U<<5)
+#define USART_SR_TC (1U<<6)
+#define USART_SR_TXE (1U<<7)
+#define USART_CR1_RE (1U<<2)
+#define USART_CR1_TE (1U<<3)
+#define USART_CR1_IDLEIE (1U<<4)
+#define USART_CR1_RXNEIE (1U<<5)
+#define USART_CR1_TCIE (1U<<6)
+#define USART_CR1_TXEIE (1U<<7)
+#define USART_CR1_PEIE (1U<<8)
+#define USART_CR1_PS (1U<<9)
+#define USART_CR1_PCE (1U<<10)
+#define USART_CR1_M (1U<<12)
+#define USART_CR1_UE (1U<<13)
+#define USART_CR1_OVER8 (1U<<15)
+#define USART_CR3_EIE (1U<<0)
+#define USART_CR3_DMAR (1U<<6)
+#define USART_CR3_DMAT (1U<<7)
+#define USART_CR3_ONEBIT (1U<<11)
+
+// ADC
+#define ADC_SR_AWD (1U<<0)
+#define ADC_SR_EOC (1U<<1)
+#define ADC_SR_JEOC (1U<<2)
+#define ADC_SR_JSTRT (1U<<3)
+#define ADC_SR_STRT (1U<<4)
+#define ADC_SR_OVR (1U<<5)
+#define ADC_CR1_EOCIE (1U<<5)
+#define ADC_CR1_JEOCIE (1U<<7)
+#define ADC_CR1_SCAN (1U<<8)
+#define ADC_CR1_JAUTO (1U<<10)
+#define ADC_CR1_OVRIE (1U<<26)
+#define ADC_CR2_ADON (1U<<0)
+#define ADC_CR2_CONT (1U<<1)
+#define ADC_CR2_DMA (1U<<8)
+#define ADC_CR2_DDS (1U<<9)
+#define ADC_CR2_EOCS (1U<<10)
+#define ADC_CR2_ALIGN (1U<<11)
+#define ADC_CR2_JEXTSEL_Pos 16U
+#define ADC_CR2_JEXTSEL (0xFU<<16)
+#define ADC_CR2_JEXTEN_Pos 20U
+#define ADC_CR2_JEXTEN (3U<<20)
+#define ADC_CR2_JEXTEN_0 (1U<<20)
+#define ADC_CR2_JSWSTART (1U<<22)
+#define ADC_CR2_EXTSEL_Pos 24U
+#define ADC_CR2_EXTEN (3U<<28)
+#define ADC_CR2_SWSTART (1U<<30)
+#define ADC_SMPR2_SMP0_Pos 0U
+#define ADC_SMPR2_SMP1_Pos 3U
+#define ADC_SMPR2_SMP4_Pos 12U
+#define ADC_SMPR2_SMP5_Pos 15U
+#define ADC_SMPR1_SMP18_Pos 24U
+#define ADC_SQR1_L_Pos 20U
+#define ADC_SQR1_L (0xFU<<20)
+#define ADC_SQR3_SQ1_Pos 0U
+#define ADC_SQR3_SQ2_Pos 5U
+#define ADC_SQR3_SQ3_Pos 10U
+#define ADC_JSQR_JSQ4_Pos 15U
+#define ADC_JSQR_JL_Pos 20U
+#define ADC_JSQR_JL (3U<<20)
+#define ADC_CCR_ADCPRE_Pos 16U
+#define ADC_CCR_ADCPRE (3U<<16)
+#define ADC_CCR_ADCPRE_0 (1U<<16)
+#define ADC_CCR_TSVREFE (1U<<23)
+
+// DMA
+#define DMA_SxCR_EN (1U<<0)
+#define DMA_SxCR_DMEIE (1U<<1)
+#define DMA_SxCR_TEIE (1U<<2)
+#define DMA_SxCR_HTIE (1U<<3)
+#define DMA_SxCR_TCIE (1U<<4)
+#define DMA_SxCR_DIR_Pos 6U
+#define DMA_SxCR_DIR_0 (1U<<6)
+#define DMA_SxCR_CIRC (1U<<8)
+#define DMA_SxCR_PINC (1U<<9)
+#define DMA_SxCR_MINC (1U<<10)
+#define DMA_SxCR_PSIZE_0 (1U<<11)
+#define DMA_SxCR_PSIZE_1 (2U<<11)
+#define DMA_SxCR_MSIZE_0 (1U<<13)
+#define DMA_SxCR_MSIZE_1 (2U<<13)
+#define DMA_SxCR_PL_Pos 16U
+#define DMA_SxCR_PL_1 (2U<<16)
+#define DMA_SxCR_DBM (1U<<18)
+#define DMA_SxCR_CT (1U<<19)
+#define DMA_SxCR_CHSEL_Pos 25U
+#define DMA_LISR_TCIF0 (1U<<5)
+#define DMA_LISR_HTIF0 (1U<<4)
+#define DMA_LISR_TEIF0 (1U<<3)
+#define DMA_LIFCR_CTCIF0 (1U<<5)
+#define DMA_LIFCR_CHTIF0 (1U<<4)
+#define DMA_LIFCR_CTEIF0 (1U<<3)
+#define DMA_LIFCR_CFEIF0 (1U<<0)
+#define DMA_LIFCR_CDMEIF0 (1U<<2)
+#define DMA_LISR_TCIF2 (1U<<21)
+#define DMA_LIFCR_CTCIF2 (1U<<21)
+#define DMA_HISR_TCIF5 (1U<<11)
+#define DMA_HISR_HTIF5 (1U<<10)
+#define DMA_HIFCR_CTCIF5 (1U<<11)
+#define DMA_HIFCR_CHTIF5 (1U<<10)
+#define DMA_HISR_TCIF6 (1U<<21)
+#define DMA_HIFCR_CTCIF6 (1U<<21)
+#define DMA_HISR_TCIF7 (1U<<27)
+#define DMA_HIFCR_CTCIF7 (1U<<27)
+#define DMA_HISR_TEIF5 (1U<<9)
+#define DMA_HIFCR_CTEIF5 (1U<<9)
+#define DMA_HIFCR_CFEIF5 (1U<<6)
+#define DMA_HIFCR_CDMEIF5 (1U<<8)
+
+// I2C
+#define I2C_CR1_PE (1U<<0)
+#define I2C_CR1_START (1U<<8)
+#define I2C_CR1_STOP (1U<<9)
+#define I2C_CR1_ACK (1U<<10)
+#define I2C_CR1_SWRST (1U<<15)
+#define I2C_CR2_FREQ_Pos 0U
+#define I2C_CR2_ITERREN (1U<<8)
+#define I2C_CR2_ITEVTEN (1U<<9)
+#define I2C_CR2_ITBUFEN (1U<<10)
+#define I2C_CR2_DMAEN (1U<<11)
+#define I2C_CR2_LAST (1U<<12)
+#define I2C_SR1_SB (1U<<0)
+#define I2C_SR1_ADDR (1U<<1)
+#define I2C_SR1_BTF (1U<<2)
+#define I2C_SR1_RXNE (1U<<6)
+#define I2C_SR1_TXE (1U<<7)
+#define I2C_SR1_BERR (1U<<8)
+#define I2C_SR1_ARLO (1U<<9)
+#define I2C_SR1_AF (1U<<10)
+#define I2C_SR1_OVR (1U<<11)
+#define I2C_SR1_TIMEOUT (1U<<14)
+#define I2C_SR2_MSL (1U<<0)
+#define I2C_SR2_BUSY (1U<<1)
+#define I2C_SR2_TRA (1U<<2)
+#define I2C_CCR_FS (1U<<15)
+
+// IWDG
+#define IWDG_SR_PVU (1U<<0)
+#define IWDG_SR_RVU (1U<<1)
+
+// EXTI / SYSCFG
+#define SYSCFG_EXTICR3_EXTI10 (0xFU<<8)
+#define SYSCFG_EXTICR3_EXTI10_PA 0U
+
+// CRC
+#define CRC_CR_RESET (1U<<0)
+
+// DBGMCU
+#define DBGMCU_APB1_FZ_DBG_IWDG_STOP (1U<<12)
+
+#endif
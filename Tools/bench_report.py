@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Collect a benchmark build's report (Bench_Build=1) and compare it with a baseline.
+
+Usage:
+    bench_report.py capture.txt                         # text captured from USART1 (or QEMU's stdout)
+    bench_report.py --port /dev/rfcomm0                 # send K and read the report (needs pyserial)
+    bench_report.py capture.txt --json base.json        # keep as a baseline
+    bench_report.py new.txt --baseline base.json        # per case change of the median, exit 1 on regression
+
+Report lines, see Firmware/Inc/bench.h:
+    <K,begin,clock,iterations,overhead>
+    <K,case,min,median,max>
+    <K,end>
+"""
+
+import argparse
+import json
+import re
+import sys
+
+FRAME = re.compile(rb"<K,([^<>]*)>")
+
+
+def parse(data):
+    report = {"clock": None, "iterations": 0, "overhead": 0, "cases": {}}
+    complete = False
+    for m in FRAME.finditer(data):
+        fields = m.group(1).decode("ascii", "replace").split(",")
+        if fields[0] == "begin" and len(fields) == 4:
+            # A rerun (K) starts a new report
+            report = {"clock": fields[1], "iterations": int(fields[2]), "overhead": int(fields[3]), "cases": {}}
+            complete = False
+        elif fields[0] == "end":
+            complete = True
+        elif len(fields) == 4:
+            report["cases"][fields[0]] = dict(zip(("min", "median", "max"), map(int, fields[1:])))
+    if report["clock"] is None:
+        raise ValueError("no <K,begin,...> in capture")
+    if not complete:
+        raise ValueError("report truncated, no <K,end>")
+    return report
+
+
+def table(report, baseline=None, out=sys.stdout):
+    out.write("# clock %s, %d calls per case, overhead %d subtracted\n"
+              % (report["clock"], report["iterations"], report["overhead"]))
+    out.write("%-18s %8s %8s %8s%s\n" % ("case", "min", "median", "max", "   vs base" if baseline else ""))
+    for name, r in report["cases"].items():
+        change = ""
+        base = baseline["cases"].get(name) if baseline else None
+        if base and base["median"]:
+            change = "  %+8.1f%%" % (100.0 * (r["median"] - base["median"]) / base["median"])
+        out.write("%-18s %8d %8d %8d%s\n" % (name, r["min"], r["median"], r["max"], change))
+
+
+def regressions(report, baseline, tolerance):
+    # Median only: min hides cache/branch effects, max catches the odd pipeline stall
+    bad = []
+    for name, r in report["cases"].items():
+        base = baseline["cases"].get(name)
+        if base and r["median"] > base["median"] * (1.0 + tolerance / 100.0):
+            bad.append(name)
+    return bad
+
+
+def read_port(port, baud, timeout):
+    import serial  # pyserial, only needed for live capture
+    with serial.Serial(port, baud, timeout=timeout) as ser:
+        ser.reset_input_buffer()
+        ser.write(b"K")
+        data = bytearray()
+        while b"<K,end>" not in data:
+            chunk = ser.read(4096)
+            if not chunk:
+                break
+            data += chunk
+        return bytes(data)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("capture", nargs="?", help="captured report text")
+    ap.add_argument("--port", help="serial port of a benchmark build")
+    ap.add_argument("--baud", type=int, default=9600)
+    ap.add_argument("--timeout", type=float, default=10.0)
+    ap.add_argument("--json", help="write the report as JSON")
+    ap.add_argument("--baseline", help="JSON report to compare against")
+    ap.add_argument("--tolerance", type=float, default=5.0, help="allowed median increase, %% (default 5)")
+    args = ap.parse_args()
+
+    if args.port:
+        data = read_port(args.port, args.baud, args.timeout)
+    elif args.capture:
+        with open(args.capture, "rb") as f:
+            data = f.read()
+    else:
+        ap.error("give a capture file or --port")
+
+    report = parse(data)
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+        if baseline.get("clock") != report["clock"]:
+            sys.stderr.write("warning: baseline clock %s, report clock %s\n" % (baseline.get("clock"), report["clock"]))
+
+    table(report, baseline)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=2)
+
+    if baseline:
+        bad = regressions(report, baseline, args.tolerance)
+        if bad:
+            sys.stderr.write("slower than baseline: %s\n" % ", ".join(bad))
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
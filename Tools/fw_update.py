@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""Stream a new application image to a car over its USART1 link (HC-05), see Firmware/Inc/update.h.
+
+Usage:
+    fw_update.py --port /dev/rfcomm0 Firmware_A.bin Firmware_B.bin
+    fw_update.py --port /dev/ttyUSB0 --baud 115200 --update-baud 921600 A.bin B.bin   # wired USART1
+    fw_update.py --port /dev/rfcomm0 --id 3 A.bin B.bin                                  # <@3,U,...>
+
+The two images are the same build linked for slot A and slot B (STM32F411CEUX_FLASH_APP.ld,
+-Wl,--defsym=App_Slot=1 for B), as raw binaries (arm-none-eabi-objcopy -O binary). The bootloader
+names the slot it will write, the matching image is sent: the running one stays as the fallback.
+
+--update-baud only works on a wired USART1 link. Over the HC-05 the module's own UART rate (AT+UART)
+does not follow the bootloader's BRR, the stream would be garbled: leave it at 0 there.
+
+Sequence:
+    <U,baud>                 application: reset into the bootloader (<U,B>)
+    <U,R,slot,max_bytes>     bootloader ready
+    <U,length,crc>           -> <U,G> once the slot is erased
+    frames                   two in flight, <U,A,seq> per programmed frame, <U,N,seq>: resend from seq
+    <U,D,slot,version>       committed, the car boots the new image on trial
+    <P,token>                first frame over the link: the new image confirms itself
+"""
+
+import argparse
+import re
+import struct
+import sys
+import time
+
+CHUNK = 1024                        # Update_Chunk
+SLOT_ADDR = (0x08020000, 0x08040000)
+SLOT_SIZE = 0x20000
+HEADER_SIZE = 0x200
+REPLY = re.compile(rb"<U,([^<>]*)>")
+
+
+def crc_table():
+    table = []
+    for i in range(256):
+        c = i << 24
+        for _ in range(8):
+            c = ((c << 1) ^ 0x04C11DB7) if c & 0x80000000 else (c << 1)
+        table.append(c & 0xFFFFFFFF)
+    return table
+
+
+TABLE = crc_table()
+
+
+def crc32_words(data):
+    # STM32 CRC unit: little endian words fed MSB first, init 0xFFFFFFFF, no reflection, no final XOR
+    crc = 0xFFFFFFFF
+    for (word,) in struct.iter_unpack("<I", data):
+        for shift in (24, 16, 8, 0):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ TABLE[(crc >> 24) ^ ((word >> shift) & 0xFF)]
+    return crc
+
+
+def frame(seq, chunk):
+    body = struct.pack("<HH", seq, len(chunk)) + chunk.ljust(CHUNK, b"\xff")
+    return body + struct.pack("<I", crc32_words(body))
+
+
+class Link:
+    def __init__(self, ser):
+        self.ser = ser
+        self.buf = bytearray()
+
+    def reply(self, timeout, codes):
+        # Next <U,...> whose first field is in codes, fields as strings
+        end = time.monotonic() + timeout
+        while time.monotonic() < end:
+            m = REPLY.search(self.buf)
+            if m:
+                del self.buf[:m.end()]
+                fields = m.group(1).decode("ascii", "replace").split(",")
+                if fields[0] in codes:
+                    return fields
+                continue
+            self.buf += self.ser.read(max(1, self.ser.in_waiting))
+        return None
+
+    def send(self, data):
+        self.ser.write(data)
+
+
+def check_image(image, slot):
+    if len(image) > SLOT_SIZE - HEADER_SIZE:
+        raise ValueError("image of %d bytes does not fit in a slot" % len(image))
+    reset = struct.unpack_from("<II", image)[1]
+    base = SLOT_ADDR[slot]
+    if not base + HEADER_SIZE <= reset < base + SLOT_SIZE:
+        raise ValueError("image is not linked for slot %s (Reset_Handler 0x%08X)" % ("AB"[slot], reset))
+
+
+def stream(link, image):
+    # Two frames in flight: the bootloader programs one while the DMA receives the next
+    chunks = [image[i:i + CHUNK] for i in range(0, len(image), CHUNK)]
+    acked = 0
+    sent = 0
+    while acked < len(chunks):
+        while sent < len(chunks) and sent < acked + 2:
+            link.send(frame(sent, chunks[sent]))
+            sent += 1
+        r = link.reply(2.0, ("A", "N", "F"))
+        if r is None:
+            raise RuntimeError("no acknowledgement for frame %d" % acked)
+        if r[0] == "F":
+            raise RuntimeError("flash programming failed")
+        seq = int(r[1])
+        if r[0] == "A" and seq == acked:
+            acked += 1
+        elif r[0] == "N":
+            time.sleep(0.1)                 # Bootloader drops what was in flight
+            link.ser.reset_input_buffer()
+            link.buf.clear()
+            acked = sent = seq
+        sys.stderr.write("\r%d / %d bytes" % (min(acked * CHUNK, len(image)), len(image)))
+    sys.stderr.write("\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("image_a", help="raw binary linked for slot A")
+    ap.add_argument("image_b", help="raw binary linked for slot B")
+    ap.add_argument("--port", required=True)
+    ap.add_argument("--baud", type=int, default=9600, help="link rate (Cfg_Baud)")
+    ap.add_argument("--update-baud", type=int, default=0, help="rate for the stream, 0: the link rate (wired USART1 only, the HC-05 keeps its AT+UART rate)")
+    ap.add_argument("--id", type=int, help="car address on a shared link")
+    args = ap.parse_args()
+
+    images = []
+    for name in (args.image_a, args.image_b):
+        with open(name, "rb") as f:
+            data = f.read()
+        images.append(data + b"\xff" * (-len(data) % 4))
+
+    import serial  # pyserial
+    addr = b"@%d," % args.id if args.id is not None else b""
+    start = time.monotonic()
+
+    with serial.Serial(args.port, args.baud, timeout=0.05) as ser:
+        link = Link(ser)
+        ser.reset_input_buffer()
+        link.send(b"<" + addr + b"U,%d>" % args.update_baud)
+        r = link.reply(2.0, ("B", "E"))
+        if r is None or r[0] != "B":
+            sys.exit("car refused the update (stopped, on the HC-05 port?)")
+
+        if args.update_baud:
+            ser.baudrate = args.update_baud
+        r = link.reply(3.0, ("R",))
+        if r is None:
+            sys.exit("no bootloader answer")
+        slot = int(r[1])
+        image = images[slot]
+        check_image(image, slot)
+
+        link.send(b"<U,%d,%d>" % (len(image), crc32_words(image)))
+        r = link.reply(10.0, ("G", "E"))       # Sector erase: up to 2 s
+        if r is None or r[0] != "G":
+            sys.exit("bootloader refused the image")
+
+        stream(link, image)
+        r = link.reply(3.0, ("D", "F"))
+        if r is None or r[0] != "D":
+            sys.exit("image check failed, the installed image stays")
+        sys.stderr.write("slot %s version %s written in %.1f s\n" % ("AB"[slot], r[2], time.monotonic() - start))
+
+        # The new image keeps itself once it hears the host, otherwise the other slot comes back
+        ser.baudrate = args.baud
+        for _ in range(10):
+            time.sleep(0.5)
+            ser.reset_input_buffer()
+            link.send(b"<" + addr + b"P,49>")
+            if re.search(rb"<P,49,", ser.read(64)):
+                sys.stderr.write("new image running and confirmed\n")
+                return
+        sys.exit("new image not answering: the other slot boots again after 3 unconfirmed resets (Update_Tries)")
+
+
+if __name__ == "__main__":
+    main()
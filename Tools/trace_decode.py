@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Decode a flight-recorder dump (<D> command) into a timeline.
+
+Usage:
+    trace_decode.py capture.bin              # raw bytes captured from USART1
+    trace_decode.py --port /dev/rfcomm0      # send <D> and decode the reply (needs pyserial)
+
+Dump layout (little endian), see Firmware/Src/trace.c:
+    "TRC1" | u32 clock_hz | u32 events_logged | u16 count | count * (u32 cycles, u8 event, u8 a, u16 b)
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"TRC1"
+HEADER = struct.Struct("<4sIIH")
+RECORD = struct.Struct("<IBBH")
+
+DIRS = {0: "stop", 1: "fwd", 2: "rev", 3: "brake"}
+MODES = {0: "ackermann", 1: "differential", 2: "4wd"}
+
+
+def _chr(a):
+    return chr(a) if 32 <= a < 127 else "0x%02x" % a
+
+
+def _reset_flags(b):
+    names = ["BOR", "PIN", "POR", "SFT", "IWDG", "WWDG", "LPWR"]
+    flags = [n for i, n in enumerate(names) if b & (1 << (i + 9))]
+    return "reset=" + ("|".join(flags) if flags else "none")
+
+
+# Event code -> (name, args formatter); keep in sync with Firmware/Inc/trace.h
+EVENTS = {
+    0x01: ("boot", lambda a, b: _reset_flags(b)),
+    0x02: ("packet_rx", lambda a, b: "cmd=%s len=%d" % (_chr(a), b)),
+    0x03: ("parse_error", lambda a, b: "cmd=%s len=%d" % (_chr(a), b)),
+    0x04: ("cmd_applied", lambda a, b: "steer=%d throttle=%d dir=%s"
+           % (a, b & 0xFF, DIRS.get(b >> 8, b >> 8))),
+    0x05: ("uart_error", lambda a, b: "%s%s" % ("|".join(
+        n for bit, n in ((3, "ORE"), (2, "NE"), (1, "FE"), (0, "PE")) if b & (1 << bit)),
+        " (frame dropped)" if a else "")),
+    0x06: ("mode_change", lambda a, b: "%s -> %s" % (MODES.get(b, b), MODES.get(a, a))),
+    0x07: ("derate", lambda a, b: "limit=%d%% batt=%dmV" % (a, b)),
+    0x08: ("current_trip", lambda a, b: "adc=%d" % b),
+    0x09: ("dump", lambda a, b: "events=%d" % b),
+    0x0A: ("setpoint_drop", lambda a, b: "%s t=%d" % ("|".join(
+        n for bit, n in ((0, "late"), (1, "out_of_order"), (2, "full")) if a & (1 << bit)), b)),
+    0x0B: ("autobaud", lambda a, b: "%s %d baud" % ("snapped" if a else "confirmed", b * 100)),
+    0x0C: ("imu", lambda a, b: "running" if a == 3 else "lost sr1=0x%04X" % b),
+    0x0D: ("failsafe", lambda a, b: "%s %d ms after the last frame" % ("stopped" if a else "link lost", b)),
+    0x0E: ("range", lambda a, b: "%s at %d mm" % (("off", "lost", "clear", "clamp", "brake")[a] if a < 5 else a, b)),
+}
+
+
+def decode(data):
+    start = data.find(MAGIC)
+    if start < 0:
+        raise ValueError("no %r header in capture" % MAGIC)
+    magic, clock_hz, logged, count = HEADER.unpack_from(data, start)
+    body = start + HEADER.size
+    need = body + count * RECORD.size
+    if len(data) < need:
+        raise ValueError("capture truncated: %d of %d bytes" % (len(data) - start, need - start))
+
+    records = [RECORD.unpack_from(data, body + i * RECORD.size) for i in range(count)]
+    return clock_hz, logged, records
+
+
+def timeline(clock_hz, logged, records, out=sys.stdout):
+    out.write("# clock %d Hz, %d events logged, %d held (%d overwritten)\n"
+              % (clock_hz, logged, len(records), logged - len(records)))
+    # Unwrap the 32-bit cycle counter, assumes consecutive events are < 2^32 cycles apart
+    t0 = records[0][0] if records else 0
+    elapsed = 0
+    prev = t0
+    for cycles, event, a, b in records:
+        elapsed += (cycles - prev) & 0xFFFFFFFF
+        prev = cycles
+        name, fmt = EVENTS.get(event, ("event_0x%02x" % event, lambda a, b: "a=%d b=%d" % (a, b)))
+        out.write("%12.3f ms  %-13s %s\n" % (elapsed * 1000.0 / clock_hz, name, fmt(a, b)))
+
+
+def read_port(port, baud, timeout):
+    import serial  # pyserial, only needed for live capture
+    with serial.Serial(port, baud, timeout=timeout) as ser:
+        ser.reset_input_buffer()
+        ser.write(b"<D>")
+        data = bytearray()
+        while True:
+            chunk = ser.read(4096)
+            if not chunk:
+                break
+            data += chunk
+        return bytes(data)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("capture", nargs="?", help="raw dump file")
+    ap.add_argument("--port", help="serial port to request a dump from")
+    ap.add_argument("--baud", type=int, default=9600)
+    ap.add_argument("--timeout", type=float, default=3.0)
+    args = ap.parse_args()
+
+    if args.port:
+        data = read_port(args.port, args.baud, args.timeout)
+    elif args.capture:
+        with open(args.capture, "rb") as f:
+            data = f.read()
+    else:
+        ap.error("give a capture file or --port")
+
+    timeline(*decode(data))
+
+
+if __name__ == "__main__":
+    main()